@@ -131,10 +131,34 @@ dump_index(EdPgIdx *idx)
 	printf("gc_tail: %u\n", idx->gc_tail);
 	printf("tree: "); dump_page_array(idx->tree, ed_len(idx->tree));
 	printf("xid: %" PRIu64 "\n", idx->xid);
+	printf("xid_written: %" PRIu64 "\n", idx->xid_written);
+	printf("xid_synced: %" PRIu64 "\n", idx->xid_synced);
 	printf("vno: %" PRIu64 "\n", idx->vno);
+	printf("vres: %" PRIu64 "\n", idx->vres);
 	printf("slab_block_count: %" PRIu64 "\n", idx->slab_block_count);
 	printf("slab_ino: %" PRIu64 "\n", idx->slab_ino);
 	printf("slab_path: %s\n", idx->slab_path);
+	if (idx->active_next == ED_PG_NONE) {
+		printf("active_next: ~\n");
+	}
+	else {
+		printf("active_next: %u\n", idx->active_next);
+	}
+	if (idx->pin_start == ED_PG_NONE) {
+		printf("pin_start: ~\n");
+	}
+	else {
+		printf("pin_start: %u\n", idx->pin_start);
+	}
+	printf("npins: %u\n", idx->npins);
+	if (idx->filter_start == ED_PG_NONE) {
+		printf("filter_start: ~\n");
+	}
+	else {
+		printf("filter_start: %u\n", idx->filter_start);
+	}
+	printf("filter_count: %u\n", idx->filter_count);
+	printf("filter_xid: %" PRIu64 "\n", idx->filter_xid);
 	printf("active: "); dump_page_array(idx->active, idx->nactive);
 	printf("conns:\n");
 
@@ -226,6 +250,21 @@ dump_gc(EdPgGc *gc)
 	}
 }
 
+static void
+dump_active(EdPgActive *act)
+{
+	if (act->next == ED_PG_NONE) {
+		printf("next: ~\n");
+	}
+	else {
+		printf("next: %u\n", act->next);
+	}
+	printf("npages: %u\n", act->npages);
+	printf("pages: ");
+	dump_page_array(act->pages,
+			act->npages < ed_len(act->pages) ? act->npages : ed_len(act->pages));
+}
+
 static void
 dump_page(EdPgno no, EdPg *pg)
 {
@@ -263,6 +302,10 @@ dump_page(EdPgno no, EdPg *pg)
 		printf("gc\n");
 		if (dump_hex < 2) { dump_gc((EdPgGc *)pg); }
 		break;
+	case ED_PG_ACTIVE:
+		printf("active\n");
+		if (dump_hex < 2) { dump_active((EdPgActive *)pg); }
+		break;
 	default:
 		printf("unused\n");
 		break;
@@ -387,7 +430,8 @@ static int
 dump_block(const void *ent, char *buf, size_t len)
 {
 	const EdEntryBlock *b = ent;
-	return snprintf(buf, len, "%" PRIu64 "#%" PRIu32, b->no, b->count);
+	return snprintf(buf, len, "%" PRIu64 "#%" PRIu32 " %08x",
+			b->no, b->count, (uint32_t)(b->keyhash >> 32));
 }
 
 int
@@ -18,6 +18,15 @@ static EdOption get_opts[] = {
 	{0, 0, 0, 0, 0}
 };
 
+static void
+get_unlink(EdCache *cache, EdObject *obj)
+{
+	int rc = ed_unlink(cache, obj->key, obj->keylen);
+	if (rc < 0) {
+		warnx("failed to unlink object: %s", ed_strerror(rc));
+	}
+}
+
 static int
 get_run(const EdCommand *cmd, int argc, char *const *argv)
 {
@@ -84,7 +93,7 @@ get_run(const EdCommand *cmd, int argc, char *const *argv)
 						"key hash: %" PRIu64 "\n"
 						,
 						obj->id,
-						obj->vno %cache->slab_block_count,
+						(uint64_t)(obj->byte / cache->slab_block_size),
 						obj->vno,
 						obj->nblcks,
 						ttl,
@@ -100,6 +109,9 @@ get_run(const EdCommand *cmd, int argc, char *const *argv)
 					printf("meta crc: %u\ndata crc: %u\n",
 							obj->hdr->metacrc, obj->hdr->datacrc);
 				}
+				if (unlink) {
+					get_unlink(cache, obj);
+				}
 				ed_close(&obj);
 			}
 		}
@@ -116,25 +128,25 @@ get_run(const EdCommand *cmd, int argc, char *const *argv)
 			if (!meta) { warnx("key not found"); }
 		}
 		else {
-			size_t len;
-			const void *data = ed_value(obj, &len);
-			if (write(STDOUT_FILENO, data, len) < 0) {
-				warn("write failed");
+			ssize_t n;
+			while ((n = ed_splice(obj, STDOUT_FILENO, SIZE_MAX)) > 0) {}
+			if (n < 0) {
+				warnx("write failed: %s", ed_strerror((int)n));
 			}
 			if (meta) {
-				data = ed_meta(obj, &len);
+				size_t len;
+				const void *data = ed_meta(obj, &len);
 				if (write(STDERR_FILENO, data, len) < 0) {
 					warn("write failed");
 				}
 			}
+			if (unlink) {
+				get_unlink(cache, obj);
+			}
 			ed_close(&obj);
 		}
 	}
 
-	if (unlink) {
-		warnx("-u not yet supported");
-	}
-
 	ed_cache_close(&cache);
 	return rc == 1 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
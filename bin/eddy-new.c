@@ -6,7 +6,7 @@
 static const EdUsage new_usage = {
 	"Creates a new cache index and slab.",
 	(const char *[]) {
-		"[-v] [-f] [-C] [-s size] [-b size] [-S slab] index",
+		"[-v] [-f] [-C] [-A] [-s size] [-b size] [-S slab] [-L pct] [-T tier] [-Z size] [-G size[:pct]] [-P size] index",
 		NULL
 	},
 	"size:\n"
@@ -29,6 +29,12 @@ static EdOption new_opts[] = {
 	{"no-checksum",NULL,   0, 'C', "disable tracking crc32 checksums"},
 	{"keep-old",   NULL,   0, 'k', "don't mark replaced objects as expired"},
 	{"page-align", NULL,   0, 'p', "force file data to be page aligned"},
+	{"clock",      "pct",  0, 'L', "reinsert recently read objects, up to pct of the slab per pass"},
+	{"admit",      NULL,   0, 'A', "reject new objects read less often than those they would evict"},
+	{"tier",       "path", 0, 'T', "move evicted objects to a second slab file at path"},
+	{"tier-size",  "size", 0, 'Z', "size of the tier slab file (default is the slab size)"},
+	{"ring",       "size[:pct]", 0, 'G', "write objects up to size to their own ring of pct of the slab (default " ED_STR(ED_RING_PERCENT) ")"},
+	{"pack",       "size", 0, 'P', "pack objects up to size into shared blocks (at most half the block size)"},
 #if WITH_RAM
 	{"ram",        NULL,   0, 'R', "create the slab as a RAM-backed device"},
 #endif
@@ -91,6 +97,9 @@ new_run(const EdCommand *cmd, int argc, char *const *argv)
 	}
 
 	char *size_arg = DEFAULT_SIZE;
+	char *tier_size_arg = NULL;
+	char *ring_arg[ED_RING_MAX-1];
+	int nring = 0;
 	char *end;
 	long long val;
 	unsigned long long uval;
@@ -110,11 +119,37 @@ new_run(const EdCommand *cmd, int argc, char *const *argv)
 		case 'C': cfg.flags &= ~ED_FCHECKSUM; break;
 		case 'k': cfg.flags |= ED_FKEEPOLD; break;
 		case 'p': cfg.flags |= ED_FPAGEALIGN; break;
+		case 'A': cfg.flags |= ED_FADMIT; break;
 #if WITH_RAM
 		case 'R': ram = true; break;
 #endif
 		case 's': size_arg = optarg; break;
 		case 'S': cfg.slab_path = optarg; break;
+		case 'T':
+			cfg.flags |= ED_FTIER;
+			cfg.tier_path = optarg;
+			break;
+		case 'Z':
+			cfg.flags |= ED_FTIER;
+			tier_size_arg = optarg;
+			break;
+		case 'G':
+			if (nring == ED_RING_MAX-1) {
+				errx(1, "at most %d rings may be added", ED_RING_MAX-1);
+			}
+			cfg.flags |= ED_FRING;
+			ring_arg[nring++] = optarg;
+			break;
+		case 'P':
+			if (!ed_parse_size(optarg, &val, PAGESIZE)) {
+				errx(1, "%s must be a valid positive number", argv[optind-1]);
+			}
+			if (val < 1 || val > UINT16_MAX) {
+				errx(1, "%s must be be >= 1 and <= %u", argv[optind-1], UINT16_MAX);
+			}
+			cfg.flags |= ED_FPACK;
+			cfg.pack_size = (uint16_t)val;
+			break;
 		case 'b':
 			if (!ed_parse_size(optarg, &val, PAGESIZE)) {
 				errx(1, "%s must be a valid positive number", argv[optind-1]);
@@ -131,6 +166,14 @@ new_run(const EdCommand *cmd, int argc, char *const *argv)
 			}
 			cfg.seed = uval;
 			break;
+		case 'L':
+			uval = strtoull(optarg, &end, 10);
+			if (*end != '\0' || uval == 0 || uval > ED_CLOCK_MAX_PERCENT) {
+				errx(1, "%s must be > 0 and <= %u", argv[optind-1], ED_CLOCK_MAX_PERCENT);
+			}
+			cfg.flags |= ED_FCLOCK;
+			cfg.clock_percent = (uint8_t)uval;
+			break;
 		}
 	}
 	argc -= optind;
@@ -139,6 +182,23 @@ new_run(const EdCommand *cmd, int argc, char *const *argv)
 	if (!ed_parse_size(size_arg, &cfg.slab_size, cfg.slab_block_size)) {
 		errx(1, "size must be a valid positive number");
 	}
+	if (tier_size_arg && !ed_parse_size(tier_size_arg, &cfg.tier_size, cfg.slab_block_size)) {
+		errx(1, "tier size must be a valid positive number");
+	}
+	for (int i = 0; i < nring; i++) {
+		char *pct = strchr(ring_arg[i], ':');
+		if (pct != NULL) {
+			*pct++ = '\0';
+			uval = strtoull(pct, &end, 10);
+			if (*end != '\0' || uval == 0 || uval >= 100) {
+				errx(1, "ring percent must be > 0 and < 100");
+			}
+			cfg.ring_percent[i] = (uint8_t)uval;
+		}
+		if (!ed_parse_size(ring_arg[i], &cfg.ring_limit[i], cfg.slab_block_size)) {
+			errx(1, "ring size must be a valid positive number");
+		}
+	}
 
 	if (argc == 0) { errx(1, "index file path not provided"); }
 	cfg.index_path = argv[0];
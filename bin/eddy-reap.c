@@ -0,0 +1,55 @@
+#include "../lib/eddy-private.h"
+
+static const EdUsage reap_usage = {
+	"Removes expired objects from the cache index.",
+	(const char *[]) {
+		"[-n count] index",
+		NULL
+	},
+	"Objects are removed in order of expiration, so repeated runs with a\n"
+	"limit will continue where the previous run stopped."
+};
+static EdOption reap_opts[] = {
+	{"count", "num", 0, 'n', "maximum number of objects to remove (default is no limit)"},
+	{0, 0, 0, 0, 0}
+};
+
+static int
+reap_run(const EdCommand *cmd, int argc, char *const *argv)
+{
+	char *end;
+	unsigned long long uval;
+	unsigned budget = 0;
+	EdConfig cfg = { .flags = 0 };
+	EdCache *cache = NULL;
+
+	int ch;
+	while ((ch = ed_opt(argc, argv, cmd)) != -1) {
+		switch (ch) {
+		case 'n':
+			uval = strtoull(optarg, &end, 10);
+			if (*end != '\0' || uval == 0 || uval > INT_MAX) {
+				errx(1, "%s must be a valid positive number", argv[optind-1]);
+			}
+			budget = (unsigned)uval;
+			break;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc == 0) { errx(1, "index file path not provided"); }
+	cfg.index_path = argv[0];
+
+	int rc;
+
+	rc = ed_cache_open(&cache, &cfg);
+	if (rc < 0) { errx(1, "failed to open: %s", ed_strerror(rc)); }
+
+	rc = ed_cache_reap(cache, budget);
+	if (rc < 0) { errx(1, "failed to reap: %s", ed_strerror(rc)); }
+	printf("%d\n", rc);
+
+	ed_cache_close(&cache);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+#include "../lib/eddy-private.h"
+
+static const EdUsage rebuild_usage = {
+	"Rebuilds the cache index from the objects in the slab.",
+	(const char *[]) {
+		"[-j threads] index",
+		"-f [-C] [-k] [-p] [-b size] [-S slab] [-D seed] [-j threads] index",
+		NULL
+	},
+	"Removed, expired, and replaced objects are left out of the new index.\n"
+	"With --force, a new index file is created for an existing slab. The\n"
+	"flags, block size, and seed must match those used to create the slab."
+};
+static EdOption rebuild_opts[] = {
+	{"threads",    "num",  0, 'j', "number of threads scanning the slab (default is the CPU count)"},
+	{"force",      NULL,   0, 'f', "create a new index file for the slab"},
+	{"block-size", "size", 0, 'b', "byte size of the blocks in the slab (default 1p)"},
+	{"slab",       "path", 0, 'S', "path to slab file (default is the index path with \"-slab\" suffix)"},
+	{"seed",       "num",  0, 'D', "seed of the slab objects"},
+	{"no-checksum",NULL,   0, 'C', "the slab does not track crc32 checksums"},
+	{"keep-old",   NULL,   0, 'k', "don't mark replaced objects as expired"},
+	{"page-align", NULL,   0, 'p', "the slab data is page aligned"},
+	{0, 0, 0, 0, 0}
+};
+
+static int
+rebuild_run(const EdCommand *cmd, int argc, char *const *argv)
+{
+	char *end;
+	long long val;
+	unsigned long long uval;
+	unsigned nthreads = 0;
+	bool force = false;
+	EdConfig cfg = {
+		.flags = ED_FCHECKSUM,
+		.slab_block_size = 4096
+	};
+	EdCache *cache = NULL;
+
+	int ch;
+	while ((ch = ed_opt(argc, argv, cmd)) != -1) {
+		switch (ch) {
+		case 'f': force = true; break;
+		case 'C': cfg.flags &= ~ED_FCHECKSUM; break;
+		case 'k': cfg.flags |= ED_FKEEPOLD; break;
+		case 'p': cfg.flags |= ED_FPAGEALIGN; break;
+		case 'S': cfg.slab_path = optarg; break;
+		case 'j':
+			uval = strtoull(optarg, &end, 10);
+			if (*end != '\0' || uval > UINT16_MAX) {
+				errx(1, "%s must be a valid number", argv[optind-1]);
+			}
+			nthreads = (unsigned)uval;
+			break;
+		case 'b':
+			if (!ed_parse_size(optarg, &val, PAGESIZE)) {
+				errx(1, "%s must be a valid positive number", argv[optind-1]);
+			}
+			if (val < 16 || val > UINT16_MAX) {
+				errx(1, "%s must be be >= 16 and <= %u", argv[optind-1], UINT16_MAX);
+			}
+			cfg.slab_block_size = (uint16_t)val;
+			break;
+		case 'D':
+			uval = strtoull(optarg, &end, 10);
+			if (*end != '\0') {
+				errx(1, "%s must be a valid number", argv[optind-1]);
+			}
+			cfg.seed = uval;
+			break;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc == 0) { errx(1, "index file path not provided"); }
+	cfg.index_path = argv[0];
+
+	// Without --force, the flags are taken from the existing index.
+	if (force) {
+		cfg.flags |= ED_FCREATE|ED_FREPLACE;
+	}
+	else {
+		cfg.flags = 0;
+	}
+
+	int rc;
+
+	rc = ed_cache_open(&cache, &cfg);
+	if (rc < 0) { errx(1, "failed to open: %s", ed_strerror(rc)); }
+
+	rc = ed_cache_rebuild(cache, nthreads);
+	if (rc < 0) { errx(1, "failed to rebuild: %s", ed_strerror(rc)); }
+
+	ed_cache_close(&cache);
+	return EXIT_SUCCESS;
+}
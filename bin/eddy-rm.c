@@ -33,7 +33,7 @@ rm_run(const EdCommand *cmd, int argc, char *const *argv)
 	if (rc < 0) { errx(1, "failed to open index '%s': %s", cfg.index_path, ed_strerror(rc)); }
 
 	for (int i = 1; i < argc; i++) {
-		rc = ed_update_ttl(cache, argv[i], strlen(argv[i]), 0, false);
+		rc = ed_unlink(cache, argv[i], strlen(argv[i]));
 		if (rc < 0) {
 			warnx("faild to remove object: %s", ed_strerror(rc));
 			break;
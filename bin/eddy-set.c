@@ -70,23 +70,20 @@ set_run(const EdCommand *cmd, int argc, char *const *argv)
 
 	attr.meta = meta.data;
 	attr.metalen = meta.length;
-	attr.datalen = data.length;
 
-	EdObject *obj;
-	rc = ed_create(cache, &obj, &attr);
+	EdTimeTTL ttl = -1;
+	if (has_ttl) {
+		ttl = t;
+	}
+	else if (has_expiry && t >= 0) {
+		time_t now = time(NULL);
+		ttl = t > now ? t - now : 0;
+	}
+
+	rc = ed_set(cache, &attr, data.data, data.length, ttl);
 	if (rc < 0) {
 		warnx("faild to create object: %s", ed_strerror(rc));
 	}
-	else {
-		if (has_ttl) {
-			ed_set_ttl(obj, t);
-		}
-		else if (has_expiry) {
-			ed_set_expiry(obj, t);
-		}
-		ed_write(obj, data.data, data.length);
-		ed_close(&obj);
-	}
 
 	ed_input_final(&data);
 	ed_input_final(&meta);
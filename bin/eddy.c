@@ -349,6 +349,8 @@ ed_parse_size(const char *val, long long *out, size_t block)
 #include "eddy-rm.c"
 #include "eddy-ls.c"
 #include "eddy-stat.c"
+#include "eddy-rebuild.c"
+#include "eddy-reap.c"
 #if ED_DUMP
 # include "eddy-dump.c"
 #endif
@@ -364,6 +366,8 @@ static const EdCommand commands[] = {
 	{"rm",      rm_opts,      rm_run,      &rm_usage},
 	{"ls",      ls_opts,      ls_run,      &ls_usage},
 	{"stat",    stat_opts,    stat_run,    &stat_usage},
+	{"rebuild", rebuild_opts, rebuild_run, &rebuild_usage},
+	{"reap",    reap_opts,    reap_run,    &reap_usage},
 	{"version", version_opts, version_run, &version_usage},
 #if ED_DUMP
 	{"dump",    dump_opts,    dump_run,    &dump_usage},
@@ -20,6 +20,12 @@ _Static_assert(offsetof(EdBpt, data) % 8 == 0,
 #define IS_BRANCH_FULL(n) ((n)->nkeys == (BRANCH_ORDER-1))
 #define IS_LEAF_FULL(n, esize) ((n)->nkeys == LEAF_ORDER(esize))
 #define IS_FULL(n, esize) (IS_BRANCH(n) ? IS_BRANCH_FULL(n) : IS_LEAF_FULL(n, esize))
+#define IS_BRANCH_LOW(n) ((size_t)(n)->nkeys+1 < BRANCH_ORDER/4)
+#define IS_LEAF_LOW(n, esize) ((n)->nkeys == 0 || (n)->nkeys < LEAF_ORDER(esize)/4)
+#define IS_LOW(n, esize) (IS_BRANCH(n) ? IS_BRANCH_LOW(n) : IS_LEAF_LOW(n, esize))
+
+// Merged nodes keep a quarter of the order free so inserts don't split them again.
+#define MERGE_LIMIT(order) ((order) - (order)/4)
 
 static inline uint64_t
 branch_key(EdBpt *b, uint16_t idx)
@@ -59,19 +65,81 @@ branch_index(EdBpt *b, EdPgno *ptr)
 	return ((uint8_t *)ptr - b->data) / BRANCH_ENTRY_SIZE;
 }
 
+/**
+ * @brief  Finds the first key in a strided array that is not less than a key
+ *
+ * The loop has a fixed number of iterations for a given length, and the
+ * comparison selects the next base rather than branching, so the search does
+ * not suffer from mispredictions on random keys.
+ *
+ * @param  p  Pointer to the first key
+ * @param  n  Number of keys
+ * @param  stride  Number of bytes between keys
+ * @param  key  Key to search for
+ * @return  Index of the first key >= #key, or #n if all keys are less
+ */
+static inline uint32_t
+search_lower(const uint8_t *p, uint32_t n, size_t stride, uint64_t key)
+{
+	if (n == 0) { return 0; }
+	const uint8_t *base = p;
+	while (n > 1) {
+		uint32_t half = n / 2;
+		base = ed_fetch64(base + half*stride) < key ? base + half*stride : base;
+		n -= half;
+	}
+	return (uint32_t)((base - p) / stride) + (ed_fetch64(base) < key);
+}
+
+/**
+ * @brief  Number of keys checked around an interpolated guess
+ *
+ * If the lower bound isn't found within this many steps of the guess, the
+ * keys aren't uniform enough near the key, and the remaining range is
+ * binary searched instead.
+ */
+#define INTERP_SCAN 4
+
+uint32_t
+ed_bpt_search(const void *keys, uint32_t n, size_t stride, uint64_t key)
+{
+	const uint8_t *k = keys;
+	if (n == 0) { return 0; }
+
+	uint64_t lo = ed_fetch64(k), hi = ed_fetch64(k + (n-1)*stride);
+	if (key <= lo) { return 0; }
+	if (key > hi) { return n; }
+
+	// The span is non-zero here. Scale it to 32 bits so the product with the
+	// index cannot overflow.
+	uint64_t span = hi - lo, off = key - lo;
+	int shift = span > UINT32_MAX ? 32 - __builtin_clzll(span) : 0;
+	uint32_t i = (uint32_t)(((off >> shift) * (n - 1)) / (span >> shift));
+
+	if (ed_fetch64(k + i*stride) < key) {
+		uint32_t end = i + INTERP_SCAN < n ? i + INTERP_SCAN : n;
+		for (i++; i < end; i++) {
+			if (ed_fetch64(k + i*stride) >= key) { return i; }
+		}
+		return i + search_lower(k + i*stride, n - i, stride, key);
+	}
+	else {
+		uint32_t end = i > INTERP_SCAN ? i - INTERP_SCAN : 0;
+		for (; i > end; i--) {
+			if (ed_fetch64(k + (i-1)*stride) < key) { return i; }
+		}
+		return search_lower(k, i, stride, key);
+	}
+}
+
 static EdPgno *
 branch_search(EdBpt *b, uint64_t key)
 {
-	// TODO: binary search or SIMD
-	EdPgno *ptr = (EdPgno *)b->data;
-	uint8_t *bkey = b->data + BRANCH_PTR_SIZE;
-	for (uint32_t i = 0, n = b->nkeys; i < n; i++, bkey += BRANCH_ENTRY_SIZE) {
-		uint64_t cmp = ed_fetch64(bkey);
-		if (key < cmp) { break; }
-		ptr = BRANCH_NEXT(ptr);
-		if (key == cmp) { break; }
-	}
-	return ptr;
+	const uint8_t *keys = b->data + BRANCH_PTR_SIZE;
+	uint32_t i = ed_bpt_search(keys, b->nkeys, BRANCH_ENTRY_SIZE, key);
+	// An equal key belongs to the right child.
+	if (i < b->nkeys && ed_fetch64(keys + i*BRANCH_ENTRY_SIZE) == key) { i++; }
+	return (EdPgno *)(b->data + i*BRANCH_ENTRY_SIZE);
 }
 
 static inline uint64_t
@@ -147,19 +215,15 @@ ed_bpt_find(EdTxn *txn, unsigned db, uint64_t key, void **ent)
 	else { dbp->nsplits = 0; }
 
 	// Search the leaf node.
-	data = node->tree->data;
-	for (i = 0, n = node->tree->nkeys; i < n; i++, data += esize) {
-		uint64_t cmp = ed_fetch64(data);
-		if (key == cmp) {
-			kmax = cmp;
-			rc = 1;
-			break;
-		}
-		else if (key < cmp) {
-			kmax = cmp;
-			break;
-		}
-		kmin = cmp;
+	n = node->tree->nkeys;
+	i = ed_bpt_search(node->tree->data, n, esize, key);
+	data = node->tree->data + i*esize;
+	if (i > 0) {
+		kmin = ed_fetch64(data - esize);
+	}
+	if (i < n) {
+		kmax = ed_fetch64(data);
+		if (kmax == key) { rc = 1; }
 	}
 
 done:
@@ -223,7 +287,10 @@ static int
 move_first(EdTxn *txn, EdTxnDb *dbp, EdNode *from, uint64_t kmin, uint64_t kmax)
 {
 	int rc = 0;
-	if (from == NULL) { goto done; }
+	if (from == NULL) {
+		dbp->find = NULL;
+		goto done;
+	}
 
 	while (IS_BRANCH(from->tree)) {
 		EdPgno no = branch_ptr(from->tree, 0);
@@ -242,8 +309,8 @@ done:
 	if (rc >= 0) {
 		dbp->kmin = kmin;
 		dbp->kmax = kmax;
-		dbp->hasentry = true;
-		dbp->entry = dbp->find->tree->data;
+		dbp->hasentry = dbp->find != NULL;
+		dbp->entry = dbp->find ? dbp->find->tree->data : NULL;
 		dbp->entry_index = 0;
 	}
 	dbp->match = rc;
@@ -378,7 +445,10 @@ ed_bpt_first(EdTxn *txn, unsigned db, void **ent)
 		dbp->start = dbp->entry;
 		dbp->nloops = 0;
 		dbp->hasfind = true;
-		if (ent) { *ent = dbp->entry; }
+		if (ent) {
+			// An empty tree has no first entry.
+			*ent = dbp->find && dbp->find->tree->nkeys > 0 ? dbp->entry : NULL;
+		}
 	}
 	return rc;
 }
@@ -810,10 +880,273 @@ ed_bpt_set(EdTxn *txn, unsigned db, const void *ent, bool replace)
 	return 0;
 }
 
+/**
+ * @brief  Makes a node writable within the transaction
+ *
+ * If the node is from a prior transaction, it is replaced with a full copy.
+ * The caller is responsible for updating any references to the node.
+ *
+ * @param  txn  Transaction object
+ * @param  node  Indirect node pointer to update
+ * @return  0 on success, <0 on error
+ */
+static int
+node_own(EdTxn *txn, EdNode **node)
+{
+	EdNode *src = *node;
+	if (src->tree->xid == txn->xid) { return 0; }
+	int rc = ed_txn_clone(txn, src, node);
+	if (rc < 0) { return rc; }
+	memcpy((*node)->tree->data, src->tree->data, sizeof(src->tree->data));
+	return 0;
+}
+
+/**
+ * @brief  Removes a key and the pointer to its right from a branch
+ * @param  b  Branch tree
+ * @param  idx  Index of the pointer to remove, which must be >0
+ */
+static void
+branch_remove(EdBpt *b, uint16_t idx)
+{
+	assert(0 < idx && idx <= b->nkeys);
+	size_t pos = idx*BRANCH_ENTRY_SIZE - BRANCH_KEY_SIZE;
+	size_t end = BRANCH_PTR_SIZE + b->nkeys*BRANCH_ENTRY_SIZE;
+	memmove(b->data + pos, b->data + pos + BRANCH_ENTRY_SIZE, end - pos - BRANCH_ENTRY_SIZE);
+	b->nkeys--;
+}
+
+/**
+ * @brief  Gets a key from two adjacent leaves as if they were joined
+ * @param  l  Left leaf
+ * @param  r  Right leaf
+ * @param  idx  Index into the joined entries
+ * @param  esize  Entry size
+ * @return  Key value
+ */
+static inline uint64_t
+pair_key(EdBpt *l, EdBpt *r, uint16_t idx, size_t esize)
+{
+	return idx < l->nkeys ? leaf_key(l, idx, esize) : leaf_key(r, idx - l->nkeys, esize);
+}
+
+/**
+ * @brief  Merges or redistributes two adjacent leaves
+ *
+ * Both leaves and their parent must be writable. The find position is moved
+ * along with its entry.
+ *
+ * Repeated keys cannot span leaves, so entries are only redistributed at a
+ * point between two different keys. If no such point leaves the smaller
+ * leaf any better off, the leaves are left as they are.
+ *
+ * @param  txn  Transaction object
+ * @param  dbp  Transaction database object
+ * @param  left  Left leaf
+ * @param  right  Right leaf with the pointer immediately after #left
+ * @return  1 if merged, 0 if not, <0 on error
+ */
+static int
+rebalance_leaf(EdTxn *txn, EdTxnDb *dbp, EdNode *left, EdNode *right)
+{
+	EdBpt *l = left->tree, *r = right->tree;
+	EdBpt *p = left->parent->tree;
+	size_t esize = dbp->entry_size;
+	uint16_t nl = l->nkeys, nr = r->nkeys, n = nl + nr;
+
+	if (n <= MERGE_LIMIT(LEAF_ORDER(esize))) {
+		memcpy(l->data + nl*esize, r->data, nr*esize);
+		l->nkeys = n;
+		if (dbp->find == right) {
+			dbp->find = left;
+			dbp->entry_index += nl;
+		}
+		branch_remove(p, right->pindex);
+		int rc = ed_txn_discard(txn, right);
+		return rc < 0 ? rc : 1;
+	}
+
+	// Find the most even split point that isn't within a run of repeated keys.
+	uint16_t m = 0;
+	for (uint16_t d = 0; d < n/2 && m == 0; d++) {
+		uint16_t lo = n/2 - d, hi = n/2 + d;
+		if (pair_key(l, r, lo-1, esize) != pair_key(l, r, lo, esize)) { m = lo; }
+		else if (hi < n && pair_key(l, r, hi-1, esize) != pair_key(l, r, hi, esize)) { m = hi; }
+	}
+	uint16_t low = nl < nr ? nl : nr;
+	if (m == 0 || (m < n-m ? m : n-m) <= low) { return 0; }
+
+	if (m > nl) {
+		uint16_t k = m - nl;
+		memcpy(l->data + nl*esize, r->data, k*esize);
+		memmove(r->data, r->data + k*esize, (nr - k)*esize);
+		if (dbp->find == right) {
+			if (dbp->entry_index < k) {
+				dbp->find = left;
+				dbp->entry_index += nl;
+			}
+			else {
+				dbp->entry_index -= k;
+			}
+		}
+	}
+	else {
+		uint16_t k = nl - m;
+		memmove(r->data + k*esize, r->data, nr*esize);
+		memcpy(r->data, l->data + m*esize, k*esize);
+		if (dbp->find == right) {
+			dbp->entry_index += k;
+		}
+		else if (dbp->entry_index >= m) {
+			dbp->find = right;
+			dbp->entry_index -= m;
+		}
+	}
+	l->nkeys = m;
+	r->nkeys = n - m;
+	branch_set_key(p, right->pindex, leaf_key(r, 0, esize));
+	return 0;
+}
+
+/**
+ * @brief  Merges or redistributes two adjacent branches
+ *
+ * Both branches and their parent must be writable. The separating key from
+ * the parent is pulled down between the two sets of entries, and when
+ * redistributing, the middle key is pushed back up to the parent.
+ *
+ * @param  txn  Transaction object
+ * @param  left  Left branch
+ * @param  right  Right branch with the pointer immediately after #left
+ * @return  1 if merged, 0 if not, <0 on error
+ */
+static int
+rebalance_branch(EdTxn *txn, EdNode *left, EdNode *right)
+{
+	EdBpt *l = left->tree, *r = right->tree;
+	EdBpt *p = left->parent->tree;
+	uint16_t nl = l->nkeys, nr = r->nkeys, n = nl + nr + 1;
+	size_t lsize = BRANCH_PTR_SIZE + nl*BRANCH_ENTRY_SIZE;
+	size_t rsize = BRANCH_PTR_SIZE + nr*BRANCH_ENTRY_SIZE;
+
+	// Join the entries as: left entries, separator key, right entries.
+	uint8_t buf[2*sizeof(l->data) + BRANCH_KEY_SIZE];
+	uint64_t sep = branch_key(p, right->pindex);
+	memcpy(buf, l->data, lsize);
+	memcpy(buf + lsize, &sep, sizeof(sep));
+	memcpy(buf + lsize + BRANCH_KEY_SIZE, r->data, rsize);
+
+	if ((size_t)n + 1 <= MERGE_LIMIT(BRANCH_ORDER)) {
+		memcpy(l->data, buf, lsize + BRANCH_KEY_SIZE + rsize);
+		l->nkeys = n;
+		branch_remove(p, right->pindex);
+		int rc = ed_txn_discard(txn, right);
+		return rc < 0 ? rc : 1;
+	}
+
+	uint16_t m = (n - 1) / 2;
+	size_t off = BRANCH_PTR_SIZE + m*BRANCH_ENTRY_SIZE;
+	memcpy(l->data, buf, off);
+	memcpy(r->data, buf + off + BRANCH_KEY_SIZE, BRANCH_PTR_SIZE + (n - m - 1)*BRANCH_ENTRY_SIZE);
+	l->nkeys = m;
+	r->nkeys = n - m - 1;
+	branch_set_key(p, right->pindex, ed_fetch64(buf + off));
+	return 0;
+}
+
+/**
+ * @brief  Restores the minimum fill of a node after a removal
+ *
+ * An underfilled node is merged with or takes entries from a sibling. Each
+ * merge removes an entry from the parent, so this repeats up the tree as
+ * needed. A root branch left with a single child is replaced by that child.
+ * All modified nodes are linked back into the tree up to the root.
+ *
+ * @param  txn  Transaction object
+ * @param  dbp  Transaction database object
+ * @param  node  Writable node that had entries removed
+ * @return  0 on success, <0 on error
+ */
+static int
+rebalance(EdTxn *txn, EdTxnDb *dbp, EdNode *node)
+{
+	int rc;
+
+	while (node->parent != NULL) {
+		EdNode *parent = node->parent;
+		if (!IS_LOW(node->tree, dbp->entry_size) || parent->tree->nkeys == 0) {
+			return set_node(txn, dbp, node);
+		}
+
+		rc = node_own(txn, &parent);
+		if (rc < 0) { return rc; }
+		node->parent = parent;
+		branch_set_ptr(parent->tree, node->pindex, node->page->no);
+
+		// Prefer the left sibling, as the right-most child is the only one without.
+		uint16_t sidx = node->pindex > 0 ? node->pindex - 1 : node->pindex + 1;
+		EdNode *sib;
+		rc = ed_txn_map(txn, branch_ptr(parent->tree, sidx), parent, sidx, &sib);
+		if (rc < 0) { return rc; }
+		rc = node_own(txn, &sib);
+		if (rc < 0) { return rc; }
+		branch_set_ptr(parent->tree, sidx, sib->page->no);
+
+		EdNode *left = sidx < node->pindex ? sib : node;
+		EdNode *right = sidx < node->pindex ? node : sib;
+		rc = IS_BRANCH(node->tree) ?
+			rebalance_branch(txn, left, right) :
+			rebalance_leaf(txn, dbp, left, right);
+		if (rc < 0) { return rc; }
+		if (rc == 0) { return set_node(txn, dbp, parent); }
+		node = parent;
+	}
+
+	if (IS_BRANCH(node->tree) && node->tree->nkeys == 0) {
+		EdNode *child;
+		rc = ed_txn_map(txn, branch_ptr(node->tree, 0), NULL, 0, &child);
+		if (rc < 0) { return rc; }
+		rc = ed_txn_discard(txn, node);
+		if (rc < 0) { return rc; }
+		node = child;
+	}
+	dbp->root = node;
+	return 0;
+}
+
+/**
+ * @brief  Remaps the path from the root to the find leaf
+ *
+ * Rebalancing can move the find leaf to a different parent or position, so
+ * the parent links are refreshed by searching for the first key in the leaf.
+ *
+ * @param  txn  Transaction object
+ * @param  dbp  Transaction database object
+ * @return  0 on success, <0 on error
+ */
+static int
+remap_find(EdTxn *txn, EdTxnDb *dbp)
+{
+	EdNode *node = dbp->root, *leaf = dbp->find;
+	if (leaf->tree->nkeys == 0) {
+		assert(node == leaf);
+		return 0;
+	}
+
+	uint64_t key = leaf_key(leaf->tree, 0, dbp->entry_size);
+	while (IS_BRANCH(node->tree)) {
+		EdPgno *ptr = branch_search(node->tree, key);
+		uint16_t bidx = branch_index(node->tree, ptr);
+		int rc = ed_txn_map(txn, branch_ptr(node->tree, bidx), node, bidx, &node);
+		if (rc < 0) { return rc; }
+	}
+	assert(node == leaf);
+	return 0;
+}
+
 int
 ed_bpt_del(EdTxn *txn, unsigned db)
 {
-	// FIXME: this function is terrible
 	if (ed_txn_isrdonly(txn)) { return ED_EINDEX_RDONLY; }
 
 	EdTxnDb *dbp = ed_txn_db(txn, db, false);
@@ -824,29 +1157,32 @@ ed_bpt_del(EdTxn *txn, unsigned db)
 	size_t esize = dbp->entry_size;
 	uint32_t eidx = dbp->entry_index;
 
-	if (leaf->tree->xid < txn->xid) {
-		EdNode *src = leaf;
-		int rc = ed_txn_clone(txn, src, &leaf);
-		if (rc < 0) { return rc; }
-		memcpy(leaf->tree->data, src->tree->data, sizeof(leaf->tree->data));
-		rc = set_node(txn, dbp, leaf);
+	int rc = node_own(txn, &leaf);
+	if (rc < 0) { return rc; }
+	dbp->find = leaf;
+
+	uint8_t *entry = leaf->tree->data + eidx*esize;
+	memmove(entry, entry + esize, (leaf->tree->nkeys - eidx - 1) * esize);
+	leaf->tree->nkeys--;
+
+	// Move the separator up to the new first key of the leaf.
+	if (eidx == 0 && leaf->tree->nkeys > 0 && leaf->parent && leaf->pindex > 0) {
+		EdNode *parent = leaf->parent;
+		rc = node_own(txn, &parent);
 		if (rc < 0) { return rc; }
-		dbp->entry = leaf->tree->data + esize*eidx;
-		dbp->find = leaf;
+		leaf->parent = parent;
+		branch_set_key(parent->tree, leaf->pindex, leaf_key(leaf->tree, 0, esize));
 	}
 
-	memmove(dbp->entry, (uint8_t *)dbp->entry + esize,
-			(leaf->tree->nkeys - eidx - 1) * esize);
-	if (leaf->tree->nkeys == 1) {
-		leaf->tree->nkeys = 0;
-	}
-	else {
-		leaf->tree->nkeys--;
-#if 0
-		if (leaf->parent && eidx == 0) {
-			branch_set_key(leaf->parent->tree, leaf->pindex, ed_fetch64(dbp->entry));
-		}
-#endif
+	rc = rebalance(txn, dbp, leaf);
+	if (rc < 0) { return rc; }
+	rc = remap_find(txn, dbp);
+	if (rc < 0) { return rc; }
+
+	leaf = dbp->find;
+	dbp->entry = leaf->tree->data + dbp->entry_index*esize;
+	if (dbp->entry_index > 0) {
+		dbp->kmin = ed_fetch64((uint8_t *)dbp->entry - esize);
 	}
 	if (dbp->entry_index == leaf->tree->nkeys) {
 		dbp->kmax = find_kmax(leaf);
@@ -859,6 +1195,145 @@ ed_bpt_del(EdTxn *txn, unsigned db)
 	return 1;
 }
 
+/**
+ * @brief  Discards every page of a tree
+ *
+ * Pages that do not look like tree nodes are skipped rather than followed.
+ * This leaks them, but a damaged tree cannot send the walk into other pages.
+ *
+ * @param  txn  Transaction object
+ * @param  no  Page number of the subtree root
+ * @param  depth  Depth of the page in the tree
+ * @return  0 on success, <0 on error
+ */
+static int
+discard_tree(EdTxn *txn, EdPgno no, int depth)
+{
+	if (depth > 16) { return 0; }
+
+	EdPg *pg = ed_idx_map(txn->idx, no);
+	if (pg == MAP_FAILED) { return ED_ERRNO; }
+
+	EdBpt *b = (EdBpt *)pg;
+	int rc = 0;
+	if (IS_BRANCH(b) && b->nkeys < BRANCH_ORDER) {
+		for (uint32_t i = 0; rc == 0 && i <= b->nkeys; i++) {
+			rc = discard_tree(txn, branch_ptr(b, i), depth+1);
+		}
+	}
+	if (rc == 0 && (IS_BRANCH(b) || pg->type == ED_PG_LEAF)) {
+		EdNode node = { .page = pg };
+		rc = ed_txn_discard(txn, &node);
+	}
+	ed_idx_unmap(txn->idx, pg);
+	return rc;
+}
+
+/**
+ * @brief  Allocates a node for the bulk loader
+ * @param  txn  Transaction object
+ * @param  type  Page type of the node
+ * @param  nkeys  Number of keys in the node
+ * @param  out  Node pointer to assign to
+ * @return  0 on success, <0 on error
+ */
+static int
+load_node(EdTxn *txn, uint32_t type, uint16_t nkeys, EdNode **out)
+{
+	int rc = ed_txn_alloc(txn, NULL, 0, out);
+	if (rc < 0) { return rc; }
+	(*out)->page->type = type;
+	(*out)->tree->next = ED_PG_NONE;
+	(*out)->tree->nkeys = nkeys;
+	return 0;
+}
+
+int
+ed_bpt_load(EdTxn *txn, unsigned db, const void *ents, size_t nents)
+{
+	if (ed_txn_isrdonly(txn)) { return ED_EINDEX_RDONLY; }
+
+	EdTxnDb *dbp = ed_txn_db(txn, db, true);
+	const uint8_t *p = ents;
+	size_t esize = dbp->entry_size;
+	EdPgno *nos = NULL;
+	uint64_t *keys = NULL;
+	size_t n = 0, nslot = 0;
+	EdNode *node = NULL;
+	int rc = 0;
+
+	if (dbp->root != NULL) {
+		rc = discard_tree(txn, dbp->root->page->no, 0);
+		if (rc < 0) { return rc; }
+	}
+
+	// Fill every leaf, except that a run of repeated keys is never split.
+	for (size_t i = 0; i < nents; ) {
+		size_t m = nents - i;
+		if (m > LEAF_ORDER(esize)) {
+			m = LEAF_ORDER(esize);
+			uint64_t k = ed_fetch64(p + (i+m)*esize);
+			while (m > 0 && ed_fetch64(p + (i+m-1)*esize) == k) { m--; }
+			if (m == 0) {
+				rc = ED_EINDEX_DUPKEY;
+				goto done;
+			}
+		}
+
+		if (n == nslot) {
+			nslot = nslot ? nslot * 2 : 64;
+			EdPgno *nnos = realloc(nos, nslot * sizeof(*nos));
+			if (nnos == NULL) { rc = ED_ERRNO; goto done; }
+			nos = nnos;
+			uint64_t *nkeys = realloc(keys, nslot * sizeof(*keys));
+			if (nkeys == NULL) { rc = ED_ERRNO; goto done; }
+			keys = nkeys;
+		}
+
+		rc = load_node(txn, ED_PG_LEAF, (uint16_t)m, &node);
+		if (rc < 0) { goto done; }
+		memcpy(node->tree->data, p + i*esize, m*esize);
+		nos[n] = node->page->no;
+		keys[n] = ed_fetch64(p + i*esize);
+		n++;
+		i += m;
+	}
+
+	// Build each branch level from the first key of its children. The level is
+	// rewritten in place as each branch consumes at least as many children.
+	while (n > 1) {
+		size_t nb = 0;
+		for (size_t i = 0; i < n; ) {
+			size_t m = n - i;
+			if (m > BRANCH_ORDER) {
+				m = BRANCH_ORDER;
+				// Don't leave a final branch with a single child.
+				if (n - i - m == 1) { m--; }
+			}
+			rc = load_node(txn, ED_PG_BRANCH, (uint16_t)(m-1), &node);
+			if (rc < 0) { goto done; }
+			for (uint16_t j = 0; j < m; j++) {
+				branch_set_ptr(node->tree, j, nos[i+j]);
+				branch_set_key(node->tree, j, keys[i+j]);
+			}
+			nos[nb] = node->page->no;
+			keys[nb] = keys[i];
+			nb++;
+			i += m;
+		}
+		n = nb;
+	}
+
+done:
+	free(nos);
+	free(keys);
+	if (rc < 0) { return (txn->error = rc); }
+	dbp->root = dbp->find = node;
+	dbp->hasfind = false;
+	dbp->hasentry = false;
+	return 0;
+}
+
 static int
 bpt_mark_children(EdIdx *idx, EdStat *stat, EdBpt *brch, int depth, int *max)
 {
@@ -16,6 +16,7 @@ obj_new(EdObject **objp, const void *k, size_t klen, bool rdonly)
 {
 	EdObject *obj = calloc(1, sizeof(*obj) + (rdonly ? 0 : klen));
 	if (obj == NULL) { return ED_ERRNO; }
+	obj->pipe[0] = obj->pipe[1] = -1;
 	if (rdonly) {
 		obj->rdonly = true;
 	}
@@ -56,6 +57,12 @@ obj_slab_size(uint16_t keylen, uint16_t metalen, uint32_t datalen, uint16_t bloc
 	return ED_ALIGN_SIZE(obj_data_offset(keylen, metalen, flags) + datalen, block_size);
 }
 
+static size_t
+obj_pack_size(uint16_t keylen, uint16_t metalen, uint32_t datalen, uint64_t flags)
+{
+	return ED_ALIGN_SIZE(obj_data_offset(keylen, metalen, flags) + datalen, ED_PACK_ALIGN);
+}
+
 static uint8_t *
 obj_key(EdObjectHdr *hdr)
 {
@@ -74,12 +81,110 @@ obj_data(EdObjectHdr *hdr, uint64_t flags)
 	return (uint8_t *)hdr + obj_data_offset(hdr->keylen, hdr->metalen, flags);
 }
 
+/**
+ * @brief  Gets the number of rings in the slab
+ * @param  cache  Cache object
+ * @return  Number of rings, which is 1 without #ED_FRING
+ */
+static unsigned
+ring_total(const EdCache *cache)
+{
+	return cache->idx.ring ? (unsigned)cache->idx.ring->count : 1;
+}
+
+/**
+ * @brief  Gets the first slab block of a ring
+ * @param  cache  Cache object
+ * @param  ring  Ring index
+ * @return  Slab block number
+ */
+static EdBlkno
+ring_start(const EdCache *cache, unsigned ring)
+{
+	return cache->idx.ring ? cache->idx.ring->rings[ring].start : 0;
+}
+
+/**
+ * @brief  Gets the number of slab blocks in a ring
+ * @param  cache  Cache object
+ * @param  ring  Ring index
+ * @return  Number of blocks
+ */
+static EdBlkno
+ring_count(const EdCache *cache, unsigned ring)
+{
+	return cache->idx.ring ? cache->idx.ring->rings[ring].count : cache->slab_block_count;
+}
+
+/**
+ * @brief  Gets the end of the reserved blocks of a ring
+ *
+ * The first ring uses the reservation in the index header.
+ *
+ * @param  cache  Cache object
+ * @param  ring  Ring index
+ * @return  Pointer to the virtual block number
+ */
+static EdBlknoV *
+ring_vres(const EdCache *cache, unsigned ring)
+{
+	return ring > 0 ? &cache->idx.ring->rings[ring].vres : &cache->idx.hdr->vres;
+}
+
+/**
+ * @brief  Selects the ring for an object size
+ * @param  cache  Cache object
+ * @param  nblcks  Number of blocks in the object
+ * @return  Ring index
+ */
+static unsigned
+ring_for_size(const EdCache *cache, EdBlkno nblcks)
+{
+	const unsigned n = ring_total(cache);
+	for (unsigned i = 0; i + 1 < n; i++) {
+		if (nblcks <= cache->idx.ring->rings[i].limit) { return i; }
+	}
+	return n - 1;
+}
+
+/**
+ * @brief  Finds the ring holding a slab block
+ * @param  cache  Cache object
+ * @param  no  Slab block number
+ * @return  Ring index
+ */
+static unsigned
+ring_for_block(const EdCache *cache, EdBlkno no)
+{
+	unsigned i = ring_total(cache) - 1;
+	while (i > 0 && no < ring_start(cache, i)) { i--; }
+	return i;
+}
+
+/**
+ * @brief  Gets the slab block number for a virtual block number
+ * @param  cache  Cache object
+ * @param  vno  Virtual block number without #ED_VNO_TIER set
+ * @return  Slab block number
+ */
+static EdBlkno
+slab_no(const EdCache *cache, EdBlkno vno)
+{
+	if (cache->idx.ring == NULL) {
+		return ed_vno_pos(vno) % cache->slab_block_count;
+	}
+	const EdRing *ring = &cache->idx.ring->rings[ed_vno_ring(vno)];
+	return ring->start + ed_vno_pos(vno) % ring->count;
+}
+
 static void
 obj_init_basic(EdObject *obj, EdCache *cache, EdObjectHdr *hdr, EdBlkno vno, bool rdonly, EdTime exp)
 {
 	const uint16_t block_size = cache->slab_block_size;
-	size_t size = obj_slab_size(hdr->keylen, hdr->metalen, hdr->datalen, block_size,
-			cache->idx.flags);
+	const size_t off = ed_vno_offset(vno);
+	size_t size = ed_vno_ispacked(vno) ?
+		obj_pack_size(hdr->keylen, hdr->metalen, hdr->datalen, cache->idx.flags) :
+		obj_slab_size(hdr->keylen, hdr->metalen, hdr->datalen, block_size, cache->idx.flags);
 	obj->cache = cache;
 	obj->key = obj_key(hdr);
 	obj->keylen = hdr->keylen;
@@ -90,11 +195,12 @@ obj_init_basic(EdObject *obj, EdCache *cache, EdObjectHdr *hdr, EdBlkno vno, boo
 	obj->hdr = hdr;
 	obj->xid = hdr->xid;
 	obj->vno = vno;
-	obj->nblcks = size/block_size;
-	obj->byte = (vno % cache->slab_block_count) * block_size;
+	obj->nblcks = ED_ALIGN_SIZE(off + size, block_size)/block_size;
+	obj->byte = slab_no(cache, vno) * block_size + off;
 	obj->nbytes = size;
 	obj->exp = exp;
 	obj->rdonly = rdonly;
+	obj->locked = true;
 	snprintf(obj->id, sizeof(obj->id), "%" PRIx64 ":%" PRIx64, obj->xid, vno);
 }
 
@@ -106,6 +212,24 @@ obj_init(EdObject *obj, EdCache *cache, EdObjectHdr *hdr, EdBlkno vno, bool rdon
 	obj->data = obj_data(hdr, cache->idx.flags);
 }
 
+/**
+ * @brief  Checks the meta data and body of a mapped object against its checksums
+ * @param  hdr  Object header with the entire object mapped
+ * @param  flags  Flags used to locate the body data
+ * @return  0 if both match, <0 on error
+ */
+static int
+obj_hdr_verify(EdObjectHdr *hdr, uint64_t flags)
+{
+	if (hdr->metalen && ed_crc32c(0, obj_meta(hdr), hdr->metalen) != hdr->metacrc) {
+		return ED_EOBJECT_METACRC;
+	}
+	if (hdr->datalen && ed_crc32c(0, obj_data(hdr, flags), hdr->datalen) != hdr->datacrc) {
+		return ED_EOBJECT_DATACRC;
+	}
+	return 0;
+}
+
 static int
 obj_verify(const EdObject *obj, const uint64_t flags)
 {
@@ -120,370 +244,2693 @@ obj_verify(const EdObject *obj, const uint64_t flags)
 	return 0;
 }
 
-static int64_t
-obj_write(void *dst, const void *src, size_t len, uint32_t *crc, uint64_t flags)
+/**
+ * @brief  Tests if the blocks at a virtual block number have not been reserved again
+ *
+ * Writers publish the end of each region they reserve before writing to it,
+ * and always move forward through the virtual block numbers. The blocks remain
+ * intact until a reserved region reaches them on the next pass through the
+ * slab.
+ *
+ * @param  cache  Cache object
+ * @param  vno  Virtual block number
+ * @return  true if the blocks have not been reserved again
+ */
+static bool
+vno_current(const EdCache *cache, EdBlkno vno)
 {
-	if (flags & ED_FCHECKSUM) {
-		*crc = ed_crc32c(*crc, src, len);
+	const unsigned ring = ed_vno_ring(vno);
+	return *ring_vres(cache, ring) <= ed_vno_block(vno) + ring_count(cache, ring);
+}
+
+/**
+ * @brief  Tests if an object opened without a slab lock is unchanged
+ *
+ * Unlinked objects are also tombstoned by their header.
+ *
+ * @param  obj  Object opened with #ED_OOPTIMISTIC
+ * @return  true if the object has not been replaced
+ */
+static bool
+obj_current(const EdObject *obj)
+{
+	const volatile EdObjectHdr *hdr = obj->hdr;
+	__sync_synchronize();
+	return vno_current(obj->cache, obj->vno) && hdr->exp != ED_TIME_DELETE;
+}
+
+/**
+ * @brief  Initializes an object mapped without a slab lock
+ *
+ * A header being overwritten may describe a different size than the mapped
+ * region, so the size is checked along with the object itself.
+ *
+ * @param  obj  Object to initialize
+ * @param  cache  Cache object
+ * @param  hdr  Mapped object header
+ * @param  vno  Virtual block number of the object
+ * @param  count  Number of blocks mapped
+ * @param  exp  Expiry from the index
+ * @return  true if the object is current
+ */
+static bool
+obj_init_optimistic(EdObject *obj, EdCache *cache, EdObjectHdr *hdr,
+		EdBlkno vno, EdBlkno count, EdTime exp)
+{
+	obj_init(obj, cache, hdr, vno, true, exp);
+	obj->locked = false;
+	return obj->nblcks == count && obj_current(obj);
+}
+
+/**
+ * @brief  Maps a range of slab blocks
+ *
+ * When the entire slab is mapped, this returns a pointer into that mapping
+ * rather than creating a new one.
+ *
+ * @param  cache  Cache object
+ * @param  no  Starting block number
+ * @param  count  Number of blocks needed
+ * @param  need  Hint that the blocks will be needed soon
+ * @return  Pointer to the first block or MAP_FAILED on error
+ */
+static void *
+slab_map(const EdCache *cache, EdBlkno no, EdBlkno count, bool need)
+{
+	if (cache->slab != NULL) {
+		return cache->slab + no * cache->slab_block_size;
 	}
-	memcpy(dst, src, len);
-	return len;
+	return ed_blk_map(cache->idx.slabfd, no, count, cache->slab_block_size, need);
 }
 
+/**
+ * @brief  Unmaps blocks returned from #slab_map()
+ * @param  cache  Cache object
+ * @param  p  Pointer to the first block
+ * @param  count  Number of blocks mapped
+ */
 static void
-obj_hdr_final(EdObjectHdr *hdr, size_t nbytes, uint64_t flags)
+slab_unmap(const EdCache *cache, void *p, EdBlkno count)
 {
-	uint8_t *data = obj_data(hdr, flags) + hdr->datalen;
-	memset(data, 0, nbytes - (data - (uint8_t *)hdr));
+	if (cache->slab == NULL) {
+		ed_blk_unmap(p, count, cache->slab_block_size);
+	}
 }
 
-static bool
-obj_overlap(const EdEntryBlock *block, EdBlkno start, EdBlkno end)
+/**
+ * @brief  Maps the header of an object in the slab
+ *
+ * Packed objects are mapped from the start of their block.
+ *
+ * @param  cache  Cache object
+ * @param  vno  Virtual block number of the object
+ * @param  count  Number of blocks needed
+ * @param  need  Hint that the blocks will be needed soon
+ * @return  Pointer to the object header or MAP_FAILED on error
+ */
+static void *
+slab_map_obj(const EdCache *cache, EdBlkno vno, EdBlkno count, bool need)
 {
-	return block->no < end && start < block->no + block->count;
+	uint8_t *p = slab_map(cache, slab_no(cache, vno), count, need);
+	return p == MAP_FAILED ? MAP_FAILED : p + ed_vno_offset(vno);
 }
 
-static int
-obj_reserve(EdCache *cache, EdTxn *txn, uint64_t flags, EdBlkno *vnop, size_t len)
+/**
+ * @brief  Unmaps a header returned from #slab_map_obj()
+ * @param  cache  Cache object
+ * @param  vno  Virtual block number of the object
+ * @param  p  Pointer to the object header
+ * @param  count  Number of blocks mapped
+ */
+static void
+slab_unmap_obj(const EdCache *cache, EdBlkno vno, void *p, EdBlkno count)
+{
+	slab_unmap(cache, (uint8_t *)p - ed_vno_offset(vno), count);
+}
+
+/**
+ * @brief  Gets the slab region to lock for reading an object
+ *
+ * A packed object only locks the start of its header. Objects appended to the
+ * block never overlap it, and reserving the block again locks all of it.
+ * Appends are only made within the pass that reserved the block, so readers
+ * also check that the block is current once locked.
+ *
+ * @param  cache  Cache object
+ * @param  vno  Virtual block number of the object
+ * @param  count  Number of blocks used by the object
+ * @param  off  Pointer to assign the byte offset of the region to
+ * @param  len  Pointer to assign the byte length of the region to
+ */
+static void
+slab_region(const EdCache *cache, EdBlkno vno, EdBlkno count, off_t *off, off_t *len)
 {
-	const int slabfd = cache->idx.slabfd;
 	const uint16_t block_size = cache->slab_block_size;
-	const EdBlkno block_count = cache->slab_block_count;
-	const EdBlkno nmin = ED_ALIGN_SIZE(sizeof(EdObjectHdr) + ED_MAX_KEY + 1, block_size);
-	EdBlkno vno = *vnop, no = vno % block_count, end;
-	size_t start = no * block_size;
-	bool searched = false;
-	bool locked = false;
-	EdEntryBlock *block = NULL;
-	int rc;
+	*off = (off_t)slab_no(cache, vno) * block_size + (off_t)ed_vno_offset(vno);
+	*len = ed_vno_ispacked(vno) ? ED_PACK_ALIGN : (off_t)count * block_size;
+}
 
-	// Find then next unlocked region >= #vno. If the current #vno cannot be used,
-	// start from the beginning of the next entry.
-	for (;;) {
-		// If the range sticks out past the end of the file, search at the beginning.
-		// I was creating a wrapped mmap here previously. For simplicity, that has
-		// been removed, but it could come back without any file format changes.
-		if (start + len > block_count*block_size) {
-			start = 0;
-			vno += block_count - no;
-			no = vno % block_count;
-			searched = false;
-		}
+/**
+ * @brief  Gets the tier slab block number for a virtual block number
+ * @param  cache  Cache object opened with #ED_FTIER
+ * @param  vno  Virtual block number with #ED_VNO_TIER set
+ * @return  Tier slab block number
+ */
+static EdBlkno
+tier_no(const EdCache *cache, EdBlkno vno)
+{
+	return (vno & ~ED_VNO_TIER) % cache->idx.tier->block_count;
+}
 
-		if (!searched) {
-			// Lookup an entry at the current slab position. Its likely nothing will be
-			// matched which will leave the block NULL. We must be sure the check this
-			// case when removing replaced entries.
-			rc = ed_bpt_find(txn, ED_DB_BLOCKS, no, (void **)&block);
-			if (rc < 0) { goto done; }
-			searched = true;
-		}
+/**
+ * @brief  Maps a range of tier slab blocks
+ *
+ * The tier slab is only mapped while holding the index write lock.
+ *
+ * @param  cache  Cache object opened with #ED_FTIER
+ * @param  no  Starting tier slab block number
+ * @param  count  Number of blocks needed
+ * @return  Pointer to the first block or MAP_FAILED on error
+ */
+static void *
+tier_map(const EdCache *cache, EdBlkno no, EdBlkno count)
+{
+	return ed_blk_map(cache->idx.tierfd, no, count, cache->slab_block_size, true);
+}
 
-		if (ed_flck(slabfd, ED_LCK_EX, start, len, flags|ED_FNOBLOCK) < 0) {
-			// The lock failed, so find the next block position and loop again
-			rc = ed_bpt_next(txn, ED_DB_BLOCKS, (void **)&block);
-			if (rc < 0) { goto done; }
-			vno += block->count;
-			no = block->no;
-			start = no * block_size;
-		}
-		else {
-			locked = true;
-			break;
-		}
+/**
+ * @brief  Unmaps blocks returned from #tier_map()
+ * @param  cache  Cache object opened with #ED_FTIER
+ * @param  p  Pointer to the first block
+ * @param  count  Number of blocks mapped
+ */
+static void
+tier_unmap(const EdCache *cache, void *p, EdBlkno count)
+{
+	ed_blk_unmap(p, count, cache->slab_block_size);
+}
+
+/**
+ * @brief  Gets the number of blocks to map to compare the key of an object
+ * @param  cache  Cache object
+ * @param  vno  Virtual block number of the key entry
+ * @param  count  Number of blocks used by the object
+ * @return  Number of blocks to pass to #key_map()
+ */
+static EdBlkno
+key_need(const EdCache *cache, EdBlkno vno, EdBlkno count)
+{
+	const EdBlkno need = ED_COUNT_SIZE(ed_vno_offset(vno) + sizeof(EdObjectHdr) + ED_MAX_KEY,
+			cache->slab_block_size);
+	return need < count ? need : count;
+}
+
+/**
+ * @brief  Maps the object header for a key entry in either slab
+ * @param  cache  Cache object
+ * @param  vno  Virtual block number of the key entry
+ * @param  count  Number of blocks needed
+ * @return  Pointer to the first block or MAP_FAILED on error
+ */
+static void *
+key_map(const EdCache *cache, EdBlkno vno, EdBlkno count)
+{
+	if (ed_vno_istier(vno)) {
+		return tier_map(cache, tier_no(cache, vno), count);
 	}
+	return slab_map_obj(cache, vno, count, true);
+}
 
-	// Determine the first page number after the write region.
-	end = no + len/block_size;
+/**
+ * @brief  Unmaps blocks returned from #key_map()
+ * @param  cache  Cache object
+ * @param  vno  Virtual block number of the key entry
+ * @param  p  Pointer to the first block
+ * @param  count  Number of blocks mapped
+ */
+static void
+key_unmap(const EdCache *cache, EdBlkno vno, void *p, EdBlkno count)
+{
+	if (ed_vno_istier(vno)) {
+		tier_unmap(cache, p, count);
+	}
+	else {
+		slab_unmap_obj(cache, vno, p, count);
+	}
+}
 
-	// If the original find didn't match and we never iterated to the next
-	// position, load the next entry.
-	if (block == NULL) {
-		rc = ed_bpt_next(txn, ED_DB_BLOCKS, (void **)&block);
-		if (rc < 0) { goto done; }
+/**
+ * @brief  Finds the entry for a slab region
+ * @param  cache  Cache object with #EdCache.lckmtx held
+ * @param  start  Byte offset of the region
+ * @param  len  Byte length of the region
+ * @param  pending  Pending state of the entry
+ * @return  Index of the entry, or #EdCache.nlcks if not found
+ */
+static unsigned
+slab_lck_find(const EdCache *cache, off_t start, off_t len, int pending)
+{
+	unsigned i = 0;
+	for (; i < cache->nlcks; i++) {
+		const EdSlabLck *l = &cache->lcks[i];
+		if (l->start == start && l->len == len && l->pending == pending) { break; }
 	}
+	return i;
+}
 
-	// Loop through objects by block position and remove the key and then block
-	// entries in the index.
-	while (block && obj_overlap(block, no, end)) {
-		// Only the first page of the object is needed.
-		EdObjectHdr *old = ed_blk_map(slabfd, block->no, nmin, block_size, true);
-		if (old == MAP_FAILED) { rc = ED_ERRNO; goto done; }
+/**
+ * @brief  Locks a slab region without blocking
+ *
+ * Regions already locked by another thread in the process conflict the same
+ * way they would across processes. A shared lock waits for any overlapping
+ * region that another thread is still locking or unlocking.
+ *
+ * @param  cache  Cache object
+ * @param  type  Lock type, #ED_LCK_SH or #ED_LCK_EX
+ * @param  start  Byte offset of the region
+ * @param  len  Byte length of the region
+ * @param  flags  Lock flags
+ * @return  0 on success, <0 if the region is unavailable or on error
+ */
+static int
+slab_lock(EdCache *cache, EdLckType type, off_t start, off_t len, uint64_t flags)
+{
+	const off_t end = start + len;
+	int rc = 0;
 
-		// Loop through each key entry to resolve collisions. Key comparison is not
-		// rquireds for this resolution. We are looking for the key that maps to
-		// current block number.
-		EdEntryKey *key;
-		for (rc = ed_bpt_find(txn, ED_DB_KEYS, old->keyhash, (void **)&key);
-				rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
-				rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
-			if ((key->vno % block_count) == block->no) {
-				rc = ed_bpt_del(txn, ED_DB_KEYS);
-				if (rc >= 0) {
-					rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key);
-				}
-				break;
+	pthread_mutex_lock(&cache->lckmtx);
+	for (;;) {
+		EdSlabLck *same = NULL;
+		bool wait = false;
+		for (unsigned i = 0; i < cache->nlcks; i++) {
+			EdSlabLck *l = &cache->lcks[i];
+			if (l->start >= end || l->start + l->len <= start) { continue; }
+			if (type == ED_LCK_EX || l->count < 0) {
+				rc = ed_esys(EAGAIN);
+				goto done;
 			}
+			if (l->pending != 0) { wait = true; }
+			else if (l->start == start && l->len == len) { same = l; }
 		}
-		ed_blk_unmap(old, nmin, block_size);
-		if (rc < 0) { goto done; }
 
-		rc = ed_bpt_del(txn, ED_DB_BLOCKS);
-		if (rc < 0) { goto done; }
+		// The process already holds a shared lock on this exact region.
+		if (same != NULL) {
+			same->count++;
+			goto done;
+		}
+		if (!wait) { break; }
+		pthread_cond_wait(&cache->lckcond, &cache->lckmtx);
+	}
 
-		rc = ed_bpt_next(txn, ED_DB_BLOCKS, (void **)&block);
-		if (rc < 0) { goto done; }
+	if (cache->nlcks == cache->nlckslot) {
+		unsigned nslot = cache->nlckslot ? cache->nlckslot * 2 : 16;
+		EdSlabLck *lcks = realloc(cache->lcks, nslot * sizeof(lcks[0]));
+		if (lcks == NULL) {
+			rc = ED_ERRNO;
+			goto done;
+		}
+		cache->lcks = lcks;
+		cache->nlckslot = nslot;
 	}
+	cache->lcks[cache->nlcks++] = (EdSlabLck){
+		start, len, type == ED_LCK_EX ? -1 : 1, 1
+	};
+	pthread_mutex_unlock(&cache->lckmtx);
 
-	*vnop = vno;
+	if (cache->idx.pins != NULL) {
+		rc = ed_idx_pin(&cache->idx, type, start, len);
+	}
+	else {
+		rc = ed_flck(cache->idx.slabfd, type, start, len, flags|ED_FNOBLOCK);
+	}
 
-done:
-	if (rc < 0 && locked) {
-		ed_flck(slabfd, ED_LCK_UN, start, len, flags);
+	pthread_mutex_lock(&cache->lckmtx);
+	unsigned i = slab_lck_find(cache, start, len, 1);
+	assert(i < cache->nlcks);
+	if (rc == 0) {
+		cache->lcks[i].pending = 0;
+	}
+	else {
+		cache->lcks[i] = cache->lcks[--cache->nlcks];
 	}
+	pthread_cond_broadcast(&cache->lckcond);
+
+done:
+	pthread_mutex_unlock(&cache->lckmtx);
 	return rc;
 }
 
-static int
-obj_upsert(EdCache *cache, const void *k, size_t klen, uint64_t h,
-		EdBlkno vno, EdBlkno nblcks, EdTime exp)
+/**
+ * @brief  Unlocks a slab region locked with #slab_lock()
+ *
+ * Regions being unlocked by other threads no longer cover any part of this
+ * one, so each uncovered range is released by at least one of them.
+ *
+ * @param  cache  Cache object
+ * @param  start  Byte offset of the region
+ * @param  len  Byte length of the region
+ * @param  flags  Lock flags
+ */
+static void
+slab_unlock(EdCache *cache, off_t start, off_t len, uint64_t flags)
 {
-	EdTxn *txn = cache->txn;
-	const uint16_t block_size = cache->slab_block_size;
-	const EdBlkno block_count = cache->slab_block_count;
-	const EdBlkno nmin = ED_ALIGN_SIZE(sizeof(EdObjectHdr) + ED_MAX_KEY + 1, block_size);
-	EdEntryBlock blocknew = ed_entry_block_make(vno, nblcks, block_count, txn->xid);
-	EdEntryKey *key, keynew = ed_entry_key_make(h, vno, nblcks, exp);
-	bool replace = false;
-	int rc;
-
-	// Insert the slab position into the db.
-	if ((rc = ed_bpt_find(txn, ED_DB_BLOCKS, blocknew.no, NULL)) < 0 || 
-		(rc = ed_bpt_set(txn, ED_DB_BLOCKS, (void *)&blocknew, true) < 0)) {
-		return rc;
+	const int fd = cache->idx.slabfd;
+	off_t pos = start, end = start + len;
+
+	pthread_mutex_lock(&cache->lckmtx);
+	unsigned i = slab_lck_find(cache, start, len, 0);
+	if (i == cache->nlcks) { goto done; }
+	if (cache->lcks[i].count > 1) {
+		cache->lcks[i].count--;
+		goto done;
+	}
+	cache->lcks[i].pending = -1;
+
+	// Pins are independent of each other, so only the exact region is released.
+	if (cache->idx.pins != NULL) {
+		pthread_mutex_unlock(&cache->lckmtx);
+		ed_idx_unpin(&cache->idx, start, len);
+		pthread_mutex_lock(&cache->lckmtx);
+		goto remove;
 	}
 
-	// Insert the key into the db.
-	for (rc = ed_bpt_find(txn, ED_DB_KEYS, h, (void **)&key);
-			rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
-			rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
-		// Map the slab object.
-		EdObjectHdr *old = ed_blk_map(cache->idx.slabfd, key->vno % block_count, nmin, block_size, true);
-		if (old == MAP_FAILED) { return ED_ERRNO; }
-
-		replace = old->keylen == klen && memcmp(obj_key(old), k, klen) == 0;
-		if (replace && !(cache->idx.flags & ED_FKEEPOLD)) {
-			old->exp = ED_TIME_DELETE;
+	// Wait for overlapping regions still being locked. New ones wait for this
+	// region, so the other holders can only decrease.
+	for (bool wait = true; wait; ) {
+		wait = false;
+		for (unsigned j = 0; j < cache->nlcks; j++) {
+			const EdSlabLck *l = &cache->lcks[j];
+			if (l->pending > 0 && l->start < end && start < l->start + l->len) {
+				wait = true;
+				pthread_cond_wait(&cache->lckcond, &cache->lckmtx);
+				break;
+			}
 		}
-		ed_blk_unmap(old, nmin, block_size);
-		if (replace) { break; }
 	}
-	if (rc >= 0) {
-		rc = ed_bpt_set(txn, ED_DB_KEYS, (void *)&keynew, replace);
+
+	// Release only the parts of the region not covered by another holder.
+	while (pos < end) {
+		off_t gap = end;
+		bool covered = false;
+		for (unsigned j = 0; j < cache->nlcks; j++) {
+			const EdSlabLck *l = &cache->lcks[j];
+			off_t lend = l->start + l->len;
+			if (l->pending != 0 || lend <= pos || l->start >= end) { continue; }
+			if (l->start <= pos) {
+				pos = lend;
+				covered = true;
+				break;
+			}
+			if (l->start < gap) { gap = l->start; }
+		}
+		if (!covered) {
+			pthread_mutex_unlock(&cache->lckmtx);
+			ed_flck(fd, ED_LCK_UN, pos, gap - pos, flags);
+			pthread_mutex_lock(&cache->lckmtx);
+			pos = gap;
+		}
 	}
-	return rc;
+
+remove:
+	i = slab_lck_find(cache, start, len, -1);
+	assert(i < cache->nlcks);
+	cache->lcks[i] = cache->lcks[--cache->nlcks];
+	pthread_cond_broadcast(&cache->lckcond);
+
+done:
+	pthread_mutex_unlock(&cache->lckmtx);
 }
 
-int
-ed_cache_open(EdCache **cachep, const EdConfig *cfg)
+/**
+ * @brief  Unlocks the slab region of an opened object
+ * @param  obj  Object to unlock
+ * @param  flags  Lock flags
+ */
+static void
+obj_unlock(EdObject *obj, uint64_t flags)
 {
-	int rc;
-	EdCache *cache = malloc(sizeof(*cache));
-	if (cache == NULL) { return ED_ERRNO; }
-
-	rc = ed_idx_open(&cache->idx, cfg);
-	if (rc < 0) { goto error_open; }
+	off_t off, len;
+	slab_region(obj->cache, obj->vno, obj->nblcks, &off, &len);
+	slab_unlock(obj->cache, off, len, flags);
+}
 
-	rc = ed_txn_new(&cache->txn, &cache->idx);
-	if (rc < 0) { goto error_txn; }
+/**
+ * @brief  Takes an idle transaction from the cache pool
+ *
+ * A new transaction is created when the pool is empty. Every operation uses
+ * its own transaction, so threads sharing the cache never share one.
+ *
+ * @param  cache  Cache object
+ * @param  txnp  Indirect pointer to assign the transaction to
+ * @return  0 on success, <0 on error
+ */
+static int
+cache_txn_get(EdCache *cache, EdTxn **txnp)
+{
+	pthread_mutex_lock(&cache->mtx);
+	EdTxn *txn = cache->txn;
+	if (txn != NULL) {
+		cache->txn = txn->next;
+		txn->next = NULL;
+	}
+	pthread_mutex_unlock(&cache->mtx);
 
-	cache->ref = 1;
-	cache->slab_block_count = cache->idx.hdr->slab_block_count;
-	cache->slab_block_size = cache->idx.hdr->slab_block_size;
-	*cachep = cache;
+	if (txn == NULL) {
+		int rc = ed_txn_new(&txn, &cache->idx);
+		if (rc < 0) { return rc; }
+	}
+	*txnp = txn;
 	return 0;
+}
 
-error_txn:
-	ed_idx_close(&cache->idx);
-error_open:
-	free(cache);
-	return rc;
+/**
+ * @brief  Returns a closed transaction to the cache pool
+ * @param  cache  Cache object
+ * @param  txn  Transaction closed with #ED_FRESET, or NULL
+ */
+static void
+cache_txn_put(EdCache *cache, EdTxn *txn)
+{
+	if (txn == NULL) { return; }
+	pthread_mutex_lock(&cache->mtx);
+	txn->next = cache->txn;
+	cache->txn = txn;
+	pthread_mutex_unlock(&cache->mtx);
 }
 
-EdCache *
-ed_cache_ref(EdCache *cache)
+/**
+ * @brief  Advises the kernel on the use of a mapped object
+ *
+ * Changing the advice on part of the whole-slab mapping would split it into
+ * multiple mappings, so the object is only prefetched when reading instead.
+ *
+ * @param  cache  Cache object
+ * @param  p  Pointer to the object
+ * @param  len  Length of the object in bytes
+ * @param  read  The object is being opened for reading
+ */
+static void
+slab_advise(const EdCache *cache, void *p, size_t len, bool read)
 {
-	if (cache != NULL) {
-		__sync_fetch_and_add(&cache->ref, 1);
+	if (cache->slab == NULL) {
+		madvise(p, len, MADV_SEQUENTIAL);
+	}
+	else if (read) {
+		uint8_t *m = (uint8_t *)p - ((uintptr_t)p % PAGESIZE);
+		madvise(m, len + ((uint8_t *)p - m), MADV_WILLNEED);
 	}
-	return cache;
 }
 
-void
-ed_cache_close(EdCache **cachep)
+static int64_t
+obj_write(void *dst, const void *src, size_t len, uint32_t *crc, uint64_t flags)
 {
-	EdCache *cache = *cachep;
-	if (cache != NULL) {
-		*cachep = NULL;
-		if (__sync_fetch_and_sub(&cache->ref, 1) == 1) {
-			ed_txn_close(&cache->txn, cache->idx.flags);
-			ed_idx_close(&cache->idx);
-			free(cache);
+	if (flags & ED_FCHECKSUM) {
+		*crc = ed_crc32c(*crc, src, len);
+	}
+	memcpy(dst, src, len);
+	return len;
+}
+
+static void
+obj_hdr_init(EdObjectHdr *hdr, const EdObjectAttr *attr, uint64_t h, EdTime now, uint64_t flags)
+{
+	hdr->xid = 0;
+	hdr->created = now;
+	hdr->exp = 0;
+	hdr->flags = 0;
+	hdr->keylen = attr->keylen;
+	hdr->metalen = attr->metalen;
+	hdr->datalen = attr->datalen;
+	hdr->keyhash = h;
+	hdr->metacrc = 0;
+	hdr->datacrc = 0;
+
+	// Copy the key into the tail of the header segment.
+	uint8_t *key = obj_key(hdr), *meta = obj_meta(hdr);
+	memcpy(key, attr->key, attr->keylen);
+	key += attr->keylen;
+
+	// Zero out the end of the key segment.
+	memset(key, 0, obj_meta(hdr) - key);
+
+	// Write the meta data segment if provided.
+	if (attr->meta != NULL && attr->metalen > 0) {
+		obj_write(meta, attr->meta, attr->metalen, &hdr->metacrc, flags);
+	}
+	meta += attr->metalen;
+
+	// Zero out the end of the meta segment.
+	memset(meta, 0, obj_data(hdr, flags) - meta);
+}
+
+static off_t
+obj_data_byte(const EdObject *obj)
+{
+	return (off_t)obj->byte + (off_t)(obj->data - (uint8_t *)obj->hdr) + obj->dataread;
+}
+
+static size_t
+obj_data_remain(const EdObject *obj, size_t len)
+{
+	size_t rem = obj->datalen - obj->dataread;
+	return len < rem ? len : rem;
+}
+
+static void
+obj_pipe_close(EdObject *obj)
+{
+	if (obj->pipe[0] >= 0) {
+		close(obj->pipe[0]);
+		close(obj->pipe[1]);
+		obj->pipe[0] = obj->pipe[1] = -1;
+		obj->pipelen = 0;
+	}
+}
+
+static void
+obj_hdr_final(EdObjectHdr *hdr, size_t nbytes, uint64_t flags)
+{
+	uint8_t *data = obj_data(hdr, flags) + hdr->datalen;
+	memset(data, 0, nbytes - (data - (uint8_t *)hdr));
+}
+
+static bool
+obj_overlap(const EdEntryBlock *block, EdBlkno start, EdBlkno end)
+{
+	return block->no < end && start < block->no + block->count;
+}
+
+/**
+ * @brief  Tests if a key entry refers to the object of a block entry
+ * @param  cache  Cache object
+ * @param  block  Block entry
+ * @param  vno  Virtual block number of the key entry
+ * @return  true if the key entry is for the same slab position
+ */
+static bool
+obj_match(const EdCache *cache, const EdEntryBlock *block, EdBlkno vno)
+{
+	return !ed_vno_istier(vno) && slab_no(cache, vno) == block->no &&
+		ed_vno_slot(vno) == block->slot;
+}
+
+/**
+ * @brief  Appends a key hash to a growable array
+ * @param  arr  Indirect pointer to the array
+ * @param  n  Number of hashes in the array
+ * @param  nslot  Number of slots in the array
+ * @param  h  Key hash to append
+ * @return  0 on success, <0 on error
+ */
+static int
+hash_push(uint64_t **arr, unsigned *n, unsigned *nslot, uint64_t h)
+{
+	if (*n == *nslot) {
+		unsigned next = *nslot ? *nslot * 2 : 16;
+		uint64_t *a = realloc(*arr, next * sizeof(*a));
+		if (a == NULL) { return ED_ERRNO; }
+		*arr = a;
+		*nslot = next;
+	}
+	(*arr)[(*n)++] = h;
+	return 0;
+}
+
+/**
+ * @brief  Records a key entry removed by the batch
+ *
+ * The key filter is only updated once the batch transaction commits.
+ *
+ * @param  batch  Batch object
+ * @param  h  Hash of the removed key
+ * @return  0 on success, <0 on error
+ */
+static int
+batch_remove(EdBatch *batch, uint64_t h)
+{
+	if (batch->cache->idx.filter == NULL) { return 0; }
+	return hash_push(&batch->removed, &batch->nremoved, &batch->nremovedslot, h);
+}
+
+/**
+ * @brief  Records a key entry added by the batch
+ *
+ * The key filter is only updated when the batch transaction commits, so an
+ * aborted batch leaves the filter counts unchanged.
+ *
+ * @param  batch  Batch object
+ * @param  h  Hash of the added key
+ * @return  0 on success, <0 on error
+ */
+static int
+batch_add(EdBatch *batch, uint64_t h)
+{
+	if (batch->cache->idx.filter == NULL) { return 0; }
+	return hash_push(&batch->added, &batch->nadded, &batch->naddedslot, h);
+}
+
+/**
+ * @brief  Frees the key hashes recorded by the batch
+ * @param  batch  Batch object
+ */
+static void
+batch_free_keys(EdBatch *batch)
+{
+	free(batch->removed);
+	batch->removed = NULL;
+	batch->nremoved = batch->nremovedslot = 0;
+	free(batch->added);
+	batch->added = NULL;
+	batch->nadded = batch->naddedslot = 0;
+}
+
+/**
+ * @brief  Adds the expiry entry for a key entry
+ *
+ * Keys that never expire are not added to the expiry b+tree.
+ *
+ * @param  txn  Write transaction
+ * @param  key  Key entry
+ * @return  0 on success, <0 on error
+ */
+static int
+expiry_add(EdTxn *txn, const EdEntryKey *key)
+{
+	if (key->exp == ED_TIME_INF) { return 0; }
+	EdEntryExp ent = ed_entry_exp_make(key->hash, key->vno, key->exp);
+	int rc = ed_bpt_find(txn, ED_DB_EXPIRY, ent.key, NULL);
+	if (rc >= 0) {
+		rc = ed_bpt_set(txn, ED_DB_EXPIRY, (void *)&ent, false);
+	}
+	return rc < 0 ? rc : 0;
+}
+
+/**
+ * @brief  Removes the expiry entry for a key entry
+ * @param  txn  Write transaction
+ * @param  key  Key entry
+ * @return  0 on success, <0 on error
+ */
+static int
+expiry_remove(EdTxn *txn, const EdEntryKey *key)
+{
+	if (key->exp == ED_TIME_INF) { return 0; }
+	const EdEntryExp find = ed_entry_exp_make(key->hash, key->vno, key->exp);
+	EdEntryExp *ent;
+	int rc;
+	for (rc = ed_bpt_find(txn, ED_DB_EXPIRY, find.key, (void **)&ent);
+			rc == 1 && ed_bpt_loop(txn, ED_DB_EXPIRY) == 0;
+			rc = ed_bpt_next(txn, ED_DB_EXPIRY, (void **)&ent)) {
+		if (ent->hash == find.hash && ent->vno == find.vno) {
+			rc = ed_bpt_del(txn, ED_DB_EXPIRY);
+			break;
+		}
+	}
+	return rc < 0 ? rc : 0;
+}
+
+/**
+ * @brief  Moves a recently read object to the current pass through the slab
+ *
+ * The object is left in place and the write position moves past it. Its key
+ * entry is given the virtual block number of the current pass, so it is next
+ * evicted a full pass later.
+ *
+ * @param  batch  Batch object
+ * @param  block  Block entry of the object at the write position
+ * @param  vno  Virtual block number for the object in the current pass
+ * @return  1 if reinserted, 0 if the object should be evicted, <0 on error
+ */
+static int
+obj_reinsert(EdBatch *batch, const EdEntryBlock *block, EdBlkno vno)
+{
+	EdCache *cache = batch->cache;
+	EdTxn *txn = batch->txn;
+	EdPgIdx *hdr = cache->idx.hdr;
+	const unsigned ring = ed_vno_ring(vno);
+	const EdBlkno lap = ed_vno_pos(vno) / ring_count(cache, ring);
+	EdBlkno *clock_lap = &hdr->clock_lap, *clock_used = &hdr->clock_used;
+	EdBlkno budget = hdr->clock_budget;
+
+	// A packed block holds unrelated objects, so it is never kept as a whole.
+	if (block->slot != 0) { return 0; }
+
+	// Each ring is given a share of the budget by its size.
+	if (cache->idx.ring != NULL) {
+		budget = (EdBlkno)((uint64_t)budget * ring_count(cache, ring) / cache->slab_block_count);
+		if (ring > 0) {
+			clock_lap = &cache->idx.ring->rings[ring].clock_lap;
+			clock_used = &cache->idx.ring->rings[ring].clock_used;
+		}
+	}
+
+	if (*clock_lap != lap) {
+		*clock_lap = lap;
+		*clock_used = 0;
+	}
+	if (*clock_used + block->count > budget ||
+			!ed_idx_clock_take(&cache->idx, block->no)) {
+		return 0;
+	}
+
+	EdEntryKey *key;
+	int rc;
+	for (rc = ed_bpt_find(txn, ED_DB_KEYS, block->keyhash, (void **)&key);
+			rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
+			rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
+		if (!obj_match(cache, block, key->vno)) { continue; }
+		if (ed_expired_at(cache->idx.epoch, key->exp, ed_now_unix())) { return 0; }
+
+		EdEntryKey keyold = *key, keynew = *key;
+		keynew.vno = vno;
+		if ((rc = expiry_remove(txn, &keyold)) < 0 ||
+			(rc = ed_bpt_set(txn, ED_DB_KEYS, (void *)&keynew, true)) < 0 ||
+			(rc = expiry_add(txn, &keynew)) < 0) {
+			return rc;
+		}
+		*clock_used += block->count;
+		return 1;
+	}
+	return rc < 0 ? rc : 0;
+}
+
+/**
+ * @brief  Decides if a new object may evict the live objects in a region
+ *
+ * Objects replacing an existing key are always admitted. Otherwise, the key
+ * must be looked up at least as often as every live object it would evict.
+ *
+ * @param  batch  Batch object
+ * @param  h  Hash of the new key
+ * @param  tag  Tag of the new key
+ * @param  no  First block of the region
+ * @param  end  First block after the region
+ * @return  0 if admitted, #ED_EOBJECT_REJECTED if not, <0 on error
+ */
+static int
+obj_admit(EdBatch *batch, uint64_t h, uint64_t tag, EdBlkno no, EdBlkno end)
+{
+	EdCache *cache = batch->cache;
+	EdTxn *txn = batch->txn;
+	const EdTimeUnix now = ed_now_unix();
+	EdEntryKey *key;
+	EdEntryBlock *block = NULL;
+	int rc;
+
+	for (rc = ed_bpt_find(txn, ED_DB_KEYS, h, (void **)&key);
+			rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
+			rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
+		if (key->tag == tag) { return 0; }
+	}
+	if (rc < 0) { return rc; }
+
+	const unsigned freq = ed_idx_sketch_get(&cache->idx, h);
+
+	rc = ed_bpt_find(txn, ED_DB_BLOCKS, no, (void **)&block);
+	if (rc == 0) {
+		rc = ed_bpt_next(txn, ED_DB_BLOCKS, (void **)&block);
+	}
+	for (; rc >= 0 && block && obj_overlap(block, no, end) &&
+			ed_bpt_loop(txn, ED_DB_BLOCKS) == 0;
+			rc = ed_bpt_next(txn, ED_DB_BLOCKS, (void **)&block)) {
+		// Only compare against objects that are still reachable by key.
+		for (rc = ed_bpt_find(txn, ED_DB_KEYS, block->keyhash, (void **)&key);
+				rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
+				rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
+			if (!obj_match(cache, block, key->vno)) { continue; }
+			if (!ed_expired_at(cache->idx.epoch, key->exp, now) &&
+					ed_idx_sketch_get(&cache->idx, block->keyhash) > freq) {
+				return ED_EOBJECT_REJECTED;
+			}
+			break;
+		}
+		if (rc < 0) { return rc; }
+	}
+	return rc < 0 ? rc : 0;
+}
+
+/**
+ * @brief  Removes the block entry for a key entry in the slab
+ * @param  batch  Batch object
+ * @param  vno  Virtual block number of the key entry
+ * @param  h  Hash of the key
+ * @return  0 on success, <0 on error
+ */
+static int
+block_remove(EdBatch *batch, EdBlkno vno, uint64_t h)
+{
+	EdTxn *txn = batch->txn;
+	EdEntryBlock *block;
+	int rc;
+	for (rc = ed_bpt_find(txn, ED_DB_BLOCKS, slab_no(batch->cache, vno), (void **)&block);
+			rc == 1 && ed_bpt_loop(txn, ED_DB_BLOCKS) == 0;
+			rc = ed_bpt_next(txn, ED_DB_BLOCKS, (void **)&block)) {
+		if (block->keyhash == h && block->slot == ed_vno_slot(vno)) {
+			rc = ed_bpt_del(txn, ED_DB_BLOCKS);
+			break;
+		}
+	}
+	return rc < 0 ? rc : 0;
+}
+
+/**
+ * @brief  Removes the tier block entry for a key entry
+ * @param  batch  Batch object
+ * @param  key  Key entry with #ED_VNO_TIER set
+ * @return  0 on success, <0 on error
+ */
+static int
+tier_remove(EdBatch *batch, const EdEntryKey *key)
+{
+	EdTxn *txn = batch->txn;
+	EdEntryBlock *block;
+	int rc = ed_bpt_find(txn, ED_DB_TIER, tier_no(batch->cache, key->vno), (void **)&block);
+	if (rc == 1 && block->keyhash == key->hash) {
+		rc = ed_bpt_del(txn, ED_DB_TIER);
+	}
+	return rc < 0 ? rc : 0;
+}
+
+/**
+ * @brief  Copies an object being evicted from the slab into the tier slab
+ *
+ * Objects at the tier slab write position are evicted first. The key entry
+ * is then moved to the tier slab, so the object remains reachable by key.
+ *
+ * @param  batch  Batch object
+ * @param  keyold  Copy of the key entry of the object being evicted
+ * @return  1 if moved, 0 if the object does not fit, <0 on error
+ */
+static int
+obj_demote(EdBatch *batch, const EdEntryKey *keyold)
+{
+	EdCache *cache = batch->cache;
+	EdTxn *txn = batch->txn;
+	const uint64_t flags = cache->idx.flags;
+	const uint16_t block_size = cache->slab_block_size;
+	const EdBlkno block_count = cache->idx.tier->block_count;
+	const EdBlkno count = keyold->count;
+	EdBlkno vno = ed_txn_tvno(txn), no = vno % block_count;
+	EdEntryBlock *block = NULL;
+	EdEntryKey *key;
+	int rc;
+
+	if (count > block_count) { return 0; }
+	if (no + count > block_count) {
+		vno += block_count - no;
+		no = 0;
+	}
+
+	// Remove the key and block entries of the overlapped tier objects.
+	rc = ed_bpt_find(txn, ED_DB_TIER, no, (void **)&block);
+	if (rc == 0) {
+		rc = ed_bpt_next(txn, ED_DB_TIER, (void **)&block);
+	}
+	while (rc >= 0 && block && obj_overlap(block, no, no + count)) {
+		for (rc = ed_bpt_find(txn, ED_DB_KEYS, block->keyhash, (void **)&key);
+				rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
+				rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
+			if (ed_vno_istier(key->vno) && tier_no(cache, key->vno) == block->no) {
+				rc = expiry_remove(txn, key);
+				if (rc >= 0) {
+					rc = ed_bpt_del(txn, ED_DB_KEYS);
+				}
+				if (rc >= 0) {
+					rc = batch_remove(batch, block->keyhash);
+				}
+				break;
+			}
+		}
+		if (rc >= 0) {
+			rc = ed_bpt_del(txn, ED_DB_TIER);
+		}
+		if (rc >= 0) {
+			rc = ed_bpt_next(txn, ED_DB_TIER, (void **)&block);
+		}
+	}
+	if (rc < 0) { return rc; }
+
+	// Copy the object as-is. The tier slab is synced now because the slab
+	// region is overwritten within the same transaction.
+	void *src = slab_map(cache, slab_no(cache, keyold->vno), count, false);
+	if (src == MAP_FAILED) { return ED_ERRNO; }
+	void *dst = tier_map(cache, no, count);
+	if (dst == MAP_FAILED) {
+		rc = ED_ERRNO;
+		slab_unmap(cache, src, count);
+		return rc;
+	}
+	memcpy(dst, src, (size_t)count * block_size);
+	if (!(flags & ED_FNOSYNC)) {
+		rc = ed_blk_sync(dst, count, block_size, flags);
+	}
+	tier_unmap(cache, dst, count);
+	slab_unmap(cache, src, count);
+	if (rc < 0) { return rc; }
+
+	EdEntryKey keynew = *keyold;
+	keynew.vno = ED_VNO_TIER | vno;
+	EdEntryBlock blocknew = ed_entry_block_make(vno, count, block_count, txn->xid, keyold->hash);
+
+	for (rc = ed_bpt_find(txn, ED_DB_KEYS, keyold->hash, (void **)&key);
+			rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
+			rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
+		if (key->vno == keyold->vno) {
+			if ((rc = expiry_remove(txn, keyold)) < 0 ||
+				(rc = ed_bpt_set(txn, ED_DB_KEYS, (void *)&keynew, true)) < 0 ||
+				(rc = expiry_add(txn, &keynew)) < 0 ||
+				(rc = ed_bpt_find(txn, ED_DB_TIER, blocknew.no, NULL)) < 0 ||
+				(rc = ed_bpt_set(txn, ED_DB_TIER, (void *)&blocknew, true)) < 0 ||
+				(rc = ed_txn_set_tvno(txn, vno + count)) < 0) {
+				return rc;
+			}
+			return 1;
+		}
+	}
+	return rc < 0 ? rc : 0;
+}
+
+static int
+obj_reserve(EdBatch *batch, uint64_t flags, EdBlkno *vnop, size_t len,
+		uint64_t h, uint64_t tag)
+{
+	EdCache *cache = batch->cache;
+	EdTxn *txn = batch->txn;
+	const uint16_t block_size = cache->slab_block_size;
+	const unsigned ring = ed_vno_ring(*vnop);
+	const EdBlkno ring_first = ring_start(cache, ring);
+	const EdBlkno ring_end = ring_first + ring_count(cache, ring);
+	EdBlkno vno = *vnop, no = slab_no(cache, vno), end;
+	size_t start = no * block_size;
+	bool searched = false;
+	bool locked = false;
+	EdEntryBlock *block = NULL;
+	int rc;
+
+	// The region could never fit within the ring.
+	if (len/block_size > ring_end - ring_first) { return ED_EOBJECT_TOOBIG; }
+
+again:
+	// Find then next unlocked region >= #vno. If the current #vno cannot be used,
+	// start from the beginning of the next entry.
+	for (;;) {
+		// If the range sticks out past the end of the file, search at the beginning.
+		// I was creating a wrapped mmap here previously. For simplicity, that has
+		// been removed, but it could come back without any file format changes.
+		if (start + len > ring_end*block_size) {
+			vno += ring_end - no;
+			no = ring_first;
+			start = no * block_size;
+			searched = false;
+		}
+
+		if (!searched) {
+			// Lookup an entry at the current slab position. Its likely nothing will be
+			// matched which will leave the block NULL. We must be sure the check this
+			// case when removing replaced entries.
+			rc = ed_bpt_find(txn, ED_DB_BLOCKS, no, (void **)&block);
+			if (rc < 0) { goto done; }
+			searched = true;
+		}
+
+		if (slab_lock(cache, ED_LCK_EX, start, len, flags) < 0) {
+			// The lock failed, so find the next block position and loop again
+			rc = ed_bpt_next(txn, ED_DB_BLOCKS, (void **)&block);
+			if (rc < 0) { goto done; }
+			// Objects of other rings are passed by starting from the beginning
+			// of the ring again.
+			if (cache->idx.ring != NULL && (block->no < ring_first || block->no >= ring_end)) {
+				vno += ring_end - no;
+				no = ring_first;
+				start = no * block_size;
+				searched = false;
+				continue;
+			}
+			vno += block->count;
+			no = block->no;
+			start = no * block_size;
+		}
+		else {
+			locked = true;
+			break;
+		}
+	}
+
+	// Determine the first page number after the write region.
+	end = no + len/block_size;
+
+	// Check the admission before any objects are evicted, and then search for
+	// the first block entry again.
+	if (cache->idx.sketch != NULL) {
+		rc = obj_admit(batch, h, tag, no, end);
+		if (rc < 0) { goto done; }
+		block = NULL;
+		rc = ed_bpt_find(txn, ED_DB_BLOCKS, no, (void **)&block);
+		if (rc < 0) { goto done; }
+	}
+
+	// If the original find didn't match and we never iterated to the next
+	// position, load the next entry.
+	if (block == NULL) {
+		rc = ed_bpt_next(txn, ED_DB_BLOCKS, (void **)&block);
+		if (rc < 0) { goto done; }
+	}
+
+	// Loop through objects by block position and remove the key and then block
+	// entries in the index.
+	// The block entries carry the key hash, so removing the overlapped objects
+	// does not need to read the slab while holding the write lock.
+	while (block && obj_overlap(block, no, end)) {
+		// An object read since the last pass is skipped over rather than evicted,
+		// and the region is searched for again after it.
+		if (cache->idx.clock != NULL && block->no >= no) {
+			EdBlkno vblk = vno + (block->no - no);
+			rc = obj_reinsert(batch, block, vblk);
+			if (rc < 0) { goto done; }
+			if (rc > 0) {
+				slab_unlock(cache, start, len, flags);
+				locked = false;
+				vno = vblk + block->count;
+				no = slab_no(cache, vno);
+				start = no * block_size;
+				searched = false;
+				block = NULL;
+				goto again;
+			}
+		}
+
+		// Loop through each key entry to resolve collisions. Key comparison is not
+		// rquireds for this resolution. We are looking for the key that maps to
+		// current block number.
+		EdEntryKey *key;
+		for (rc = ed_bpt_find(txn, ED_DB_KEYS, block->keyhash, (void **)&key);
+				rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
+				rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
+			if (obj_match(cache, block, key->vno)) {
+				// A live object is moved to the tier slab rather than discarded.
+				// Packed objects are always discarded with their block.
+				if (cache->idx.tier != NULL && !ed_vno_ispacked(key->vno) &&
+						!ed_expired_at(cache->idx.epoch, key->exp, ed_now_unix())) {
+					const EdEntryKey keyold = *key;
+					rc = obj_demote(batch, &keyold);
+					if (rc != 0) { break; }
+					// The key b+tree may have changed, so find the entry again.
+					for (rc = ed_bpt_find(txn, ED_DB_KEYS, keyold.hash, (void **)&key);
+							rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
+							rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
+						if (key->vno == keyold.vno) { break; }
+					}
+					if (rc != 1) { break; }
+				}
+				rc = expiry_remove(txn, key);
+				if (rc >= 0) {
+					rc = ed_bpt_del(txn, ED_DB_KEYS);
+				}
+				if (rc >= 0) {
+					rc = batch_remove(batch, block->keyhash);
+				}
+				if (rc >= 0) {
+					rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key);
+				}
+				break;
+			}
+		}
+		if (rc < 0) { goto done; }
+
+		rc = ed_bpt_del(txn, ED_DB_BLOCKS);
+		if (rc < 0) { goto done; }
+
+		rc = ed_bpt_next(txn, ED_DB_BLOCKS, (void **)&block);
+		if (rc < 0) { goto done; }
+	}
+
+	// The new object must earn its own access bit.
+	if (cache->idx.clock != NULL) {
+		ed_idx_clock_take(&cache->idx, no);
+	}
+
+	// Publish the reserved region before any of it is written. Writes only move
+	// forward through the virtual block numbers, so this invalidates every
+	// object an unlocked reader could have opened within the region.
+	EdBlknoV *vres = ring_vres(cache, ring);
+	if (vno + len/block_size > *vres) {
+		*vres = vno + len/block_size;
+	}
+	__sync_synchronize();
+	*vnop = vno;
+
+done:
+	if (rc < 0 && locked) {
+		slab_unlock(cache, start, len, flags);
+	}
+	return rc;
+}
+
+/**
+ * @brief  Reserves a slot for a packed object
+ *
+ * The object is appended to the open pack block when it fits and the block
+ * has not been reserved again since. Appending evicts nothing, so only a new
+ * block is checked for admission. An appended slot is locked on its own
+ * unless the batch already holds the lock for the whole block.
+ *
+ * @param  batch  Batch object
+ * @param  flags  Lock flags
+ * @param  vnop  Pointer to assign the packed virtual block number to
+ * @param  len  Packed size of the object in bytes
+ * @param  h  Hash of the key
+ * @param  tag  Tag of the key
+ * @return  0 if a new block was locked, 1 if the slot was locked, 2 if the
+ *   block was already locked by the batch, <0 on error
+ */
+static int
+obj_reserve_pack(EdBatch *batch, uint64_t flags, EdBlkno *vnop, size_t len,
+		uint64_t h, uint64_t tag)
+{
+	EdCache *cache = batch->cache;
+	EdTxn *txn = batch->txn;
+	const uint16_t block_size = cache->slab_block_size;
+	unsigned count;
+	EdBlkno vno = ed_txn_pvno(txn, &count);
+	int rc;
+
+	if (vno != ED_BLK_NONE && count < ED_PACK_MAX &&
+			ed_vno_offset(vno) + len <= block_size && vno_current(cache, vno)) {
+		const EdBlkno no = slab_no(cache, vno);
+		rc = 1;
+		for (unsigned i = 0; i < batch->nslab; i++) {
+			const EdBatchSlab *s = &batch->slab[i];
+			if (s->no == no && s->count > 0 && s->len == 0) {
+				rc = 2;
+				break;
+			}
+		}
+		if (rc == 2 || slab_lock(cache, ED_LCK_EX,
+					(off_t)(no * block_size + ed_vno_offset(vno)), (off_t)len, flags) == 0) {
+			goto done;
+		}
+	}
+
+	vno = ed_txn_vno(txn, 0);
+	rc = obj_reserve(batch, flags, &vno, block_size, h, tag);
+	if (rc < 0) { return rc; }
+	ed_txn_set_vno(txn, vno + 1);
+	vno = ed_vno_pack(vno, 0);
+	count = 0;
+
+done:
+	ed_txn_set_pvno(txn, ed_vno_pack(vno, ed_vno_offset(vno) + len), count + 1);
+	*vnop = vno;
+	return rc;
+}
+
+/**
+ * @brief  Commits the batch transaction and updates the filter for its keys
+ *
+ * The filter is updated just before the commit so that no reader can use a
+ * snapshot holding an added key while the filter lacks it, or lacking a
+ * removed key while the filter still counts it. Additions go first so a key
+ * that is both removed and added never drops out of the filter. If the commit
+ * fails, both changes are undone.
+ *
+ * @param  batch  Batch object
+ * @param  txnp  Indirect pointer to the batch transaction
+ * @param  flags  Transaction commit flags
+ * @return  0 on success, <0 on error
+ */
+static int
+batch_commit(EdBatch *batch, EdTxn **txnp, uint64_t flags)
+{
+	EdIdx *idx = &batch->cache->idx;
+	const EdTxnId xid = (*txnp)->xid;
+	for (unsigned i = 0; i < batch->nadded; i++) {
+		ed_idx_filter_add(idx, batch->added[i]);
+	}
+	if (batch->nremoved > 0) {
+		ed_idx_filter_remove(idx, xid, batch->removed, batch->nremoved);
+	}
+	int rc = ed_txn_commit(txnp, flags);
+	if (rc < 0) {
+		for (unsigned i = 0; i < batch->nremoved; i++) {
+			ed_idx_filter_add(idx, batch->removed[i]);
+		}
+		if (batch->nadded > 0) {
+			ed_idx_filter_remove(idx, xid, batch->added, batch->nadded);
+		}
+	}
+	batch->nremoved = 0;
+	batch->nadded = 0;
+	return rc;
+}
+
+/**
+ * @brief  Ensures space is available for additional slab changes
+ * @param  batch  Batch object
+ * @param  n  Number of changes that will be added
+ * @return  0 on success, <0 on error
+ */
+static int
+batch_reserve(EdBatch *batch, unsigned n)
+{
+	unsigned nslabslot = batch->nslabslot;
+	if (batch->nslab + n <= nslabslot) { return 0; }
+	do {
+		nslabslot = nslabslot ? nslabslot * 2 : 16;
+	} while (batch->nslab + n > nslabslot);
+	EdBatchSlab *slab = realloc(batch->slab, nslabslot * sizeof(*slab));
+	if (slab == NULL) { return ED_ERRNO; }
+	batch->slab = slab;
+	batch->nslabslot = nslabslot;
+	return 0;
+}
+
+/**
+ * @brief  Changes the expiry of an object header
+ *
+ * Objects written by the batch transaction are not yet visible, so these are
+ * changed immediately. All other changes are deferred until the commit.
+ *
+ * @param  batch  Batch object
+ * @param  hdr  Mapped object header
+ * @param  vno  Virtual block number of the object
+ * @param  exp  New expiry for the object
+ */
+static void
+batch_hdr(EdBatch *batch, EdObjectHdr *hdr, EdBlkno vno, EdTime exp)
+{
+	if (hdr->xid == batch->txn->xid) {
+		hdr->exp = exp;
+	}
+	else {
+		assert(batch->nslab < batch->nslabslot);
+		batch->slab[batch->nslab++] = (EdBatchSlab){
+			slab_no(batch->cache, vno), 0, exp, (uint16_t)ed_vno_offset(vno), 0
+		};
+	}
+}
+
+/**
+ * @brief  Exchanges the expiry of a deferred header change with the header
+ *
+ * The change is left holding the expiry it replaced, so exchanging it again
+ * restores the header.
+ *
+ * @param  cache  Cache object
+ * @param  s  Deferred header change
+ * @param  xid  Transaction ID of the batch
+ * @return  0 on success, <0 on error
+ */
+static int
+batch_swap(EdCache *cache, EdBatchSlab *s, EdTxnId xid)
+{
+	const EdBlkno nmin = ED_COUNT_SIZE(s->off + sizeof(EdObjectHdr), cache->slab_block_size);
+	uint8_t *p = slab_map(cache, s->no, nmin, true);
+	if (p == MAP_FAILED) { return ED_ERRNO; }
+	// The object may have been replaced by a later write in the batch.
+	EdObjectHdr *hdr = (EdObjectHdr *)(p + s->off);
+	if (hdr->xid != xid) {
+		const EdTime exp = hdr->exp;
+		hdr->exp = s->exp;
+		s->exp = exp;
+	}
+	slab_unmap(cache, p, nmin);
+	return 0;
+}
+
+/**
+ * @brief  Restores the headers changed by #batch_apply()
+ *
+ * The changes are undone in reverse, so an object changed more than once in
+ * the batch gets back the expiry it had before the first change. The blocks
+ * cannot be reused by another writer until the write lock is released, so this
+ * must be called before closing the transaction.
+ *
+ * @param  batch  Batch object
+ * @param  n  Number of slab changes that were applied
+ * @param  xid  Transaction ID of the batch
+ */
+static void
+batch_revert(EdBatch *batch, unsigned n, EdTxnId xid)
+{
+	while (n > 0) {
+		EdBatchSlab *s = &batch->slab[--n];
+		if (s->count == 0) {
+			batch_swap(batch->cache, s, xid);
+		}
+	}
+}
+
+/**
+ * @brief  Writes all deferred object header changes
+ *
+ * If a header cannot be written, the changes before it are reverted.
+ *
+ * @param  batch  Batch object
+ * @return  Number of objects written by the batch, <0 on error
+ */
+static int
+batch_apply(EdBatch *batch)
+{
+	const EdTxnId xid = batch->txn->xid;
+	int nwritten = 0;
+
+	for (unsigned i = 0; i < batch->nslab; i++) {
+		EdBatchSlab *s = &batch->slab[i];
+		if (s->count > 0) {
+			nwritten++;
+			continue;
+		}
+		int rc = batch_swap(batch->cache, s, xid);
+		if (rc < 0) {
+			batch_revert(batch, i, xid);
+			return rc;
+		}
+	}
+	return nwritten;
+}
+
+/**
+ * @brief  Unlocks a slab region written by the batch
+ * @param  cache  Cache object
+ * @param  s  Slab change with a non-zero #EdBatchSlab.count
+ */
+static void
+batch_slab_unlock(EdCache *cache, const EdBatchSlab *s)
+{
+	const uint16_t block_size = cache->slab_block_size;
+	slab_unlock(cache, s->no * block_size + s->off,
+			s->len ? s->len : s->count * block_size, cache->idx.flags);
+}
+
+/**
+ * @brief  Unlocks all slab regions written by the batch
+ * @param  batch  Batch object
+ */
+static void
+batch_unlock(EdBatch *batch)
+{
+	for (unsigned i = 0; i < batch->nslab; i++) {
+		const EdBatchSlab *s = &batch->slab[i];
+		if (s->count > 0) {
+			batch_slab_unlock(batch->cache, s);
+		}
+	}
+	batch->nslab = 0;
+}
+
+/**
+ * @brief  Syncs the slab regions written by the batch
+ *
+ * Adjacent regions are merged so that objects written sequentially are
+ * synced with a single call.
+ *
+ * @param  batch  Batch object
+ * @param  flags  Transaction commit flags
+ * @return  0 on success, <0 on error
+ */
+static int
+batch_sync(EdBatch *batch, uint64_t flags)
+{
+	EdCache *cache = batch->cache;
+	const uint16_t block_size = cache->slab_block_size;
+	EdBlkno no = ED_BLK_NONE, count = 0;
+
+	for (unsigned i = 0; i <= batch->nslab; i++) {
+		const EdBatchSlab *s = i < batch->nslab ? &batch->slab[i] : NULL;
+		if (s != NULL) {
+			if (s->count == 0) { continue; }
+			// Objects packed into a block being synced are covered by it.
+			if (count > 0 && s->no >= no && s->no + s->count <= no + count) { continue; }
+			if (count > 0 && s->no == no + count) {
+				count += s->count;
+				continue;
+			}
+		}
+		if (count > 0) {
+			void *p = slab_map(cache, no, count, false);
+			if (p == MAP_FAILED) { return ED_ERRNO; }
+			int rc = ed_blk_sync(p, count, block_size, flags);
+			slab_unmap(cache, p, count);
+			if (rc < 0) { return rc; }
+		}
+		if (s != NULL) {
+			no = s->no;
+			count = s->count;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief  Commits or abandons the batch transaction
+ * @param  batch  Batch object
+ * @param  txnp  Indirect pointer to the batch transaction
+ * @param  commit  Commit the changes rather than abandoning them
+ * @param  flags  Transaction commit or close flags
+ * @return  0 on success, <0 on error
+ */
+static int
+batch_end(EdBatch *batch, EdTxn **txnp, bool commit, uint64_t flags)
+{
+	int rc = 0;
+	if (commit) {
+		const EdTxnId xid = (*txnp)->xid;
+		rc = batch_apply(batch);
+		// Sync the objects before the index is able to reference them.
+		if (rc > 0 && !(flags & ED_FNOSYNC)) {
+			rc = batch_sync(batch, flags);
+			if (rc < 0) { batch_revert(batch, batch->nslab, xid); }
+		}
+		if (rc < 0) {
+			ed_txn_close(txnp, flags);
+		}
+		else if ((rc = batch_commit(batch, txnp, flags)) < 0) {
+			// A commit fails before changing the index, either because the
+			// transaction is not open for writing or because an earlier change
+			// failed, so the old headers are still referenced.
+			batch_revert(batch, batch->nslab, xid);
+		}
+	}
+	else {
+		ed_txn_close(txnp, flags);
+	}
+	batch_unlock(batch);
+	batch_free_keys(batch);
+	return rc;
+}
+
+static int
+obj_upsert(EdBatch *batch, const void *k, size_t klen, uint64_t h,
+		EdBlkno vno, EdBlkno nblcks, EdTime exp)
+{
+	EdCache *cache = batch->cache;
+	EdTxn *txn = batch->txn;
+	const EdBlkno block_count = cache->slab_block_count;
+	EdEntryBlock blocknew = ed_entry_block_make(slab_no(cache, vno), nblcks, block_count, txn->xid, h);
+	const uint64_t tag = ed_entry_key_tag(k, klen, cache->idx.seed);
+	EdEntryKey *key, keynew = ed_entry_key_make(h, vno, nblcks, exp, tag);
+	EdEntryKey keyold;
+	bool replace = false;
+	int rc;
+
+	// Insert the slab position into the db. Objects packed into the same block
+	// each have an entry.
+	blocknew.slot = ed_vno_slot(vno);
+	if ((rc = ed_bpt_find(txn, ED_DB_BLOCKS, blocknew.no, NULL)) < 0 ||
+		(rc = ed_bpt_set(txn, ED_DB_BLOCKS, (void *)&blocknew, !ed_vno_ispacked(vno))) < 0) {
+		return rc;
+	}
+
+	// Insert the key into the db.
+	for (rc = ed_bpt_find(txn, ED_DB_KEYS, h, (void **)&key);
+			rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
+			rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
+		// A different tag is a hash collision with another key.
+		if (key->tag != tag) { continue; }
+
+		// Map the slab object. Objects in the tier slab are never opened directly,
+		// so their headers are left unchanged.
+		const EdBlkno nmin = key_need(cache, key->vno, key->count);
+		EdObjectHdr *old = key_map(cache, key->vno, nmin);
+		if (old == MAP_FAILED) { return ED_ERRNO; }
+
+		replace = old->keylen == klen && memcmp(obj_key(old), k, klen) == 0;
+		if (replace && !ed_vno_istier(key->vno) && !(cache->idx.flags & ED_FKEEPOLD)) {
+			batch_hdr(batch, old, key->vno, ED_TIME_DELETE);
+		}
+		key_unmap(cache, key->vno, old, nmin);
+		if (replace) {
+			keyold = *key;
+			break;
+		}
+	}
+	if (rc >= 0 && replace) {
+		rc = expiry_remove(txn, &keyold);
+	}
+	if (rc >= 0) {
+		rc = ed_bpt_set(txn, ED_DB_KEYS, (void *)&keynew, replace);
+	}
+	if (rc >= 0 && replace && ed_vno_istier(keyold.vno)) {
+		rc = tier_remove(batch, &keyold);
+	}
+	if (rc >= 0) {
+		rc = expiry_add(txn, &keynew);
+	}
+	if (rc >= 0 && !replace) {
+		rc = batch_add(batch, h);
+	}
+	return rc;
+}
+
+static EdPgno
+cache_slab_pages(const EdCache *cache)
+{
+	return ed_count_pg(cache->slab_block_count * cache->slab_block_size);
+}
+
+int
+ed_cache_open(EdCache **cachep, const EdConfig *cfg)
+{
+	int rc;
+	EdCache *cache = malloc(sizeof(*cache));
+	if (cache == NULL) { return ED_ERRNO; }
+
+	rc = ed_idx_open(&cache->idx, cfg);
+	if (rc < 0) { goto error_open; }
+
+	rc = ed_txn_new(&cache->txn, &cache->idx);
+	if (rc < 0) { goto error_txn; }
+
+	cache->ref = 1;
+	pthread_mutex_init(&cache->mtx, NULL);
+	pthread_mutex_init(&cache->lckmtx, NULL);
+	pthread_cond_init(&cache->lckcond, NULL);
+	cache->lcks = NULL;
+	cache->nlcks = 0;
+	cache->nlckslot = 0;
+	cache->slab = NULL;
+	cache->slab_block_count = cache->idx.hdr->slab_block_count;
+	cache->slab_block_size = cache->idx.hdr->slab_block_size;
+
+	if (cache->idx.flags & ED_FMAPSLAB) {
+		uint8_t *slab = ed_pg_map(cache->idx.slabfd, 0, cache_slab_pages(cache), false);
+		if (slab == MAP_FAILED) {
+			rc = ED_ERRNO;
+			goto error_map;
+		}
+		cache->slab = slab;
+	}
+
+	*cachep = cache;
+	return 0;
+
+error_map:
+	pthread_cond_destroy(&cache->lckcond);
+	pthread_mutex_destroy(&cache->lckmtx);
+	pthread_mutex_destroy(&cache->mtx);
+	ed_txn_close(&cache->txn, cache->idx.flags);
+error_txn:
+	ed_idx_close(&cache->idx);
+error_open:
+	free(cache);
+	return rc;
+}
+
+EdCache *
+ed_cache_ref(EdCache *cache)
+{
+	if (cache != NULL) {
+		__sync_fetch_and_add(&cache->ref, 1);
+	}
+	return cache;
+}
+
+void
+ed_cache_close(EdCache **cachep)
+{
+	EdCache *cache = *cachep;
+	if (cache != NULL) {
+		*cachep = NULL;
+		if (__sync_fetch_and_sub(&cache->ref, 1) == 1) {
+			if (cache->slab != NULL) {
+				ed_pg_unmap(cache->slab, cache_slab_pages(cache));
+			}
+			while (cache->txn != NULL) {
+				EdTxn *txn = cache->txn;
+				cache->txn = txn->next;
+				ed_txn_close(&txn, cache->idx.flags);
+			}
+			pthread_cond_destroy(&cache->lckcond);
+			pthread_mutex_destroy(&cache->lckmtx);
+			pthread_mutex_destroy(&cache->mtx);
+			free(cache->lcks);
+			ed_idx_close(&cache->idx);
+			free(cache);
+		}
+	}
+}
+
+int
+ed_cache_stat(EdCache *cache, FILE *out, uint64_t flags)
+{
+	if (out == NULL) { out = stdout; }
+
+	EdStat *stat;
+	int rc = ed_stat_new(&stat, &cache->idx, flags);
+	if (rc < 0) { return rc; }
+
+	flockfile(out);
+	ed_stat_print(stat, out);
+	fprintf(out,
+		"slab:\n"
+		"  path: %s\n"
+		"  inode: %" PRIu64 "\n"
+		"  blocks:\n"
+		"    size: %zu\n"
+		"    count: %zu\n"
+		"    cursor: %zu\n"
+		"    current: %zu\n"
+		,
+		cache->idx.hdr->slab_path,
+		cache->idx.hdr->slab_ino,
+		(size_t)cache->slab_block_size,
+		(size_t)cache->slab_block_count,
+		(size_t)cache->idx.hdr->vno,
+		(size_t)slab_no(cache, cache->idx.hdr->vno)
+	);
+	if (cache->idx.ring != NULL) {
+		fprintf(out, "rings:\n");
+		for (unsigned i = 0; i < ring_total(cache); i++) {
+			const EdRing *ring = &cache->idx.ring->rings[i];
+			const EdBlkno vno = i > 0 ? ring->vno : cache->idx.hdr->vno;
+			fprintf(out,
+				"  - start: %zu\n"
+				"    count: %zu\n"
+				"    limit: %zu\n"
+				"    cursor: %zu\n"
+				"    current: %zu\n"
+				,
+				(size_t)ring->start,
+				(size_t)ring->count,
+				(size_t)ring->limit,
+				(size_t)ed_vno_pos(vno),
+				(size_t)slab_no(cache, vno)
+			);
+		}
+	}
+	if (cache->idx.tier != NULL) {
+		const EdPgTier *tier = cache->idx.tier;
+		fprintf(out,
+			"tier:\n"
+			"  path: %s\n"
+			"  inode: %" PRIu64 "\n"
+			"  blocks:\n"
+			"    count: %zu\n"
+			"    cursor: %zu\n"
+			"    current: %zu\n"
+			,
+			tier->path,
+			tier->ino,
+			(size_t)tier->block_count,
+			(size_t)tier->vno,
+			(size_t)(tier->vno % tier->block_count)
+		);
+	}
+
+	funlockfile(out);
+	ed_stat_free(&stat);
+	return 0;
+}
+
+/** Maximum number of objects removed by each reaping transaction */
+#define REAP_BATCH 256
+
+/** Minimum number of slab blocks scanned by each rebuild thread */
+#define REBUILD_SEGMENT_MIN 1024
+
+/**
+ * @brief  Object header found while scanning the slab
+ */
+typedef struct {
+	uint64_t     hash;             /**< Hash of the key */
+	uint64_t     tag;              /**< Tag of the key */
+	EdTxnId      xid;              /**< Transaction ID that wrote the object */
+	EdBlkno      no;               /**< Slab block number of the object */
+	EdPgno       count;            /**< Number of blocks used by the object */
+	uint32_t     slot;             /**< Slot of a packed object, or 0 */
+	EdTime       created;          /**< Creation time of the object */
+	EdTime       exp;              /**< Expiration of the object */
+} RebuildObj;
+
+/**
+ * @brief  Slab segment scanned by a rebuild thread
+ */
+typedef struct {
+	EdCache *    cache;            /**< Cache object */
+	EdBlkno      start;            /**< First block of the segment */
+	EdBlkno      end;              /**< Block following the segment */
+	EdTxnId      xmax;             /**< Latest committed transaction ID */
+	size_t       nbadhash;         /**< Number of headers rejected by their key hash */
+	bool         spawned;          /**< A thread was created to scan the segment */
+	pthread_t    thread;           /**< Scanning thread */
+	RebuildObj * objs;             /**< Objects starting within the segment */
+	size_t       nobjs;            /**< Number of objects found */
+	size_t       nobjslot;         /**< Allocated size of #objs */
+	int          rc;               /**< Result of the scan */
+} RebuildSeg;
+
+/**
+ * @brief  Checks if a slab position holds a plausible object header
+ *
+ * Unfinished objects have no transaction ID, and objects written by a
+ * transaction that never committed have an ID past #xmax. Otherwise, the zero
+ * padding after the key and the object size must be consistent. A packed
+ * object must also end within its block.
+ *
+ * @param  cache  Cache object
+ * @param  hdr  Mapped header candidate
+ * @param  no  Slab block number of the header
+ * @param  off  Byte offset of the header in the block
+ * @param  avail  Number of mapped bytes starting at #hdr
+ * @param  xmax  Latest committed transaction ID
+ * @return  true if the header is valid
+ */
+static bool
+rebuild_valid(const EdCache *cache, EdObjectHdr *hdr, EdBlkno no, size_t off, size_t avail,
+		EdTxnId xmax)
+{
+	if (avail < sizeof(*hdr) || hdr->xid == 0 || hdr->xid > xmax ||
+			(hdr->flags & ~ED_HDR_FPACK) != 0 ||
+			hdr->keylen > ED_MAX_KEY || obj_meta_offset(hdr->keylen) > avail) {
+		return false;
+	}
+	for (const uint8_t *p = obj_key(hdr) + hdr->keylen; p < obj_meta(hdr); p++) {
+		if (*p != 0) { return false; }
+	}
+	if (hdr->flags & ED_HDR_FPACK) {
+		size_t nbytes = obj_pack_size(hdr->keylen, hdr->metalen, hdr->datalen, cache->idx.flags);
+		if (off + nbytes > cache->slab_block_size) {
+			return false;
+		}
+	}
+	else {
+		size_t nbytes = obj_slab_size(hdr->keylen, hdr->metalen, hdr->datalen,
+				cache->slab_block_size, cache->idx.flags);
+		const unsigned ring = ring_for_block(cache, no);
+		if (off > 0 ||
+				nbytes / cache->slab_block_size > ring_start(cache, ring) + ring_count(cache, ring) - no) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief  Checks the key hash and checksums of a plausible object header
+ *
+ * Data within an object, such as a segment starting in the middle of one, can
+ * look like a header. The key must match the hash in the header, which is why a
+ * new index must use the seed of the slab. With #ED_FCHECKSUM, the meta data and
+ * body must also match their checksums.
+ *
+ * @param  seg  Segment being scanned
+ * @param  hdr  Header that passed #rebuild_valid()
+ * @param  no  Slab block number of the header
+ * @param  avail  Number of mapped bytes starting at #hdr
+ * @return  1 if the object is intact, 0 if not, <0 on error
+ */
+static int
+rebuild_verify(RebuildSeg *seg, EdObjectHdr *hdr, EdBlkno no, size_t avail)
+{
+	const EdCache *cache = seg->cache;
+	const uint64_t flags = cache->idx.flags;
+	if (hdr->keyhash != ed_hash(obj_key(hdr), hdr->keylen, cache->idx.seed)) {
+		seg->nbadhash++;
+		return 0;
+	}
+	if (!(flags & ED_FCHECKSUM)) { return 1; }
+
+	const size_t nbytes = (hdr->flags & ED_HDR_FPACK) ?
+		obj_pack_size(hdr->keylen, hdr->metalen, hdr->datalen, flags) :
+		obj_slab_size(hdr->keylen, hdr->metalen, hdr->datalen, cache->slab_block_size, flags);
+	if (nbytes <= avail) {
+		return obj_hdr_verify(hdr, flags) == 0;
+	}
+
+	// The object extends past the mapping of the segment. Only unpacked objects
+	// can, so the header is at the start of the block.
+	const EdBlkno count = nbytes / cache->slab_block_size;
+	EdObjectHdr *full = slab_map(cache, no, count, false);
+	if (full == MAP_FAILED) { return ED_ERRNO; }
+	int rc = obj_hdr_verify(full, flags) == 0;
+	slab_unmap(cache, full, count);
+	return rc;
+}
+
+/**
+ * @brief  Adds an object found while scanning to a slab segment
+ * @param  seg  Segment being scanned
+ * @param  hdr  Valid object header
+ * @param  no  Slab block number of the object
+ * @param  count  Number of blocks used by the object
+ * @param  slot  Slot of a packed object, or 0
+ * @return  0 on success, <0 on error
+ */
+static int
+rebuild_push(RebuildSeg *seg, EdObjectHdr *hdr, EdBlkno no, EdPgno count, uint32_t slot)
+{
+	const EdCache *cache = seg->cache;
+	if (seg->nobjs == seg->nobjslot) {
+		size_t nslot = seg->nobjslot ? seg->nobjslot * 2 : 256;
+		RebuildObj *objs = realloc(seg->objs, nslot * sizeof(*objs));
+		if (objs == NULL) { return ED_ERRNO; }
+		seg->objs = objs;
+		seg->nobjslot = nslot;
+	}
+
+	seg->objs[seg->nobjs++] = (RebuildObj){
+		hdr->keyhash,
+		ed_entry_key_tag(obj_key(hdr), hdr->keylen, cache->idx.seed),
+		hdr->xid, no, count, slot, hdr->created, hdr->exp,
+	};
+	return 0;
+}
+
+/**
+ * @brief  Collects the object headers starting within a slab segment
+ *
+ * Valid objects are skipped over as a whole. Anything else advances by a
+ * single block. The headers of a packed block follow one another until one
+ * is not valid or not intact.
+ *
+ * @param  data  Segment to scan
+ * @return  NULL
+ */
+static void *
+rebuild_scan(void *data)
+{
+	RebuildSeg *seg = data;
+	EdCache *cache = seg->cache;
+	const uint16_t block_size = cache->slab_block_size;
+	const EdBlkno block_count = cache->slab_block_count;
+	const EdBlkno nmin = ED_ALIGN_SIZE(obj_meta_offset(ED_MAX_KEY), block_size) / block_size;
+	const EdBlkno end = block_count - seg->end > nmin ? seg->end + nmin : block_count;
+	const EdBlkno count = end - seg->start;
+
+	uint8_t *p = slab_map(cache, seg->start, count, false);
+	if (p == MAP_FAILED) {
+		seg->rc = ED_ERRNO;
+		return NULL;
+	}
+	slab_advise(cache, p, count * block_size, false);
+
+	for (EdBlkno no = seg->start; no < seg->end && seg->rc >= 0; ) {
+		uint8_t *blk = p + (no - seg->start) * block_size;
+		const size_t avail = (end - no) * block_size;
+		EdObjectHdr *hdr = (EdObjectHdr *)blk;
+		if (!rebuild_valid(cache, hdr, no, 0, avail, seg->xmax)) {
+			no++;
+			continue;
+		}
+		int rc = rebuild_verify(seg, hdr, no, avail);
+		if (rc <= 0) {
+			seg->rc = rc;
+			no++;
+			continue;
+		}
+
+		if (hdr->flags & ED_HDR_FPACK) {
+			size_t off = 0;
+			do {
+				seg->rc = rebuild_push(seg, hdr, no, 1, ed_vno_slot(ed_vno_pack(0, off)));
+				off += obj_pack_size(hdr->keylen, hdr->metalen, hdr->datalen, cache->idx.flags);
+				hdr = (EdObjectHdr *)(blk + off);
+			} while (seg->rc >= 0 && off < block_size &&
+					rebuild_valid(cache, hdr, no, off, avail - off, seg->xmax) &&
+					(hdr->flags & ED_HDR_FPACK) &&
+					(seg->rc = rebuild_verify(seg, hdr, no, avail - off)) > 0);
+			no++;
+			continue;
+		}
+
+		const EdPgno nblcks = obj_slab_size(hdr->keylen, hdr->metalen, hdr->datalen,
+				block_size, cache->idx.flags) / block_size;
+		seg->rc = rebuild_push(seg, hdr, no, nblcks, 0);
+		no += nblcks;
+	}
+
+	slab_unmap(cache, p, count);
+	return NULL;
+}
+
+/**
+ * @brief  Orders objects from the newest write to the oldest
+ */
+static int
+rebuild_xid_cmp(const void *a, const void *b)
+{
+	const RebuildObj *oa = a, *ob = b;
+	if (oa->xid != ob->xid) { return oa->xid > ob->xid ? -1 : 1; }
+	if (oa->no != ob->no) { return oa->no > ob->no ? -1 : 1; }
+	if (oa->slot != ob->slot) { return oa->slot > ob->slot ? -1 : 1; }
+	return 0;
+}
+
+/**
+ * @brief  Orders objects by key, with the newest write of each key first
+ */
+static int
+rebuild_key_cmp(const void *a, const void *b)
+{
+	const RebuildObj *oa = a, *ob = b;
+	if (oa->hash != ob->hash) { return oa->hash < ob->hash ? -1 : 1; }
+	if (oa->tag != ob->tag) { return oa->tag < ob->tag ? -1 : 1; }
+	if (oa->xid != ob->xid) { return oa->xid > ob->xid ? -1 : 1; }
+	return 0;
+}
+
+/**
+ * @brief  Orders expiry entries by expiration
+ */
+static int
+rebuild_exp_cmp(const void *a, const void *b)
+{
+	const EdEntryExp *ea = a, *eb = b;
+	if (ea->key != eb->key) { return ea->key < eb->key ? -1 : 1; }
+	return 0;
+}
+
+/**
+ * @brief  Orders block entries by slab position
+ */
+static int
+rebuild_block_cmp(const void *a, const void *b)
+{
+	const EdEntryBlock *ba = a, *bb = b;
+	if (ba->no != bb->no) { return ba->no < bb->no ? -1 : 1; }
+	return 0;
+}
+
+/**
+ * @brief  Claims the blocks of an object unless a newer object overlaps it
+ *
+ * Packed objects share the block claimed by the first of them found.
+ *
+ * @param  claimed  Bitmap of claimed slab blocks
+ * @param  packed  Bitmap of claimed slab blocks holding packed objects
+ * @param  no  First block of the object
+ * @param  count  Number of blocks in the object
+ * @param  slot  Slot of a packed object, or 0
+ * @return  true if the blocks were claimed
+ */
+static bool
+rebuild_claim(uint64_t *claimed, uint64_t *packed, EdBlkno no, EdPgno count, uint32_t slot)
+{
+	const uint64_t bit = UINT64_C(1) << (no%64);
+	if (slot != 0) {
+		if (claimed[no/64] & bit) { return (packed[no/64] & bit) != 0; }
+		claimed[no/64] |= bit;
+		packed[no/64] |= bit;
+		return true;
+	}
+	for (EdBlkno i = no; i < no + count; i++) {
+		if (claimed[i/64] & (UINT64_C(1) << (i%64))) { return false; }
+	}
+	for (EdBlkno i = no; i < no + count; i++) {
+		claimed[i/64] |= UINT64_C(1) << (i%64);
+	}
+	return true;
+}
+
+int
+ed_cache_rebuild(EdCache *cache, unsigned nthreads)
+{
+	EdIdx *idx = &cache->idx;
+	const uint64_t flags = idx->flags;
+	const uint16_t block_size = cache->slab_block_size;
+	const EdBlkno block_count = cache->slab_block_count;
+	RebuildSeg *segs = NULL;
+	RebuildObj *objs = NULL;
+	uint64_t *claimed = NULL, *packed = NULL;
+	EdEntryKey *keys = NULL;
+	EdEntryBlock *blocks = NULL;
+	EdEntryExp *exps = NULL;
+	size_t nobjs = 0, n = 0, nexps = 0;
+	EdTxn *txn = NULL;
+	int rc;
+
+	if (nthreads == 0) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = ncpu > 0 ? (unsigned)ncpu : 1;
+	}
+	if (block_count / nthreads < REBUILD_SEGMENT_MIN) {
+		nthreads = block_count > REBUILD_SEGMENT_MIN ?
+			(unsigned)(block_count / REBUILD_SEGMENT_MIN) : 1;
+	}
+
+	rc = cache_txn_get(cache, &txn);
+	if (rc < 0) { return rc; }
+
+	// The write lock is held for the whole rebuild so the slab cannot change.
+	rc = ed_txn_open(txn, flags);
+	if (rc < 0) { goto done; }
+
+	// A new index has never committed a transaction, so the transaction IDs of
+	// the objects cannot be checked against it.
+	const bool fresh = idx->hdr->xid <= 1;
+	size_t nbadhash = 0;
+
+	segs = calloc(nthreads, sizeof(*segs));
+	if (segs == NULL) { rc = ED_ERRNO; goto done; }
+	for (unsigned i = 0; i < nthreads; i++) {
+		segs[i].cache = cache;
+		segs[i].start = block_count * i / nthreads;
+		segs[i].end = block_count * (i+1) / nthreads;
+		segs[i].xmax = fresh ? UINT64_MAX : idx->hdr->xid;
+		if (i > 0) {
+			segs[i].spawned = pthread_create(&segs[i].thread, NULL, rebuild_scan, &segs[i]) == 0;
+		}
+	}
+	// Any segment without a thread is scanned by the calling thread.
+	for (unsigned i = 0; i < nthreads; i++) {
+		if (segs[i].spawned) { pthread_join(segs[i].thread, NULL); }
+		else { rebuild_scan(&segs[i]); }
+		if (segs[i].rc < 0 && rc >= 0) { rc = segs[i].rc; }
+		nobjs += segs[i].nobjs;
+		nbadhash += segs[i].nbadhash;
+	}
+	if (rc < 0) { goto done; }
+
+	// If no key hash matches, the new index was not created with the seed of
+	// the slab.
+	if (fresh && nobjs == 0 && nbadhash > 0) {
+		rc = ED_EINDEX_SEED;
+		goto done;
+	}
+
+	objs = malloc((nobjs + 1) * sizeof(*objs));
+	claimed = calloc((block_count + 63) / 64, sizeof(*claimed));
+	packed = calloc((block_count + 63) / 64, sizeof(*packed));
+	if (objs == NULL || claimed == NULL || packed == NULL) { rc = ED_ERRNO; goto done; }
+	nobjs = 0;
+	for (unsigned i = 0; i < nthreads; i++) {
+		memcpy(objs + nobjs, segs[i].objs, segs[i].nobjs * sizeof(*objs));
+		nobjs += segs[i].nobjs;
+	}
+
+	// Newer objects overwrote any older objects they overlap.
+	qsort(objs, nobjs, sizeof(*objs), rebuild_xid_cmp);
+	for (size_t i = 0; i < nobjs; i++) {
+		if (rebuild_claim(claimed, packed, objs[i].no, objs[i].count, objs[i].slot)) {
+			objs[n++] = objs[i];
+		}
+	}
+	nobjs = n;
+
+	// The newest object in each ring ends at its write position.
+	const unsigned nrings = ring_total(cache);
+	EdBlkno vnos[ED_RING_MAX], pos[ED_RING_MAX], lap[ED_RING_MAX];
+	bool found[ED_RING_MAX];
+	for (unsigned r = 0; r < nrings; r++) {
+		vnos[r] = ed_txn_vno(txn, r);
+		pos[r] = lap[r] = 0;
+		found[r] = false;
+	}
+	for (size_t i = 0; i < nobjs; i++) {
+		const unsigned r = ring_for_block(cache, objs[i].no);
+		if (!found[r]) {
+			pos[r] = objs[i].no - ring_start(cache, r) + objs[i].count;
+			found[r] = true;
+		}
+	}
+
+	// New pages must be newer than every object. A new index also adopts the
+	// time epoch of the objects, estimated from the last modification of the slab.
+	if (nobjs > 0 && objs[0].xid >= txn->xid) {
+		txn->xid = objs[0].xid + 1;
+	}
+	if (fresh && nobjs > 0) {
+		EdTime created = 0;
+		for (size_t i = 0; i < nobjs; i++) {
+			if (objs[i].created > created) { created = objs[i].created; }
+		}
+		struct stat st;
+		EdTimeUnix at = fstat(idx->slabfd, &st) == 0 ? st.st_mtime : ed_now_unix();
+		if (at > created) {
+			idx->hdr->epoch = idx->epoch = at - created;
+		}
+	}
+
+	// Drop removed and expired objects, and all but the newest of each key.
+	const EdTimeUnix now = ed_now_unix();
+	qsort(objs, nobjs, sizeof(*objs), rebuild_key_cmp);
+	n = 0;
+	for (size_t i = 0; i < nobjs; i++) {
+		if (n > 0 && objs[n-1].hash == objs[i].hash && objs[n-1].tag == objs[i].tag) {
+			continue;
+		}
+		objs[n++] = objs[i];
+	}
+	nobjs = n;
+	n = 0;
+	for (size_t i = 0; i < nobjs; i++) {
+		if (!ed_expired_at(idx->epoch, objs[i].exp, now)) {
+			objs[n++] = objs[i];
+		}
+	}
+
+	// Objects before the write position were written on the current lap and
+	// objects after it on the previous lap. The lap is chosen so that the
+	// position never moves backwards.
+	for (size_t i = 0; i < n; i++) {
+		const unsigned r = ring_for_block(cache, objs[i].no);
+		if (objs[i].no - ring_start(cache, r) >= pos[r]) { lap[r] = 1; }
+	}
+	for (unsigned r = 0; r < nrings; r++) {
+		if (!found[r]) { continue; }
+		const EdBlkno count = ring_count(cache, r);
+		const EdBlkno vres = ed_vno_pos(*ring_vres(cache, r));
+		EdBlkno vmin = ed_vno_pos(vnos[r]) > vres ? ed_vno_pos(vnos[r]) : vres;
+		if (vmin > lap[r] * count + pos[r]) {
+			lap[r] = (vmin - pos[r] + count - 1) / count;
+		}
+		vnos[r] = ed_vno_make(r, lap[r] * count + pos[r]);
+	}
+
+	keys = malloc((n + 1) * sizeof(*keys));
+	blocks = malloc((n + 1) * sizeof(*blocks));
+	exps = malloc((n + 1) * sizeof(*exps));
+	if (keys == NULL || blocks == NULL || exps == NULL) { rc = ED_ERRNO; goto done; }
+	for (size_t i = 0; i < n; i++) {
+		const RebuildObj *o = &objs[i];
+		const unsigned r = ring_for_block(cache, o->no);
+		const EdBlkno rno = o->no - ring_start(cache, r);
+		EdBlkno v = ed_vno_make(r, (rno < pos[r] ? lap[r] : lap[r] - 1) * ring_count(cache, r) + rno) |
+			((EdBlkno)o->slot << ED_VNO_SLOT_SHIFT);
+		keys[i] = ed_entry_key_make(o->hash, v, o->count, o->exp, o->tag);
+		blocks[i] = ed_entry_block_make(o->no, o->count, block_count, o->xid, o->hash);
+		blocks[i].slot = o->slot;
+		if (o->exp != ED_TIME_INF) {
+			exps[nexps++] = ed_entry_exp_make(o->hash, v, o->exp);
+		}
+	}
+	qsort(blocks, n, sizeof(*blocks), rebuild_block_cmp);
+	qsort(exps, nexps, sizeof(*exps), rebuild_exp_cmp);
+
+	if (fresh) {
+		for (size_t i = 0; i < n && rc >= 0; i++) {
+			uint8_t *p = slab_map(cache, objs[i].no, objs[i].count, false);
+			if (p == MAP_FAILED) { rc = ED_ERRNO; break; }
+			EdObjectHdr *hdr = (EdObjectHdr *)(p +
+					ed_vno_offset((EdBlkno)objs[i].slot << ED_VNO_SLOT_SHIFT));
+			if (hdr->keyhash != objs[i].hash) {
+				hdr->keyhash = objs[i].hash;
+				if (!(flags & ED_FNOSYNC)) {
+					rc = ed_blk_sync(p, objs[i].count, block_size, flags);
+				}
+			}
+			slab_unmap(cache, p, objs[i].count);
+		}
+		if (rc < 0) { goto done; }
+	}
+
+	// Only the slab is scanned, so any objects in the tier slab are dropped.
+	if ((rc = ed_bpt_load(txn, ED_DB_KEYS, keys, n)) < 0 ||
+			(rc = ed_bpt_load(txn, ED_DB_BLOCKS, blocks, n)) < 0 ||
+			(rc = ed_bpt_load(txn, ED_DB_EXPIRY, exps, nexps)) < 0 ||
+			(rc = ed_bpt_load(txn, ED_DB_TIER, NULL, 0)) < 0) {
+		goto done;
+	}
+	for (unsigned r = 0; r < nrings; r++) {
+		rc = ed_txn_set_vno(txn, vnos[r]);
+		if (rc < 0) { goto done; }
+	}
+	rc = ed_txn_set_pvno(txn, ED_BLK_NONE, 0);
+	if (rc < 0) { goto done; }
+
+	if (idx->filter != NULL) {
+		ed_idx_filter_clear(idx, txn->xid);
+		for (size_t i = 0; i < n; i++) {
+			ed_idx_filter_add(idx, keys[i].hash);
+		}
+	}
+	rc = ed_txn_commit(&txn, flags|ED_FRESET);
+	if (rc < 0 && idx->filter != NULL) {
+		// The filter no longer matches the index, so misses are never trusted.
+		ed_idx_filter_clear(idx, UINT64_MAX);
+	}
+
+done:
+	if (txn != NULL && ed_txn_isopen(txn)) {
+		ed_txn_close(&txn, flags|ED_FRESET);
+	}
+	cache_txn_put(cache, txn);
+	if (segs != NULL) {
+		for (unsigned i = 0; i < nthreads; i++) {
+			free(segs[i].objs);
+		}
+		free(segs);
+	}
+	free(objs);
+	free(claimed);
+	free(packed);
+	free(keys);
+	free(blocks);
+	free(exps);
+	return rc < 0 ? rc : 0;
+}
+
+/**
+ * @brief  Removes the key and block entries for an expired object
+ * @param  batch  Batch object
+ * @param  ent  Expiry entry of the object
+ * @return  0 on success, <0 on error
+ */
+static int
+obj_reap(EdBatch *batch, const EdEntryExp *ent)
+{
+	EdTxn *txn = batch->txn;
+	EdEntryKey *key;
+	int rc;
+
+	for (rc = ed_bpt_find(txn, ED_DB_KEYS, ent->hash, (void **)&key);
+			rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
+			rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
+		if (key->vno == ent->vno) {
+			rc = ed_bpt_del(txn, ED_DB_KEYS);
+			if (rc >= 0) {
+				rc = batch_remove(batch, ent->hash);
+			}
+			break;
+		}
+	}
+	if (rc < 0) { return rc; }
+
+	if (ed_vno_istier(ent->vno)) {
+		const EdEntryKey key = { .hash = ent->hash, .vno = ent->vno };
+		return tier_remove(batch, &key);
+	}
+
+	return block_remove(batch, ent->vno, ent->hash);
+}
+
+/**
+ * @brief  Removes the objects at the front of the expiry b+tree that expired
+ * @param  batch  Batch object
+ * @param  limit  Maximum number of objects to remove
+ * @param  now  Current time
+ * @return  Number of objects removed, <0 on error
+ */
+static int
+batch_reap(EdBatch *batch, unsigned limit, EdTimeUnix now)
+{
+	EdTxn *txn = batch->txn;
+	const EdTimeUnix epoch = batch->cache->idx.epoch;
+	unsigned n = 0;
+	int rc = 0;
+
+	for (; n < limit; n++) {
+		EdEntryExp *ent;
+		rc = ed_bpt_first(txn, ED_DB_EXPIRY, (void **)&ent);
+		if (rc < 0 || ent == NULL || !ed_expired_at(epoch, ed_entry_exp_time(ent), now)) {
+			break;
+		}
+		EdEntryExp exp = *ent;
+		rc = ed_bpt_del(txn, ED_DB_EXPIRY);
+		if (rc >= 0) {
+			rc = obj_reap(batch, &exp);
 		}
+		if (rc < 0) { break; }
 	}
+	return rc < 0 ? rc : (int)n;
 }
 
 int
-ed_cache_stat(EdCache *cache, FILE *out, uint64_t flags)
+ed_cache_reap(EdCache *cache, unsigned budget)
 {
-	if (out == NULL) { out = stdout; }
+	const uint64_t flags = cache->idx.flags;
+	EdBatch batch = { .cache = cache };
+	unsigned total = 0;
 
-	EdStat *stat;
-	int rc = ed_stat_new(&stat, &cache->idx, flags);
+	if (budget == 0 || budget > INT_MAX) { budget = INT_MAX; }
+
+	int rc = cache_txn_get(cache, &batch.txn);
 	if (rc < 0) { return rc; }
 
-	flockfile(out);
-	ed_stat_print(stat, out);
-	fprintf(out,
-		"slab:\n"
-		"  path: %s\n"
-		"  inode: %" PRIu64 "\n"
-		"  blocks:\n"
-		"    size: %zu\n"
-		"    count: %zu\n"
-		"    cursor: %zu\n"
-		"    current: %zu\n"
-		,
-		cache->idx.hdr->slab_path,
-		cache->idx.hdr->slab_ino,
-		(size_t)cache->slab_block_size,
-		(size_t)cache->slab_block_count,
-		(size_t)cache->idx.hdr->vno,
-		(size_t)(cache->idx.hdr->vno % cache->slab_block_count)
-	);
+	// Each transaction removes a limited number of objects so that the write
+	// lock is released regularly.
+	while (total < budget) {
+		unsigned limit = budget - total < REAP_BATCH ? budget - total : REAP_BATCH;
+		rc = ed_txn_open(batch.txn, flags);
+		if (rc < 0) { break; }
+		rc = batch_reap(&batch, limit, ed_now_unix());
+		int erc = batch_end(&batch, &batch.txn, rc > 0, flags|ED_FRESET);
+		if (rc >= 0 && erc < 0) { rc = erc; }
+		if (rc <= 0) { break; }
+		total += rc;
+		if ((unsigned)rc < limit) { break; }
+	}
 
-	funlockfile(out);
-	ed_stat_free(&stat);
-	return 0;
+	cache_txn_put(cache, batch.txn);
+	return rc < 0 ? rc : (int)total;
 }
 
+/**
+ * @brief  Copies the object for a key from the tier slab back into the slab
+ *
+ * The object is copied as-is, so its header and checksums are unchanged.
+ * Reserving the new region may write to the tier slab, so the object is first
+ * copied out of it. This requires space for one slab change in the batch.
+ *
+ * @param  batch  Batch object
+ * @param  k  Key of the object
+ * @param  klen  Length of the key
+ * @param  h  Key hash
+ * @return  1 if copied, 0 if not found, <0 on error
+ */
 static int
-open_key(EdCache *cache, EdTxn *txn, EdObject *obj, const void *k, size_t klen, uint64_t flags)
+obj_promote(EdBatch *batch, const void *k, size_t klen, uint64_t h)
+{
+	EdCache *cache = batch->cache;
+	EdTxn *txn = batch->txn;
+	const uint64_t flags = cache->idx.flags;
+	const uint16_t block_size = cache->slab_block_size;
+	const uint64_t tag = ed_entry_key_tag(k, klen, cache->idx.seed);
+	const EdTimeUnix now = ed_now_unix();
+	EdObjectHdr *copy = NULL, *hdr;
+	EdEntryKey *key, found;
+	int rc;
+
+	for (rc = ed_bpt_find(txn, ED_DB_KEYS, h, (void **)&key);
+			rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
+			rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
+		if (key->tag != tag || !ed_vno_istier(key->vno) ||
+				ed_expired_at(cache->idx.epoch, key->exp, now)) {
+			continue;
+		}
+		hdr = tier_map(cache, tier_no(cache, key->vno), key->count);
+		if (hdr == MAP_FAILED) { return ED_ERRNO; }
+		if (hdr->keylen == klen && memcmp(obj_key(hdr), k, klen) == 0) {
+			found = *key;
+			copy = malloc((size_t)found.count * block_size);
+			if (copy != NULL) {
+				memcpy(copy, hdr, (size_t)found.count * block_size);
+			}
+			else {
+				rc = ED_ERRNO;
+			}
+		}
+		tier_unmap(cache, hdr, key->count);
+		if (copy != NULL || rc < 0) { break; }
+	}
+	if (copy == NULL) { return rc < 0 ? rc : 0; }
+
+	// A damaged object is left in the tier slab rather than promoted.
+	if ((flags & ED_FCHECKSUM) && !(flags & ED_FNOVERIFY)) {
+		rc = obj_hdr_verify(copy, flags);
+		if (rc < 0) { goto done; }
+	}
+
+	const size_t nbytes = (size_t)found.count * block_size;
+	EdBlkno vno = ed_txn_vno(txn, ring_for_size(cache, found.count));
+	rc = obj_reserve(batch, flags, &vno, nbytes, h, tag);
+	if (rc < 0) { goto done; }
+
+	hdr = slab_map(cache, slab_no(cache, vno), found.count, true);
+	if (hdr == MAP_FAILED) {
+		rc = ED_ERRNO;
+		slab_unlock(cache, slab_no(cache, vno) * block_size, nbytes, flags);
+		goto done;
+	}
+
+	ed_txn_set_vno(txn, vno + found.count);
+	memcpy(hdr, copy, nbytes);
+
+	rc = obj_upsert(batch, k, klen, h, vno, found.count, found.exp);
+	if (rc >= 0) {
+		hdr->exp = found.exp;
+		hdr->xid = txn->xid;
+		assert(batch->nslab < batch->nslabslot);
+		batch->slab[batch->nslab++] = (EdBatchSlab){
+			slab_no(cache, vno), found.count, found.exp, 0, 0
+		};
+		rc = 1;
+	}
+	else {
+		slab_unlock(cache, slab_no(cache, vno) * block_size, nbytes, flags);
+	}
+	slab_unmap(cache, hdr, found.count);
+
+done:
+	free(copy);
+	return rc;
+}
+
+/**
+ * @brief  Opens an object for a key
+ *
+ * Key entries for the tier slab are not opened, but are reported so that the
+ * object may be promoted with #open_tier().
+ *
+ * @param  cache  Cache object
+ * @param  txn  Open transaction
+ * @param  obj  Object to initialize
+ * @param  k  Key of the object
+ * @param  klen  Length of the key
+ * @param  h  Key hash
+ * @param  flags  Lock flags
+ * @param  lock  Lock the slab region of the object
+ * @return  1 if opened, 2 if only found in the tier slab, 0 if not found, <0 on error
+ */
+static int
+open_key(EdCache *cache, EdTxn *txn, EdObject *obj, const void *k, size_t klen, uint64_t h,
+		uint64_t flags, bool lock)
 {
-	const uint64_t h = ed_hash(k, klen, cache->idx.seed);
 	const uint16_t block_size = cache->slab_block_size;
-	const EdBlkno block_count = cache->slab_block_count;
 	const EdTimeUnix now = ed_now_unix();
+	const uint64_t tag = ed_entry_key_tag(k, klen, cache->idx.seed);
+
+	// Hits and misses both count towards admitting the key.
+	if (cache->idx.sketch != NULL) {
+		ed_idx_sketch_add(&cache->idx, h);
+	}
+
+	// Most misses are answered by the filter without searching the b+tree.
+	if (cache->idx.filter != NULL && !ed_idx_filter_has(&cache->idx, h, txn->rxid)) {
+		return 0;
+	}
 
 	EdEntryKey *key;
+	bool tier = false;
 	int rc;
 	for (rc = ed_bpt_find(txn, ED_DB_KEYS, h, (void **)&key);
 			rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
 			rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
-		// First check if the object is expired.
-		if (ed_expired_at(cache->idx.epoch, key->exp, now)) {
+		// First check if the object is expired or a different key.
+		if (key->tag != tag || ed_expired_at(cache->idx.epoch, key->exp, now)) {
 			continue;
 		}
 
-		off_t off = (key->vno % block_count) * block_size;
-		off_t len = key->count * block_size;
+		// The tier slab is only read while holding the write lock.
+		if (ed_vno_istier(key->vno)) {
+			tier = true;
+			continue;
+		}
+
+		off_t off, len;
+		slab_region(cache, key->vno, key->count, &off, &len);
 
 		// Try to get a shared lock on the slab region. If it cannot be locked, a
 		// writer is replacing this slab location.
-		if (ed_flck(cache->idx.slabfd, ED_LCK_SH, off, len, flags|ED_FNOBLOCK) < 0) {
+		if (lock && slab_lock(cache, ED_LCK_SH, off, len, flags) < 0) {
 			continue;
 		}
 
 		// Map the slab object.
-		EdObjectHdr *hdr = ed_blk_map(cache->idx.slabfd, key->vno % block_count, key->count, block_size, false);
+		EdObjectHdr *hdr = slab_map_obj(cache, key->vno, key->count, false);
 		if (hdr == MAP_FAILED) {
 			rc = ED_ERRNO;
-			ed_flck(cache->idx.slabfd, ED_LCK_UN, off, len, flags);
+			if (lock) { slab_unlock(cache, off, len, flags); }
 			return rc;
 		}
 
 		// Resolve any hash collisions with a full key comparison. This will *very*
-		// likely match. If it does, set up the object and end the loop.
-		if (hdr->keylen == klen && memcmp(obj_key(hdr), k, klen) == 0) {
-			obj_init(obj, cache, hdr, key->vno, true, key->exp);
-			return 1;
+		// likely match. If it does, set up the object and end the loop. Without
+		// a lock, a replaced object is skipped just as a locked one would be. A
+		// replaced packed header could describe a key past the end of the block.
+		if (hdr->keylen == klen &&
+				ed_vno_offset(key->vno) + obj_key_offset() + klen <= key->count * block_size &&
+				memcmp(obj_key(hdr), k, klen) == 0) {
+			if (cache->idx.clock != NULL) {
+				ed_idx_clock_mark(&cache->idx, slab_no(cache, key->vno));
+			}
+			if (lock && (!ed_vno_ispacked(key->vno) || vno_current(cache, key->vno))) {
+				obj_init(obj, cache, hdr, key->vno, true, key->exp);
+				return 1;
+			}
+			if (!lock && obj_init_optimistic(obj, cache, hdr, key->vno, key->count, key->exp)) {
+				return 1;
+			}
 		}
 
 		// We have a hash collision so unlock and unmap the slab region and continue
 		// searching with the next entry.
-		ed_flck(cache->idx.slabfd, ED_LCK_UN, off, len, flags);
-		ed_blk_unmap(hdr, key->count, block_size);
+		if (lock) { slab_unlock(cache, off, len, flags); }
+		slab_unmap_obj(cache, key->vno, hdr, key->count);
 	}
-	return 0;
+	return tier ? 2 : 0;
+}
+
+/**
+ * @brief  Promotes the object for a key from the tier slab and opens it
+ * @param  cache  Cache object
+ * @param  txn  Closed transaction to use for both the promotion and the open
+ * @param  obj  Object to initialize
+ * @param  k  Key of the object
+ * @param  klen  Length of the key
+ * @param  h  Key hash
+ * @param  lock  Lock the slab region of the object
+ * @return  1 if opened, 0 if not found, <0 on error
+ */
+static int
+open_tier(EdCache *cache, EdTxn *txn, EdObject *obj, const void *k, size_t klen, uint64_t h,
+		bool lock)
+{
+	const uint64_t flags = cache->idx.flags;
+	EdBatchSlab slab[1];
+	EdBatch batch = { cache, txn, slab, 0, ed_len(slab), 0, NULL, 0, 0, NULL, 0, 0 };
+
+	int rc = ed_txn_open(txn, flags);
+	if (rc >= 0) {
+		rc = obj_promote(&batch, k, klen, h);
+		int erc = batch_end(&batch, &batch.txn, rc == 1, flags|ED_FRESET);
+		if (erc < 0 && rc >= 0) { rc = erc; }
+	}
+	if (rc == 1) {
+		rc = ed_txn_open(txn, flags|ED_FRDONLY);
+		if (rc >= 0) {
+			rc = open_key(cache, txn, obj, k, klen, h, flags, lock);
+			ed_txn_close(&txn, flags|ED_FRESET);
+		}
+	}
+	return rc == 2 ? 0 : rc;
+}
+
+/**
+ * @brief  Hints that the slab regions for a key hash will be read soon
+ * @param  cache  Cache object
+ * @param  txn  Open transaction
+ * @param  h  Key hash
+ * @param  now  Current time used to skip expired objects
+ * @return  0 on success, <0 on error
+ */
+static int
+open_prefetch(EdCache *cache, EdTxn *txn, uint64_t h, EdTimeUnix now)
+{
+	EdEntryKey *key;
+	int rc;
+	for (rc = ed_bpt_find(txn, ED_DB_KEYS, h, (void **)&key);
+			rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
+			rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
+		if (ed_vno_istier(key->vno) || ed_expired_at(cache->idx.epoch, key->exp, now)) {
+			continue;
+		}
+		off_t off, len;
+		slab_region(cache, key->vno, key->count, &off, &len);
+#if defined(POSIX_FADV_WILLNEED)
+		posix_fadvise(cache->idx.slabfd, off, len, POSIX_FADV_WILLNEED);
+#elif defined(F_RDADVISE)
+		struct radvisory ra = { .ra_offset = off, .ra_count = (int)len };
+		fcntl(cache->idx.slabfd, F_RDADVISE, &ra);
+#else
+		(void)off;
+		(void)len;
+#endif
+	}
+	return rc < 0 ? rc : 0;
 }
 
 static int
-open_id(EdCache *cache, EdTxn *txn, EdObject *obj, const char *id, uint64_t flags)
+open_id(EdCache *cache, EdTxn *txn, EdObject *obj, const char *id, uint64_t flags, bool lock)
 {
 	EdTxnId xid;
 	EdBlkno vno;
-	const uint16_t block_size = cache->slab_block_size;
-	const EdBlkno block_count = cache->slab_block_count;
 	int rc = obj_id(id, &xid, &vno);
 	if (rc < 0) { return rc; }
-	if (xid > cache->idx.conn->xid || vno > ed_txn_vno(txn)) {
+	if (xid > txn->rxid || ed_vno_istier(vno) || ed_vno_ring(vno) >= ring_total(cache) ||
+			(ed_vno_ispacked(vno) && ed_vno_offset(vno) >= cache->slab_block_size) ||
+			ed_vno_block(vno) > ed_txn_vno(txn, ed_vno_ring(vno))) {
 		return 0;
 	}
 
+	// Objects packed into the same block each have an entry.
 	EdEntryBlock *entry;
-	rc = ed_bpt_find(txn, ED_DB_BLOCKS, vno % block_count, (void **)&entry);
+	for (rc = ed_bpt_find(txn, ED_DB_BLOCKS, slab_no(cache, vno), (void **)&entry);
+			rc == 1 && ed_bpt_loop(txn, ED_DB_BLOCKS) == 0;
+			rc = ed_bpt_next(txn, ED_DB_BLOCKS, (void **)&entry)) {
+		if (entry->slot == ed_vno_slot(vno)) { break; }
+	}
 	if (rc <= 0) { return rc; }
 	if (entry->xid != xid) { return 0; }
 
-	off_t off = entry->no * block_size;
-	off_t len = entry->count * block_size;
+	const EdBlkno count = entry->count;
+	off_t off, len;
+	slab_region(cache, vno, count, &off, &len);
 
 	// Try to get a shared lock on the slab region. If it cannot be locked, a
 	// writer is replacing this slab location.
-	if (ed_flck(cache->idx.slabfd, ED_LCK_SH, off, len, flags|ED_FNOBLOCK) < 0) {
+	if (lock && slab_lock(cache, ED_LCK_SH, off, len, flags) < 0) {
 		return 0;
 	}
 
 	// Map the slab object.
-	EdObjectHdr *hdr = ed_blk_map(cache->idx.slabfd, entry->no, entry->count, block_size, false);
+	EdObjectHdr *hdr = slab_map_obj(cache, vno, count, false);
 	if (hdr == MAP_FAILED) {
 		rc = ED_ERRNO;
-		ed_flck(cache->idx.slabfd, ED_LCK_UN, off, len, flags);
+		if (lock) { slab_unlock(cache, off, len, flags); }
 		return rc;
 	}
 
-	obj_init(obj, cache, hdr, vno, true, hdr->exp);
-	return 1;
+	if (lock) {
+		if (!ed_vno_ispacked(vno) || vno_current(cache, vno)) {
+			obj_init(obj, cache, hdr, vno, true, hdr->exp);
+			return 1;
+		}
+		slab_unlock(cache, off, len, flags);
+	}
+	else if (obj_init_optimistic(obj, cache, hdr, vno, count, hdr->exp) &&
+			obj->xid == xid) {
+		return 1;
+	}
+	slab_unmap_obj(cache, vno, hdr, count);
+	return 0;
 }
 
 int
 ed_open(EdCache *cache, EdObject **objp, const void *k, size_t klen, int oflags)
 {
-	(void)oflags;
 	EdObject *obj = NULL;
 	int rc = obj_new(&obj, NULL, 0, true);
 	if (rc < 0) { return rc; }
 	assert(obj != NULL);
 
 	const uint64_t flags = cache->idx.flags;
-	EdTxn *const txn = cache->txn;
+	EdTxn *txn = NULL;
+
+	rc = cache_txn_get(cache, &txn);
+	if (rc < 0) { goto done; }
 
 	rc = ed_txn_open(txn, flags|ED_FRDONLY);
 	if (rc < 0) { goto done; }
 
+	const bool lock = !(oflags & ED_OOPTIMISTIC);
 	if (oflags & ED_OID) {
-		rc = open_id(cache, txn, obj, k, flags);
+		rc = open_id(cache, txn, obj, k, flags, lock);
 	}
 	else {
-		rc = open_key(cache, txn, obj, k, klen, flags);
+		const uint64_t h = ed_hash(k, klen, cache->idx.seed);
+		rc = open_key(cache, txn, obj, k, klen, h, flags, lock);
+		if (rc == 2) {
+			ed_txn_close(&txn, flags|ED_FRESET);
+			rc = open_tier(cache, txn, obj, k, klen, h, lock);
+		}
 	}
 
 done:
-	ed_txn_close(&cache->txn, flags|ED_FRESET);
+	if (txn != NULL) {
+		ed_txn_close(&txn, flags|ED_FRESET);
+		cache_txn_put(cache, txn);
+	}
 	if (rc == 1) {
-		madvise(obj->hdr, obj->nbytes, MADV_SEQUENTIAL);
+		slab_advise(cache, obj->hdr, obj->nbytes, true);
 		int vrc = obj_verify(obj, flags);
 		if (vrc < 0) { rc = vrc; }
+		// A checksum failure for an unlocked object is expected if it was
+		// replaced while verifying, and is treated the same as a locked miss.
+		if (vrc < 0 && !obj->locked && !obj_current(obj)) {
+			slab_unmap_obj(cache, obj->vno, obj->hdr, obj->nblcks);
+			rc = 0;
+		}
 	}
 	if (rc <= 0) {
 		free(obj);
@@ -493,6 +2940,229 @@ done:
 	return rc;
 }
 
+typedef struct {
+	uint64_t     hash;             /**< Hash of the key */
+	size_t       index;            /**< Position of the key in the input array */
+	bool         tier;             /**< Key is only found in the tier slab */
+} OpenKey;
+
+static int
+open_key_cmp(const void *a, const void *b)
+{
+	uint64_t ha = ((const OpenKey *)a)->hash;
+	uint64_t hb = ((const OpenKey *)b)->hash;
+	if (ha < hb) { return -1; }
+	else if (ha > hb) { return 1; }
+	return 0;
+}
+
+int
+ed_open_many(EdCache *cache, const void *const *keys, const size_t *lens, size_t n, EdObject **objs)
+{
+	const uint64_t flags = cache->idx.flags;
+	const EdTimeUnix now = ed_now_unix();
+	EdTxn *txn = NULL;
+	OpenKey *order = NULL;
+	int rc = 0, nfound = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		objs[i] = NULL;
+	}
+	if (n == 0) { return 0; }
+
+	// Sort the lookups by hash so that neighboring keys share branch and leaf
+	// pages. These stay mapped in the transaction across lookups.
+	order = malloc(n * sizeof(*order));
+	if (order == NULL) { return ED_ERRNO; }
+	for (size_t i = 0; i < n; i++) {
+		order[i].hash = ed_hash(keys[i], lens[i], cache->idx.seed);
+		order[i].index = i;
+		order[i].tier = false;
+	}
+	qsort(order, n, sizeof(*order), open_key_cmp);
+
+	rc = cache_txn_get(cache, &txn);
+	if (rc < 0) { goto done; }
+
+	rc = ed_txn_open(txn, flags|ED_FRDONLY);
+	if (rc < 0) { goto done; }
+
+	// Hint all slab regions before any are mapped so the reads may be serviced
+	// concurrently.
+	for (size_t i = 0; i < n && rc >= 0; i++) {
+		if (i == 0 || order[i].hash != order[i-1].hash) {
+			rc = open_prefetch(cache, txn, order[i].hash, now);
+		}
+	}
+
+	for (size_t i = 0; i < n && rc >= 0; i++) {
+		const size_t x = order[i].index;
+		EdObject *obj = NULL;
+		rc = obj_new(&obj, NULL, 0, true);
+		if (rc < 0) { break; }
+		rc = open_key(cache, txn, obj, keys[x], lens[x], order[i].hash, flags, true);
+		if (rc == 1) {
+			objs[x] = obj;
+			nfound++;
+		}
+		else {
+			order[i].tier = rc == 2;
+			free(obj);
+		}
+	}
+
+	ed_txn_close(&txn, flags|ED_FRESET);
+
+	// Keys found in the tier slab are promoted one at a time after the read
+	// transaction is closed.
+	for (size_t i = 0; i < n && rc >= 0; i++) {
+		if (!order[i].tier) { continue; }
+		const size_t x = order[i].index;
+		EdObject *obj = NULL;
+		rc = obj_new(&obj, NULL, 0, true);
+		if (rc < 0) { break; }
+		rc = open_tier(cache, txn, obj, keys[x], lens[x], order[i].hash, true);
+		if (rc == 1) {
+			objs[x] = obj;
+			nfound++;
+		}
+		else {
+			free(obj);
+		}
+	}
+
+	cache_txn_put(cache, txn);
+	txn = NULL;
+
+	for (size_t i = 0; i < n && rc >= 0; i++) {
+		if (objs[i] != NULL) {
+			slab_advise(cache, objs[i]->hdr, objs[i]->nbytes, true);
+			rc = obj_verify(objs[i], flags);
+		}
+	}
+
+done:
+	if (txn != NULL) {
+		ed_txn_close(&txn, flags|ED_FRESET);
+		cache_txn_put(cache, txn);
+	}
+	free(order);
+	if (rc < 0) {
+		for (size_t i = 0; i < n; i++) {
+			ed_discard(&objs[i]);
+		}
+		return rc;
+	}
+	return nfound;
+}
+
+/**
+ * @brief  Tests if a key has an entry in the index
+ *
+ * The key entry tags are compared rather than the keys in the slab, so no
+ * slab regions are mapped or locked.
+ *
+ * @param  cache  Cache object
+ * @param  txn  Open transaction
+ * @param  h  Key hash
+ * @param  tag  Key tag
+ * @param  now  Current time used to skip expired objects
+ * @return  1 if found, 0 if not found, <0 on error
+ */
+static int
+key_exists(EdCache *cache, EdTxn *txn, uint64_t h, uint64_t tag, EdTimeUnix now)
+{
+	if (cache->idx.filter != NULL && !ed_idx_filter_has(&cache->idx, h, txn->rxid)) {
+		return 0;
+	}
+
+	EdEntryKey *key;
+	int rc;
+	for (rc = ed_bpt_find(txn, ED_DB_KEYS, h, (void **)&key);
+			rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
+			rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
+		if (key->tag == tag && !ed_expired_at(cache->idx.epoch, key->exp, now)) {
+			return 1;
+		}
+	}
+	return rc < 0 ? rc : 0;
+}
+
+int
+ed_exists(EdCache *cache, const void *k, size_t klen)
+{
+	const uint64_t flags = cache->idx.flags;
+	EdTxn *txn = NULL;
+
+	int rc = cache_txn_get(cache, &txn);
+	if (rc < 0) { goto done; }
+
+	rc = ed_txn_open(txn, flags|ED_FRDONLY);
+	if (rc < 0) { goto done; }
+
+	rc = key_exists(cache, txn,
+			ed_hash(k, klen, cache->idx.seed),
+			ed_entry_key_tag(k, klen, cache->idx.seed),
+			ed_now_unix());
+
+done:
+	if (txn != NULL) {
+		ed_txn_close(&txn, flags|ED_FRESET);
+		cache_txn_put(cache, txn);
+	}
+	return rc;
+}
+
+int
+ed_contains_many(EdCache *cache, const void *const *keys, const size_t *lens, size_t n, bool *found)
+{
+	const uint64_t flags = cache->idx.flags;
+	const EdTimeUnix now = ed_now_unix();
+	EdTxn *txn = NULL;
+	OpenKey *order = NULL;
+	int rc = 0, nfound = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		found[i] = false;
+	}
+	if (n == 0) { return 0; }
+
+	// Sort the lookups by hash so that neighboring keys share branch and leaf
+	// pages. These stay mapped in the transaction across lookups.
+	order = malloc(n * sizeof(*order));
+	if (order == NULL) { return ED_ERRNO; }
+	for (size_t i = 0; i < n; i++) {
+		order[i].hash = ed_hash(keys[i], lens[i], cache->idx.seed);
+		order[i].index = i;
+		order[i].tier = false;
+	}
+	qsort(order, n, sizeof(*order), open_key_cmp);
+
+	rc = cache_txn_get(cache, &txn);
+	if (rc < 0) { goto done; }
+
+	rc = ed_txn_open(txn, flags|ED_FRDONLY);
+	if (rc < 0) { goto done; }
+
+	for (size_t i = 0; i < n && rc >= 0; i++) {
+		const size_t x = order[i].index;
+		rc = key_exists(cache, txn, order[i].hash,
+				ed_entry_key_tag(keys[x], lens[x], cache->idx.seed), now);
+		if (rc == 1) {
+			found[x] = true;
+			nfound++;
+		}
+	}
+
+done:
+	if (txn != NULL) {
+		ed_txn_close(&txn, flags|ED_FRESET);
+		cache_txn_put(cache, txn);
+	}
+	free(order);
+	return rc < 0 ? rc : nfound;
+}
+
 int
 ed_create(EdCache *cache, EdObject **objp, const EdObjectAttr *attr)
 {
@@ -506,69 +3176,47 @@ ed_create(EdCache *cache, EdObject **objp, const EdObjectAttr *attr)
 	const uint64_t h = ed_hash(attr->key, attr->keylen, cache->idx.seed);
 	const uint64_t flags = cache->idx.flags;
 	const uint16_t block_size = cache->slab_block_size;
-	const EdBlkno block_count = cache->slab_block_count;
 	const size_t nbytes = obj_slab_size(attr->keylen, attr->metalen, attr->datalen, block_size, flags);
 	const EdBlkno nblcks = nbytes/block_size;
-	const int slabfd = cache->idx.slabfd;
-	EdTxn *const txn = cache->txn;
+	EdTxn *txn = NULL;
+	EdBatch batch = { .cache = cache };
 
 	EdObjectHdr *hdr = MAP_FAILED;
 	bool locked = false;
 	EdBlkno vno;
 
-	// Open a transaction. This allows to get the current slab position safely.
-	// If this fails, return the error code, but any furtur failures must goto
-	// the done label.
-	rc = ed_txn_open(txn, flags);
-	if (rc < 0) { goto done; }
-
-	vno = ed_txn_vno(txn);
-	rc = obj_reserve(cache, txn, flags, &vno, nbytes);
-	if (rc < 0) { goto done; }
-
-	// Map the new object header in the slab.
-	hdr = ed_blk_map(slabfd, vno % block_count, nblcks, block_size, true);
-	if (hdr == MAP_FAILED) {
-		rc = ED_ERRNO;
-		goto done;
-	}
-
-	// Add the next write position to the transaction.
-	ed_txn_set_vno(txn, vno + nblcks);
-
-	// Commit changes and initialize the new header.
-	rc = ed_txn_commit(&cache->txn, flags|ED_FRESET);
+	rc = cache_txn_get(cache, &txn);
 	if (rc < 0) { goto done; }
+	batch.txn = txn;
 
-	// Initializse the object header.
-	madvise(hdr, nbytes, MADV_SEQUENTIAL);
-	hdr->xid = 0;
-	hdr->created = now;
-	hdr->exp = 0;
-	hdr->flags = 0;
-	hdr->keylen = attr->keylen;
-	hdr->metalen = attr->metalen;
-	hdr->datalen = attr->datalen;
-	hdr->keyhash = h;
-	hdr->metacrc = 0;
-	hdr->datacrc = 0;
-
-	// Copy the key into the tail of the header segment.
-	uint8_t *key = obj_key(hdr), *meta = obj_meta(hdr);
-	memcpy(key, attr->key, attr->keylen);
-	key += attr->keylen;
+	// Open a transaction. This allows to get the current slab position safely.
+	// If this fails, return the error code, but any furtur failures must goto
+	// the done label.
+	rc = ed_txn_open(txn, flags);
+	if (rc < 0) { goto done; }
 
-	// Zero out the end of the key segment.
-	memset(key, 0, obj_meta(hdr) - key);
+	vno = ed_txn_vno(txn, ring_for_size(cache, nblcks));
+	rc = obj_reserve(&batch, flags, &vno, nbytes, h,
+			ed_entry_key_tag(attr->key, attr->keylen, cache->idx.seed));
+	if (rc < 0) { goto done; }
 
-	// Write the meta data segment if provided.
-	if (attr->meta != NULL && attr->metalen > 0) {
-		obj_write(meta, attr->meta, attr->metalen, &hdr->metacrc, flags);
+	// Map the new object header in the slab.
+	hdr = slab_map(cache, slab_no(cache, vno), nblcks, true);
+	if (hdr == MAP_FAILED) {
+		rc = ED_ERRNO;
+		goto done;
 	}
-	meta += attr->metalen;
 
-	// Zero out the end of the meta segment.
-	memset(meta, 0, obj_data(hdr, flags) - meta);
+	// Add the next write position to the transaction.
+	ed_txn_set_vno(txn, vno + nblcks);
+
+	// Commit changes and initialize the new header.
+	rc = batch_commit(&batch, &txn, flags|ED_FRESET);
+	if (rc < 0) { goto done; }
+
+	// Initializse the object header.
+	slab_advise(cache, hdr, nbytes, false);
+	obj_hdr_init(hdr, attr, h, now, flags);
 
 	obj_init(obj, cache, hdr, vno, false, ED_TIME_INF);
 
@@ -576,79 +3224,327 @@ done:
 	// Clean up resources if there was an error.
 	if (rc < 0) {
 		if (hdr != MAP_FAILED) {
-			ed_blk_unmap(hdr, nblcks, block_size);
+			slab_unmap(cache, hdr, nblcks);
 		}
 		if (locked) {
-			ed_flck(slabfd, ED_LCK_UN, (vno % block_count) * block_size, nbytes, flags);
+			slab_unlock(cache, slab_no(cache, vno) * block_size, nbytes, flags);
 		}
-		if (ed_txn_isopen(txn)) {
-			ed_txn_close(&cache->txn, flags|ED_FRESET);
+		if (txn != NULL && ed_txn_isopen(txn)) {
+			ed_txn_close(&txn, flags|ED_FRESET);
 		}
 		free(obj);
 		obj = NULL;
 	}
+	batch_free_keys(&batch);
+	cache_txn_put(cache, txn);
 	*objp = obj;
 	return rc;
 }
 
+/**
+ * @brief  Writes a complete object and inserts it into the index
+ *
+ * The slab region of the new object remains locked until the batch ends.
+ * This requires space for two slab changes in the batch.
+ *
+ * @param  batch  Batch object
+ * @param  attr  Object attributes excluding the data length
+ * @param  iov  Array of data segments
+ * @param  iovcnt  Number of segments in #iov
+ * @param  exp  Expiry of the object
+ * @return  0 on success, <0 on error
+ */
 static int
-update_expiry(EdCache *cache, const void *k, size_t klen, EdTime exp, EdTimeUnix now, bool restore)
+obj_set(EdBatch *batch, const EdObjectAttr *attr, const struct iovec *iov, int iovcnt, EdTime exp)
 {
+	size_t len = 0;
+	for (int i = 0; i < iovcnt; i++) {
+		len += iov[i].iov_len;
+	}
+	if (len > UINT32_MAX) { return ED_EOBJECT_TOOBIG; }
+
+	EdObjectAttr a = *attr;
+	a.datalen = (uint32_t)len;
+
+	EdCache *cache = batch->cache;
+	EdTxn *const txn = batch->txn;
+	const EdTime now = ed_time_from_unix(cache->idx.epoch, ed_now_unix());
+	const uint64_t h = ed_hash(a.key, a.keylen, cache->idx.seed);
+	const uint64_t flags = cache->idx.flags;
 	const uint16_t block_size = cache->slab_block_size;
-	const EdBlkno block_count = cache->slab_block_count;
+	const uint64_t tag = ed_entry_key_tag(a.key, a.keylen, cache->idx.seed);
+	const size_t npack = obj_pack_size(a.keylen, a.metalen, a.datalen, flags);
+	const bool pack = npack <= cache->idx.hdr->pack_size;
+	const size_t nbytes = pack ? npack :
+		obj_slab_size(a.keylen, a.metalen, a.datalen, block_size, flags);
+	const EdBlkno nblcks = pack ? 1 : nbytes/block_size;
+
+	EdObjectHdr *hdr = MAP_FAILED;
+	EdBlkno vno = ed_txn_vno(txn, ring_for_size(cache, nblcks));
+	int rc;
+
+	if (pack) {
+		rc = obj_reserve_pack(batch, flags, &vno, nbytes, h, tag);
+	}
+	else {
+		rc = obj_reserve(batch, flags, &vno, nbytes, h, tag);
+	}
+	if (rc < 0) { return rc; }
+
+	// An object appended to a block locked by the batch has no region of its
+	// own to unlock.
+	const size_t off = ed_vno_offset(vno);
+	const EdBatchSlab slab = {
+		slab_no(cache, vno), rc == 2 ? 0 : nblcks, exp,
+		(uint16_t)off, rc == 1 ? (uint16_t)nbytes : 0
+	};
+
+	// Map the new object in the slab.
+	hdr = slab_map_obj(cache, vno, nblcks, true);
+	if (hdr == MAP_FAILED) {
+		rc = ED_ERRNO;
+		goto error;
+	}
+
+	// Add the next write position to the transaction. Packed objects move it
+	// when reserving a new block.
+	if (!pack) {
+		ed_txn_set_vno(txn, vno + nblcks);
+	}
+
+	// Write the full object.
+	slab_advise(cache, hdr, nbytes, false);
+	obj_hdr_init(hdr, &a, h, now, flags);
+	uint8_t *p = obj_data(hdr, flags);
+	for (int i = 0; i < iovcnt; i++) {
+		p += obj_write(p, iov[i].iov_base, iov[i].iov_len, &hdr->datacrc, flags);
+	}
+	obj_hdr_final(hdr, nbytes, flags);
+	if (pack) {
+		hdr->flags = ED_HDR_FPACK;
+		// Mark the end of the packed objects in the block as unfinished.
+		if (off + nbytes + sizeof(hdr->xid) <= block_size) {
+			((EdObjectHdr *)((uint8_t *)hdr + nbytes))->xid = 0;
+		}
+	}
+
+	rc = obj_upsert(batch, a.key, a.keylen, h, vno, nblcks, exp);
+	if (rc < 0) { goto error; }
+
+	hdr->exp = exp;
+	hdr->xid = txn->xid;
+	slab_unmap_obj(cache, vno, hdr, nblcks);
+
+	if (slab.count > 0) {
+		assert(batch->nslab < batch->nslabslot);
+		batch->slab[batch->nslab++] = slab;
+	}
+	return 0;
+
+error:
+	if (hdr != MAP_FAILED) {
+		slab_unmap_obj(cache, vno, hdr, nblcks);
+	}
+	if (slab.count > 0) {
+		batch_slab_unlock(cache, &slab);
+	}
+	return rc;
+}
+
+/**
+ * @brief  Changes the expiry of the object for a key
+ *
+ * This requires space for one slab change in the batch.
+ *
+ * @param  batch  Batch object
+ * @param  k  Key of the object
+ * @param  klen  Length of the key
+ * @param  exp  New expiry of the object
+ * @param  now  Current time used to skip expired objects
+ * @param  restore  Also change the expiry of expired objects
+ * @return  1 if changed, 0 if not found, <0 on error
+ */
+static int
+obj_update_expiry(EdBatch *batch, const void *k, size_t klen, EdTime exp, EdTimeUnix now, bool restore)
+{
+	EdCache *cache = batch->cache;
+	EdTxn *const txn = batch->txn;
 	const uint64_t h = ed_hash(k, klen, cache->idx.seed);
-	EdTxn *const txn = cache->txn;
+	const uint64_t tag = ed_entry_key_tag(k, klen, cache->idx.seed);
 
 	int rc = 0, set = 0;
 	EdEntryKey *key;
 
-	rc = ed_txn_open(txn, cache->idx.flags);
-	if (rc < 0) { return rc; }
-
 	for (rc = ed_bpt_find(txn, ED_DB_KEYS, h, (void **)&key);
 			rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
 			rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
-		// First check if the object is expired.
-		if (!restore && ed_expired_at(cache->idx.epoch, key->exp, now)) {
+		// First check if the object is expired or a different key.
+		if (key->tag != tag || (!restore && ed_expired_at(cache->idx.epoch, key->exp, now))) {
 			continue;
 		}
 
 		// Map the slab object.
-		EdObjectHdr *hdr = ed_blk_map(cache->idx.slabfd, key->vno % block_count, 1, block_size, true);
+		const EdBlkno vno = key->vno;
+		const EdBlkno nmin = key_need(cache, vno, key->count);
+		EdObjectHdr *hdr = key_map(cache, vno, nmin);
 		if (hdr == MAP_FAILED) {
 			rc = ED_ERRNO;
 			break;
 		}
 
 		// Resolve any hash collisions with a full key comparison. This will *very*
-		// likely match. If it does, set up the object and end the loop.
+		// likely match. If it does, set up the object and end the loop. The
+		// expiry of an object in the tier slab is only kept in the index.
 		if (hdr->keylen == klen && memcmp(obj_key(hdr), k, klen) == 0) {
 			EdEntryKey keynew = *key;
 			keynew.exp = exp;
-			rc = ed_bpt_set(txn, ED_DB_KEYS, (void *)&keynew, true);
+			rc = expiry_remove(txn, key);
+			if (rc >= 0) {
+				rc = ed_bpt_set(txn, ED_DB_KEYS, (void *)&keynew, true);
+			}
 			if (rc >= 0) {
-				hdr->exp = exp;
+				rc = expiry_add(txn, &keynew);
+			}
+			if (rc >= 0) {
+				if (!ed_vno_istier(vno)) {
+					batch_hdr(batch, hdr, vno, exp);
+				}
 				set = 1;
 			}
 		}
 
-		ed_blk_unmap(hdr, key->count, block_size);
+		key_unmap(cache, vno, hdr, nmin);
 
 		if (set == 1) {
 			break;
 		}
 	}
 
-	if (set == 1) {
-		ed_txn_commit(&cache->txn, cache->idx.flags|ED_FRESET);
-	}
-	else {
-		ed_txn_close(&cache->txn, cache->idx.flags|ED_FRESET);
+	return rc < 0 ? rc : set;
+}
+
+/**
+ * @brief  Removes the object for a key from the index
+ *
+ * Expired objects are removed as well. This requires space for one slab
+ * change in the batch.
+ *
+ * @param  batch  Batch object
+ * @param  k  Key of the object
+ * @param  klen  Length of the key
+ * @return  1 if removed, 0 if not found, <0 on error
+ */
+static int
+obj_unlink(EdBatch *batch, const void *k, size_t klen)
+{
+	EdCache *cache = batch->cache;
+	EdTxn *const txn = batch->txn;
+	const uint64_t h = ed_hash(k, klen, cache->idx.seed);
+	const uint64_t tag = ed_entry_key_tag(k, klen, cache->idx.seed);
+	EdEntryKey *key;
+	int rc, set = 0;
+
+	for (rc = ed_bpt_find(txn, ED_DB_KEYS, h, (void **)&key);
+			rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
+			rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
+		if (key->tag != tag) { continue; }
+		const EdEntryKey keyold = *key;
+		const bool tier = ed_vno_istier(keyold.vno);
+		const EdBlkno nmin = key_need(cache, keyold.vno, keyold.count);
+
+		// Map the slab object.
+		EdObjectHdr *hdr = key_map(cache, keyold.vno, nmin);
+		if (hdr == MAP_FAILED) {
+			rc = ED_ERRNO;
+			break;
+		}
+
+		// Resolve any hash collisions with a full key comparison.
+		if (hdr->keylen == klen && memcmp(obj_key(hdr), k, klen) == 0) {
+			// Remove the key entry followed by the block entry for the slab
+			// position. The block entry is always expected to exist, but the
+			// key removal is still valid without it.
+			rc = expiry_remove(txn, key);
+			if (rc >= 0) {
+				rc = ed_bpt_del(txn, ED_DB_KEYS);
+			}
+			if (rc >= 0) {
+				rc = batch_remove(batch, h);
+			}
+			if (rc >= 0 && tier) {
+				rc = tier_remove(batch, &keyold);
+			}
+			else if (rc >= 0) {
+				rc = block_remove(batch, keyold.vno, h);
+			}
+			// Tombstone the slab header so that listing and scanning the slab will
+			// no longer consider the object.
+			if (rc >= 0) {
+				if (!tier) {
+					batch_hdr(batch, hdr, keyold.vno, ED_TIME_DELETE);
+				}
+				set = 1;
+			}
+			key_unmap(cache, keyold.vno, hdr, nmin);
+			break;
+		}
+
+		key_unmap(cache, keyold.vno, hdr, nmin);
 	}
 
 	return rc < 0 ? rc : set;
 }
 
+int
+ed_set(EdCache *cache, const EdObjectAttr *attr, const void *data, size_t len, EdTimeTTL ttl)
+{
+	struct iovec iov = { .iov_base = (void *)data, .iov_len = len };
+	return ed_setv(cache, attr, &iov, 1, ttl);
+}
+
+int
+ed_setv(EdCache *cache, const EdObjectAttr *attr, const struct iovec *iov, int iovcnt, EdTimeTTL ttl)
+{
+	const uint64_t flags = cache->idx.flags;
+	const EdTime exp = ed_expiry_at(cache->idx.epoch, ttl, ed_now_unix());
+	EdBatchSlab slab[2];
+	EdBatch batch = { cache, NULL, slab, 0, ed_len(slab), 0, NULL, 0, 0, NULL, 0, 0 };
+
+	int rc = cache_txn_get(cache, &batch.txn);
+	if (rc < 0) { return rc; }
+
+	// Unlike ed_create(), the reservation, the object write, and the key upsert
+	// all happen within this one transaction.
+	rc = ed_txn_open(batch.txn, flags);
+	if (rc >= 0) {
+		rc = obj_set(&batch, attr, iov, iovcnt, exp);
+		int erc = batch_end(&batch, &batch.txn, rc >= 0, flags|ED_FRESET);
+		if (rc >= 0) { rc = erc; }
+	}
+	cache_txn_put(cache, batch.txn);
+	return rc;
+}
+
+static int
+update_expiry(EdCache *cache, const void *k, size_t klen, EdTime exp, EdTimeUnix now, bool restore)
+{
+	const uint64_t flags = cache->idx.flags;
+	EdBatchSlab slab[1];
+	EdBatch batch = { cache, NULL, slab, 0, ed_len(slab), 0, NULL, 0, 0, NULL, 0, 0 };
+
+	int rc = cache_txn_get(cache, &batch.txn);
+	if (rc < 0) { return rc; }
+
+	rc = ed_txn_open(batch.txn, flags);
+	if (rc >= 0) {
+		rc = obj_update_expiry(&batch, k, klen, exp, now, restore);
+		int erc = batch_end(&batch, &batch.txn, rc == 1, flags|ED_FRESET);
+		if (erc < 0 && rc >= 0) { rc = erc; }
+	}
+	cache_txn_put(cache, batch.txn);
+	return rc;
+}
+
 int
 ed_update_ttl(EdCache *cache, const void *k, size_t klen, EdTimeTTL ttl, bool restore)
 {
@@ -665,6 +3561,141 @@ ed_update_expiry(EdCache *cache, const void *k, size_t klen, EdTimeUnix expiry,
 	return update_expiry(cache, k, klen, exp, now, restore);
 }
 
+int
+ed_unlink(EdCache *cache, const void *k, size_t klen)
+{
+	const uint64_t flags = cache->idx.flags;
+	EdBatchSlab slab[1];
+	EdBatch batch = { cache, NULL, slab, 0, ed_len(slab), 0, NULL, 0, 0, NULL, 0, 0 };
+
+	int rc = cache_txn_get(cache, &batch.txn);
+	if (rc < 0) { return rc; }
+
+	rc = ed_txn_open(batch.txn, flags);
+	if (rc >= 0) {
+		rc = obj_unlink(&batch, k, klen);
+		int erc = batch_end(&batch, &batch.txn, rc == 1, flags|ED_FRESET);
+		if (erc < 0 && rc >= 0) { rc = erc; }
+	}
+	cache_txn_put(cache, batch.txn);
+	return rc;
+}
+
+int
+ed_batch_open(EdCache *cache, EdBatch **batchp)
+{
+	EdBatch *batch = calloc(1, sizeof(*batch));
+	if (batch == NULL) { return ED_ERRNO; }
+
+	int rc = ed_txn_new(&batch->txn, &cache->idx);
+	if (rc < 0) { goto error; }
+
+	rc = ed_txn_open(batch->txn, cache->idx.flags);
+	if (rc < 0) { goto error; }
+
+	batch->cache = cache;
+	*batchp = batch;
+	return 0;
+
+error:
+	ed_txn_close(&batch->txn, cache->idx.flags);
+	free(batch);
+	return rc;
+}
+
+int
+ed_batch_set(EdBatch *batch, const EdObjectAttr *attr, const void *data, size_t len, EdTimeTTL ttl)
+{
+	struct iovec iov = { .iov_base = (void *)data, .iov_len = len };
+	return ed_batch_setv(batch, attr, &iov, 1, ttl);
+}
+
+int
+ed_batch_setv(EdBatch *batch, const EdObjectAttr *attr, const struct iovec *iov, int iovcnt, EdTimeTTL ttl)
+{
+	if (batch->error < 0) { return batch->error; }
+
+	EdTime exp = ed_expiry_at(batch->cache->idx.epoch, ttl, ed_now_unix());
+	int rc = batch_reserve(batch, 2);
+	if (rc == 0) {
+		rc = obj_set(batch, attr, iov, iovcnt, exp);
+	}
+	// A rejected object leaves the batch unchanged.
+	if (rc < 0 && rc != ED_EOBJECT_REJECTED) { batch->error = rc; }
+	return rc;
+}
+
+int
+ed_batch_update_ttl(EdBatch *batch, const void *k, size_t klen, EdTimeTTL ttl, bool restore)
+{
+	if (batch->error < 0) { return batch->error; }
+
+	EdTimeUnix now = ed_now_unix();
+	EdTime exp = ed_expiry_at(batch->cache->idx.epoch, ttl, now);
+	int rc = batch_reserve(batch, 1);
+	if (rc == 0) {
+		rc = obj_update_expiry(batch, k, klen, exp, now, restore);
+	}
+	if (rc < 0) { batch->error = rc; }
+	return rc;
+}
+
+int
+ed_batch_update_expiry(EdBatch *batch, const void *k, size_t klen, EdTimeUnix expiry, bool restore)
+{
+	if (batch->error < 0) { return batch->error; }
+
+	EdTimeUnix now = ed_now_unix();
+	EdTime exp = ed_time_from_unix(batch->cache->idx.epoch, expiry);
+	int rc = batch_reserve(batch, 1);
+	if (rc == 0) {
+		rc = obj_update_expiry(batch, k, klen, exp, now, restore);
+	}
+	if (rc < 0) { batch->error = rc; }
+	return rc;
+}
+
+int
+ed_batch_unlink(EdBatch *batch, const void *k, size_t klen)
+{
+	if (batch->error < 0) { return batch->error; }
+
+	int rc = batch_reserve(batch, 1);
+	if (rc == 0) {
+		rc = obj_unlink(batch, k, klen);
+	}
+	if (rc < 0) { batch->error = rc; }
+	return rc;
+}
+
+int
+ed_batch_commit(EdBatch **batchp)
+{
+	EdBatch *batch = *batchp;
+	if (batch == NULL) { return 0; }
+	*batchp = NULL;
+
+	// A failed change may have left the transaction partially applied, so the
+	// entire batch is abandoned.
+	int rc = batch->error;
+	int erc = batch_end(batch, &batch->txn, rc >= 0, batch->cache->idx.flags);
+	free(batch->slab);
+	free(batch);
+	return rc < 0 ? rc : erc;
+}
+
+void
+ed_batch_discard(EdBatch **batchp)
+{
+	EdBatch *batch = *batchp;
+	if (batch == NULL) { return; }
+	*batchp = NULL;
+
+	batch_end(batch, &batch->txn, false, batch->cache->idx.flags);
+	free(batch->slab);
+	free(batch);
+}
+
 int64_t
 ed_write(EdObject *obj, const void *buf, size_t len)
 {
@@ -684,6 +3715,104 @@ ed_write(EdObject *obj, const void *buf, size_t len)
 	return (int64_t)len;
 }
 
+ssize_t
+ed_sendfile(EdObject *obj, int s, size_t len)
+{
+	if (obj->data == NULL) { return ed_esys(EINVAL); }
+
+	// Bytes already moved into the splice pipe must be delivered first.
+	if (obj->pipelen > 0) { return ed_splice(obj, s, len); }
+
+	len = obj_data_remain(obj, len);
+	if (len == 0) { return 0; }
+
+	const int slabfd = obj->cache->idx.slabfd;
+	off_t off = obj_data_byte(obj);
+
+#if defined(__linux__)
+	ssize_t n = sendfile(s, slabfd, &off, len);
+	if (n < 0) { return ED_ERRNO; }
+#elif defined(__APPLE__)
+	off_t n = (off_t)len;
+	if (sendfile(slabfd, s, off, &n, NULL, 0) < 0 && n == 0) { return ED_ERRNO; }
+#elif defined(__FreeBSD__)
+	off_t n = 0;
+	if (sendfile(slabfd, s, off, len, NULL, &n, 0) < 0 && n == 0) { return ED_ERRNO; }
+#endif
+
+	obj->dataread += (uint32_t)n;
+	return (ssize_t)n;
+}
+
+ssize_t
+ed_splice(EdObject *obj, int s, size_t len)
+{
+	if (obj->data == NULL) { return ed_esys(EINVAL); }
+
+	len = obj_data_remain(obj, len);
+	if (len == 0) { return 0; }
+
+	mode_t mode = 0;
+	if (obj->pipelen == 0) {
+		struct stat sbuf;
+		if (fstat(s, &sbuf) < 0) { return ED_ERRNO; }
+		mode = sbuf.st_mode;
+
+		// Sockets are best handled by sendfile, and character devices (e.g. a
+		// terminal) generally cannot be spliced into, so write from the mapping.
+		if (S_ISSOCK(mode)) {
+			return ed_sendfile(obj, s, len);
+		}
+		if (S_ISCHR(mode)) {
+			ssize_t n = write(s, obj->data + obj->dataread, len);
+			if (n < 0) { return ED_ERRNO; }
+			obj->dataread += (uint32_t)n;
+			return n;
+		}
+	}
+
+#if defined(__linux__)
+	const int slabfd = obj->cache->idx.slabfd;
+	off_t off = obj_data_byte(obj);
+	ssize_t n;
+
+	// A pipe target can be spliced into directly from the slab.
+	if (S_ISFIFO(mode)) {
+		n = splice(slabfd, &off, s, NULL, len, SPLICE_F_MOVE);
+		if (n < 0) { return ED_ERRNO; }
+		obj->dataread += (uint32_t)n;
+		return n;
+	}
+
+	// All other targets are moved through an intermediate pipe. The pipe is
+	// kept with the object so that any bytes that could not be delivered to a
+	// non-blocking target remain buffered for the next call.
+	if (obj->pipe[0] < 0 && pipe2(obj->pipe, O_CLOEXEC) < 0) {
+		return ED_ERRNO;
+	}
+
+	if (obj->pipelen < len) {
+		off += obj->pipelen;
+		n = splice(slabfd, &off, obj->pipe[1], NULL, len - obj->pipelen,
+				SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+		if (n < 0 && errno != EAGAIN) { return ED_ERRNO; }
+		if (n > 0) { obj->pipelen += (uint32_t)n; }
+	}
+
+	n = splice(obj->pipe[0], NULL, s, NULL, len < obj->pipelen ? len : obj->pipelen,
+			SPLICE_F_MOVE);
+	if (n < 0) { return ED_ERRNO; }
+	obj->pipelen -= (uint32_t)n;
+	obj->dataread += (uint32_t)n;
+	return n;
+#else
+	ssize_t n = write(s, obj->data + obj->dataread, len);
+	if (n < 0) { return ED_ERRNO; }
+	obj->dataread += (uint32_t)n;
+	return n;
+#endif
+}
+
 const void *
 ed_value(EdObject *obj, size_t *len)
 {
@@ -710,6 +3839,13 @@ ed_meta_crc(const EdObject *obj)
 	return obj->metacrc;
 }
 
+int
+ed_validate(const EdObject *obj)
+{
+	if (obj->locked || obj_current(obj)) { return 0; }
+	return ED_EOBJECT_CHANGED;
+}
+
 int
 ed_close(EdObject **objp)
 {
@@ -719,30 +3855,46 @@ ed_close(EdObject **objp)
 
 	EdCache *cache = obj->cache;
 	uint64_t flags = cache->idx.flags;
-	int slabfd = cache->idx.slabfd;
 	int rc = 0;
 	uint64_t h = obj->hdr->keyhash;
-	bool locked = true;
+	bool locked = obj->locked;
+	EdTxn *txn = NULL;
+	EdBatchSlab slab[1];
+	EdBatch batch = { cache, NULL, slab, 0, ed_len(slab), 0, NULL, 0, 0, NULL, 0, 0 };
 
 	if (!obj->rdonly) {
 		if (obj->datalen == obj->dataseek) {
-			rc = ed_txn_open(cache->txn, flags);
+			rc = cache_txn_get(cache, &txn);
+			if (rc < 0) { goto done; }
+			batch.txn = txn;
+
+			rc = ed_txn_open(txn, flags);
 			if (rc < 0) { goto done; }
 
-			rc = obj_upsert(cache, obj->newkey, obj->keylen, h,
+			rc = obj_upsert(&batch, obj->newkey, obj->keylen, h,
 					obj->vno, obj->nblcks, obj->exp);
 			if (rc < 0) { goto done; }
 
+			const EdTxnId xid = txn->xid;
 			obj->hdr->exp = obj->exp;
-			obj->hdr->xid = cache->txn->xid;
-			ed_flck(slabfd, ED_LCK_UN, obj->byte, obj->nbytes, flags);
-			locked = false;
-
-			rc = ed_txn_commit(&cache->txn, flags|ED_FRESET);
+			obj->hdr->xid = xid;
+			rc = batch_apply(&batch);
+			if (rc < 0) { goto done; }
 
-			if (rc >= 0 && !(flags & ED_FNOSYNC)) {
-				fsync(slabfd);
+			// Sync the object before the index is able to reference it.
+			if (!(flags & ED_FNOSYNC)) {
+				rc = ed_blk_sync(obj->hdr, obj->nblcks, cache->slab_block_size, flags);
+				if (rc < 0) {
+					batch_revert(&batch, batch.nslab, xid);
+					goto done;
+				}
 			}
+
+			slab_unlock(cache, obj->byte, obj->nbytes, flags);
+			locked = false;
+
+			rc = batch_commit(&batch, &txn, flags|ED_FRESET);
+			if (rc < 0) { batch_revert(&batch, batch.nslab, xid); }
 		}
 		else {
 			rc = ED_EOBJECT_TOOSMALL;
@@ -750,14 +3902,19 @@ ed_close(EdObject **objp)
 	}
 
 done:
-	ed_blk_unmap(obj->hdr, obj->nblcks, cache->slab_block_size);
+	obj_pipe_close(obj);
+	slab_unmap_obj(cache, obj->vno, obj->hdr, obj->nblcks);
 
 	if (locked) {
-		ed_flck(slabfd, ED_LCK_UN, obj->byte, obj->nbytes, flags);
+		obj_unlock(obj, flags);
 	}
-	if (rc < 0 && ed_txn_isopen(cache->txn)) {
-		ed_txn_close(&cache->txn, flags|ED_FRESET);
+	if (txn != NULL) {
+		if (rc < 0 && ed_txn_isopen(txn)) {
+			ed_txn_close(&txn, flags|ED_FRESET);
+		}
+		cache_txn_put(cache, txn);
 	}
+	batch_free_keys(&batch);
 	free(obj);
 	return rc;
 }
@@ -770,8 +3927,9 @@ ed_discard(EdObject **objp)
 	*objp = NULL;
 
 	EdCache *cache = obj->cache;
-	ed_blk_unmap(obj->hdr, obj->nblcks, cache->slab_block_size);
-	ed_flck(cache->idx.slabfd, ED_LCK_UN, obj->byte, obj->nbytes, cache->idx.flags);
+	obj_pipe_close(obj);
+	slab_unmap_obj(cache, obj->vno, obj->hdr, obj->nblcks);
+	obj_unlock(obj, cache->idx.flags);
 	free(obj);
 }
 
@@ -820,18 +3978,43 @@ ed_id(const EdObject *obj)
 	return obj->id;
 }
 
+/**
+ * @brief  Moves to the next block entry of the first ring
+ *
+ * Only the first ring is listed. The block entries of the other rings follow
+ * those of the first ring, so they are passed over by continuing through the
+ * b+tree, up to a full loop.
+ *
+ * @param  cache  Cache object
+ * @param  txn  Read transaction
+ * @param  blockp  Indirect pointer to assign the block entry to
+ * @return  Result of #ed_bpt_next()
+ */
+static int
+list_next_block(const EdCache *cache, EdTxn *txn, EdEntryBlock **blockp)
+{
+	const EdBlkno block_count = ring_count(cache, 0);
+	int rc;
+	do {
+		rc = ed_bpt_next(txn, ED_DB_BLOCKS, (void **)blockp);
+	} while (rc >= 0 && cache->idx.ring != NULL && (*blockp)->no >= block_count &&
+			ed_bpt_loop(txn, ED_DB_BLOCKS) <= 1);
+	return rc;
+}
+
 int
 ed_list_open(EdCache *cache, EdList **listp, const char *id)
 {
 	EdTxnId xmin = 0, xmax;
 	EdBlkno vmin = 0, vmax;
-	const EdBlkno block_count = cache->slab_block_count;
+	const EdBlkno block_count = ring_count(cache, 0);
 	int rc = 0;
 
 	// If an id is not provided, start from the oldest entry.
 	if (id != NULL) {
 		rc = obj_id(id, &xmin, &vmin);
 		if (rc != 0) { return rc; }
+		if (ed_vno_block(vmin) > ED_VNO_POS_MASK) { return ED_EOBJECT_ID; }
 	}
 
 	EdList *list = calloc(1, sizeof(*list));
@@ -844,7 +4027,7 @@ ed_list_open(EdCache *cache, EdList **listp, const char *id)
 	if (rc < 0) { goto error; }
 
 	xmax = cache->idx.conn->xid;
-	vmax = ed_txn_vno(list->txn);
+	vmax = ed_txn_vno(list->txn, 0);
 	if (id == NULL) {
 		xmin = 0;
 		vmin = vmax > block_count ? vmax - block_count : 0;
@@ -852,18 +4035,32 @@ ed_list_open(EdCache *cache, EdList **listp, const char *id)
 	}
 
 	// Move to the next entry block position if needed.
-	rc = ed_bpt_find(list->txn, ED_DB_BLOCKS, vmin % block_count, NULL);
+	EdEntryBlock *block;
+	const EdBlkno no = ed_vno_pos(vmin) % block_count;
+	rc = ed_bpt_find(list->txn, ED_DB_BLOCKS, no, (void **)&block);
 	if (rc < 0) { goto error; }
-	if (rc == 0) {
-		EdEntryBlock *block;
-		rc = ed_bpt_next(list->txn, ED_DB_BLOCKS, (void **)&block);
+	if (rc == 1) {
+		// Packed objects each have an entry for the block, so move to the
+		// entry of the slot, or start from the first entry if it is gone.
+		const uint32_t slot = ed_vno_slot(vmin);
+		while (rc == 1 && block->slot != slot && ed_bpt_loop(list->txn, ED_DB_BLOCKS) == 0) {
+			rc = ed_bpt_next(list->txn, ED_DB_BLOCKS, (void **)&block);
+		}
+		if (rc == 1 && block->slot != slot) { rc = 0; }
+		if (rc == 0) { rc = ed_bpt_find(list->txn, ED_DB_BLOCKS, no, (void **)&block); }
 		if (rc < 0) { goto error; }
-		if (rc == 0) {
+		vmin = ed_vno_block(vmin) | ((EdBlkno)block->slot << ED_VNO_SLOT_SHIFT);
+	}
+	else {
+		rc = list_next_block(cache, list->txn, &block);
+		if (rc < 0) { goto error; }
+		if (rc == 0 || block->no >= block_count) {
 			xmin = xmax;
 			vmin = vmax;
 		}
 		else {
-			vmin = block->no + vmin/block_count * block_count;
+			vmin = (block->no + ed_vno_pos(vmin)/block_count * block_count) |
+				((EdBlkno)block->slot << ED_VNO_SLOT_SHIFT);
 			xmin = block->xid;
 			list->inc = true;
 		}
@@ -884,11 +4081,25 @@ error:
 	return rc;
 }
 
+/**
+ * @brief  Gets the number of blocks mapped to read a listed object
+ * @param  cache  Cache object
+ * @param  vno  Virtual block number of the object
+ * @return  Number of blocks to map
+ */
+static EdBlkno
+list_need(const EdCache *cache, EdBlkno vno)
+{
+	return ED_COUNT_SIZE(ed_vno_offset(vno) + sizeof(EdObjectHdr) + ED_MAX_KEY,
+			cache->slab_block_size);
+}
+
 static void
-list_clear(EdList *list, const uint16_t block_size, const EdBlkno block_need)
+list_clear(EdList *list)
 {
 	if (list->obj.hdr != NULL) {
-		ed_blk_unmap(list->obj.hdr, block_need, block_size);
+		slab_unmap_obj(list->cache, list->obj.vno, list->obj.hdr,
+				list_need(list->cache, list->obj.vno));
 		memset(&list->obj, 0, sizeof(list->obj));
 	}
 }
@@ -900,23 +4111,21 @@ ed_list_next(EdList *list, const EdObject **objp)
 
 	int rc = 0;
 	const EdCache *const cache = list->cache;
-	const uint16_t block_size = cache->slab_block_size;
-	const EdBlkno block_count = cache->slab_block_count;
-	const EdBlkno block_need = ED_COUNT_SIZE(sizeof(EdObjectHdr) + ED_MAX_KEY, block_size);
+	const EdBlkno block_count = ring_count(cache, 0);
 	EdObjectHdr *hdr = MAP_FAILED;
 
 	for (;;) {
-		list_clear(list, block_size, block_need);
+		list_clear(list);
 
 		const EdBlkno vcur = list->vcur;
 
-		if (vcur >= list->vmax) {
+		if (ed_vno_block(vcur) >= list->vmax) {
 			goto done;
 		}
 
-		const EdBlkno no = vcur % block_count;
+		const EdBlkno no = ed_vno_pos(vcur) % block_count;
 
-		hdr = ed_blk_map(cache->idx.slabfd, no, block_need, block_size, true);
+		hdr = slab_map_obj(cache, vcur, list_need(cache, vcur), true);
 		if (hdr == MAP_FAILED) {
 			rc = ED_ERRNO;
 			goto done;
@@ -925,18 +4134,20 @@ ed_list_next(EdList *list, const EdObject **objp)
 		obj_init_basic(&list->obj, list->cache, hdr, vcur, true, hdr->exp);
 
 		EdEntryBlock *block;
-		rc = ed_bpt_next(list->txn, ED_DB_BLOCKS, (void **)&block);
+		rc = list_next_block(cache, list->txn, &block);
 		if (rc < 0) { goto done; }
-		if (ed_bpt_loop(list->txn, ED_DB_BLOCKS) > 1) {
+		if (ed_bpt_loop(list->txn, ED_DB_BLOCKS) > 1 || block->no >= block_count) {
 			rc = 0;
 			goto done;
 		}
+		EdBlkno vblk = ed_vno_block(vcur);
 		if (block->no < no) {
-			list->vcur += block->no + (block_count - no);
+			vblk += block->no + (block_count - no);
 		}
 		else {
-			list->vcur += block->no - no;
+			vblk += block->no - no;
 		}
+		list->vcur = vblk | ((EdBlkno)block->slot << ED_VNO_SLOT_SHIFT);
 
 		if (!list->inc) {
 			list->inc = true;
@@ -962,9 +4173,7 @@ ed_list_close(EdList **listp)
 	if (list == NULL) { return; }
 	*listp = NULL;
 
-	const uint16_t block_size = list->cache->slab_block_size;
-	const EdBlkno block_need = ED_COUNT_SIZE(sizeof(EdObjectHdr) + ED_MAX_KEY, block_size);
-	list_clear(list, block_size, block_need);
+	list_clear(list);
 
 	ed_txn_close(&list->txn, list->cache->idx.flags);
 	free(list);
@@ -8,19 +8,24 @@
 #include <math.h>
 #include <unistd.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <string.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <pthread.h>
+#include <signal.h>
 #include <assert.h>
 
 #if defined(__linux__)
 # include <linux/fs.h>
 # include <sys/sysmacros.h>
+# include <sys/sendfile.h>
 #elif defined(__APPLE__) || defined(__FreeBSD__)
 # include <sys/disk.h>
+# include <sys/socket.h>
+# include <sys/uio.h>
 #else
 # error Platform not supported
 #endif
@@ -29,6 +34,34 @@
 # define ED_ALLOC_COUNT 16
 #endif
 
+#ifndef ED_IDX_MAP_MAX
+# define ED_IDX_MAP_MAX 262144
+#endif
+
+#ifndef ED_PIN_PAGES
+# define ED_PIN_PAGES 16
+#endif
+
+#ifndef ED_FILTER_MAX_PAGES
+# define ED_FILTER_MAX_PAGES 8192
+#endif
+
+#ifndef ED_SKETCH_MAX_PAGES
+# define ED_SKETCH_MAX_PAGES 4096
+#endif
+
+#ifndef ED_CLOCK_PERCENT
+# define ED_CLOCK_PERCENT 10
+#endif
+
+#ifndef ED_RING_LIMIT
+# define ED_RING_LIMIT 65536
+#endif
+
+#ifndef ED_RING_PERCENT
+# define ED_RING_PERCENT 25
+#endif
+
 #ifndef ED_MAX_ALIGN
 # ifdef __BIGGEST_ALIGNMENT__
 #  define ED_MAX_ALIGN __BIGGEST_ALIGNMENT__
@@ -42,7 +75,9 @@
 
 #define ED_DB_KEYS 0
 #define ED_DB_BLOCKS 1
-#define ED_NDB 2
+#define ED_DB_EXPIRY 2
+#define ED_DB_TIER 3
+#define ED_NDB 4
 
 #define ED_STR2(v) #v
 #define ED_STR(v) ED_STR2(v)
@@ -58,6 +93,7 @@ typedef uint32_t EdPgno;
 typedef uint64_t EdBlkno;
 
 typedef struct EdPg EdPg;
+typedef struct EdPgActive EdPgActive;
 typedef struct EdPgGc EdPgGc;
 typedef struct EdPgGcList EdPgGcList;
 typedef struct EdPgGcState EdPgGcState;
@@ -76,8 +112,16 @@ typedef struct EdConn EdConn;
 
 typedef struct EdStat EdStat;
 
+typedef struct EdBatchSlab EdBatchSlab;
+typedef struct EdSlabLck EdSlabLck;
+typedef struct EdSlabPin EdSlabPin;
+typedef struct EdPgTier EdPgTier;
+typedef struct EdPgRing EdPgRing;
+typedef struct EdRing EdRing;
+
 typedef struct EdEntryBlock EdEntryBlock;
 typedef struct EdEntryKey EdEntryKey;
+typedef struct EdEntryExp EdEntryExp;
 typedef struct EdObjectHdr EdObjectHdr;
 
 typedef volatile EdPgno EdPgnoV;
@@ -257,6 +301,7 @@ ed_flck(int fd, EdLckType type, off_t start, off_t len, uint64_t flags);
 #define ED_PG_BRANCH    UINT32_C(0x48435242)
 #define ED_PG_LEAF      UINT32_C(0x4641454c)
 #define ED_PG_GC        UINT32_C(0x4c4c4347)
+#define ED_PG_ACTIVE    UINT32_C(0x56544341)
 
 #define ED_PG_NONE UINT32_MAX
 #define ED_PG_MAX (UINT32_MAX-1)
@@ -264,11 +309,13 @@ ed_flck(int fd, EdLckType type, off_t start, off_t len, uint64_t flags);
 
 ED_LOCAL   void * ed_blk_map(int fd, EdBlkno no, EdBlkno count, uint16_t size, bool need);
 ED_LOCAL      int ed_blk_unmap(void *p, EdBlkno count, uint16_t size);
+ED_LOCAL      int ed_blk_sync(void *p, EdBlkno count, uint16_t size, uint64_t flags);
 ED_LOCAL   void * ed_pg_map(int fd, EdPgno no, EdPgno count, bool need);
 ED_LOCAL      int ed_pg_unmap(void *p, EdPgno count);
 ED_LOCAL   void * ed_pg_load(int fd, EdPg **pgp, EdPgno no, bool need);
 ED_LOCAL     void ed_pg_unload(EdPg **pgp);
 ED_LOCAL      int ed_pg_mark_gc(EdIdx *idx, EdStat *stat);
+ED_LOCAL      int ed_pg_mark_active(EdIdx *idx, EdStat *stat);
 
 /**
  * @brief  Allocates a page from the underlying file
@@ -414,6 +461,7 @@ typedef int (*EdBptPrint)(const void *, char *buf, size_t len);
 ED_LOCAL   size_t ed_branch_order(void);
 ED_LOCAL   size_t ed_leaf_order(size_t esize);
 ED_LOCAL   size_t ed_bpt_capacity(size_t esize, size_t depth);
+ED_LOCAL uint32_t ed_bpt_search(const void *keys, uint32_t n, size_t stride, uint64_t key);
 ED_LOCAL      int ed_bpt_find(EdTxn *txn, unsigned db, uint64_t key, void **ent);
 ED_LOCAL      int ed_bpt_first(EdTxn *txn, unsigned db, void **ent);
 ED_LOCAL      int ed_bpt_last(EdTxn *txn, unsigned db, void **ent);
@@ -422,6 +470,7 @@ ED_LOCAL      int ed_bpt_prev(EdTxn *txn, unsigned db, void **ent);
 ED_LOCAL      int ed_bpt_loop(const EdTxn *txn, unsigned db);
 ED_LOCAL      int ed_bpt_set(EdTxn *txn, unsigned db, const void *ent, bool replace);
 ED_LOCAL      int ed_bpt_del(EdTxn *txn, unsigned db);
+ED_LOCAL      int ed_bpt_load(EdTxn *txn, unsigned db, const void *ents, size_t nents);
 ED_LOCAL      int ed_bpt_mark(EdIdx *, EdStat *, EdBpt *);
 ED_LOCAL     void ed_bpt_print(EdBpt *, int fd, size_t esize, FILE *, EdBptPrint);
 ED_LOCAL      int ed_bpt_verify(EdBpt *, int fd, size_t esize, FILE *);
@@ -434,12 +483,16 @@ ED_LOCAL      int ed_bpt_verify(EdBpt *, int fd, size_t esize, FILE *);
  * @brief  txn  Transaction Module
  *
  * This implements the transaction system for working with multiple database
- * b+trees. These aren't "real" transactions, in that only a single change
- * operation is supported per database. However, single changes made to
- * multiple databases are handled as a single change. This is all that's
- * needed for the index, so the simplicity is preferrable for the moment.
- * The design of the API is intended to accomodate full transactions if that
- * does become necessary.
+ * b+trees. Any number of changes may be made to each database, and all changes
+ * across all databases are committed as a single change. Pages copied within
+ * the transaction are reused by subsequent changes, so each modified page is
+ * only copied once regardless of the number of changes.
+ *
+ * Every page allocated by an open transaction is recorded in the index header
+ * so that an abandoned transaction may be reclaimed by the next writer. When
+ * the header's list fills, the remainder is tracked in a chain of
+ * #EdPgActive pages. There is no limit on the size of a transaction beyond
+ * the memory needed to track its pages.
  *
  * @{
  */
@@ -536,12 +589,17 @@ struct EdTxn {
 	unsigned     ngcslot;          /**< Number of page slots in the #gc array */
 	EdTxnNode *  nodes;            /**< Linked list of node arrays */
 	EdTxnId      xid;              /**< Transaction ID or 0 for read-only */
-	EdBlkno      vno;              /**< Current slab write block */
+	EdTxnId      rxid;             /**< Snapshot transaction ID held with the index */
+	EdBlkno      vno[ED_RING_MAX]; /**< Current slab write block of each ring */
+	EdBlkno      tvno;             /**< Current tier slab write block */
+	EdBlkno      pvno;             /**< Next slot of the open pack block or #ED_BLK_NONE */
+	unsigned     pcount;           /**< Number of objects in the open pack block */
 	uint64_t     cflags;           /**< Critical flags required during #ed_txn_commit() or #ed_txn_close() */
 	EdTxnState   state;            /**< Current transaction state */
 	int          error;            /**< Error code during transaction */
 	bool         isrdonly;         /**< Was #ed_txn_open() called with #ED_FRDONLY */
 	EdBpt *      roots[ED_NDB];    /**< Cached root pages */
+	EdTxn *      next;             /**< Next idle transaction in the cache pool */
 	EdTxnDb      db[ED_NDB];       /**< State information for each b+tree */
 };
 
@@ -628,15 +686,19 @@ ED_LOCAL void
 ed_txn_close(EdTxn **txnp, uint64_t flags);
 
 /**
- * @brief  Gets the current slab position
+ * @brief  Gets the current slab position of a ring
  * @param  txn  Transaction object
+ * @param  ring  Ring index, or 0 for a slab without rings
  * @return  slab block number
  */
 ED_LOCAL EdBlkno
-ed_txn_vno(const EdTxn *txn);
+ed_txn_vno(const EdTxn *txn, unsigned ring);
 
 /**
  * @brief  Sets the slab position to write on commit
+ *
+ * The ring is taken from the virtual block number.
+ *
  * @param  txn  Transaction object
  * @param  vno  New slab virtual write position
  * @return  0 on success <0 on error
@@ -644,6 +706,42 @@ ed_txn_vno(const EdTxn *txn);
 ED_LOCAL int
 ed_txn_set_vno(EdTxn *txn, EdBlkno vno);
 
+/**
+ * @brief  Gets the current tier slab position
+ * @param  txn  Transaction object
+ * @return  tier slab block number
+ */
+ED_LOCAL EdBlkno
+ed_txn_tvno(const EdTxn *txn);
+
+/**
+ * @brief  Sets the tier slab position to write on commit
+ * @param  txn  Transaction object
+ * @param  vno  New tier slab virtual write position
+ * @return  0 on success <0 on error
+ */
+ED_LOCAL int
+ed_txn_set_tvno(EdTxn *txn, EdBlkno vno);
+
+/**
+ * @brief  Gets the next slot of the open pack block
+ * @param  txn  Transaction object
+ * @param  count  Pointer to assign the number of objects in the block to
+ * @return  Packed virtual block number or #ED_BLK_NONE
+ */
+ED_LOCAL EdBlkno
+ed_txn_pvno(const EdTxn *txn, unsigned *count);
+
+/**
+ * @brief  Sets the next slot of the open pack block to write on commit
+ * @param  txn  Transaction object
+ * @param  vno  Packed virtual block number or #ED_BLK_NONE
+ * @param  count  Number of objects in the block
+ * @return  0 on success <0 on error
+ */
+ED_LOCAL int
+ed_txn_set_pvno(EdTxn *txn, EdBlkno vno, unsigned count);
+
 /**
  * @brief  Checks if a transaction is in read-only mode
  *
@@ -745,6 +843,7 @@ struct EdIdx {
 	char *       path;             /**< Path copied when opening */
 	int          fd;               /**< Open file discriptor for the file to allocate from */
 	int          slabfd;           /**< Open file descriptor for the slab */
+	int          tierfd;           /**< Open file descriptor for the tier slab with #ED_FTIER */
 	EdLck        lck;              /**< Write lock */
 	EdPgGc *     gc_head;          /**< Currently mapped head of the garbage collected pages */
 	EdPgGc *     gc_tail;          /**< Currently mapped tail of the garbage collected pages */
@@ -754,6 +853,18 @@ struct EdIdx {
 	int          pid;              /**< Process ID that opened the index */
 	uint64_t     seed;             /**< Randomized seed */
 	EdTimeUnix   epoch;            /**< Epoch adjustment in seconds */
+	uint8_t *    map;              /**< Reserved address range for the persistent index mapping */
+	EdPgno       mapcount;         /**< Number of file pages currently mapped into #map */
+	EdSlabPin *  pins;             /**< Mapped slab lock table with #ED_FSLABPIN */
+	uint8_t *    filter;           /**< Mapped key filter with #ED_FFILTER */
+	uint8_t *    clock;            /**< Mapped access bits with #ED_FCLOCK */
+	uint8_t *    sketch;           /**< Mapped frequency sketch with #ED_FADMIT */
+	EdPgTier *   tier;             /**< Mapped tier slab page with #ED_FTIER */
+	EdPgRing *   ring;             /**< Mapped ring page with #ED_FRING */
+	pthread_mutex_t mtx;           /**< Thread lock for #readers and #map growth */
+	EdTxnId *    readers;          /**< Sorted snapshot xids held by threads in this process */
+	unsigned     nreaders;         /**< Number of xids in #readers */
+	unsigned     nreaderslot;      /**< Number of slots in the #readers array */
 };
 
 #define ED_IDX_PAGES(nconns) ed_count_pg(offsetof(EdPgIdx, conns) + sizeof(EdConn)*nconns)
@@ -770,10 +881,23 @@ ED_LOCAL      int ed_idx_open(EdIdx *, const EdConfig *cfg);
 ED_LOCAL     void ed_idx_close(EdIdx *);
 ED_LOCAL  EdTxnId ed_idx_xmin(EdIdx *idx, EdTime now);
 ED_LOCAL      int ed_idx_lock(EdIdx *, EdLckType type);
-ED_LOCAL  EdTxnId ed_idx_acquire_xid(EdIdx *);
-ED_LOCAL     void ed_idx_release_xid(EdIdx *);
-ED_LOCAL      int ed_idx_acquire_snapshot(EdIdx *, EdBpt **trees);
-ED_LOCAL     void ed_idx_release_snapshot(EdIdx *, EdBpt **trees);
+ED_LOCAL      int ed_idx_acquire_xid(EdIdx *, EdTxnId *xid);
+ED_LOCAL     void ed_idx_release_xid(EdIdx *, EdTxnId xid);
+ED_LOCAL      int ed_idx_acquire_snapshot(EdIdx *, EdBpt **trees, EdTxnId *xid);
+ED_LOCAL     void ed_idx_release_snapshot(EdIdx *, EdBpt **trees, EdTxnId xid);
+ED_LOCAL   EdPg * ed_idx_map(EdIdx *, EdPgno no);
+ED_LOCAL     void ed_idx_unmap(EdIdx *, void *pg);
+ED_LOCAL      int ed_idx_sync(EdIdx *, EdTxnId xid, uint64_t flags);
+ED_LOCAL      int ed_idx_pin(EdIdx *, EdLckType type, off_t start, off_t len);
+ED_LOCAL     void ed_idx_unpin(EdIdx *, off_t start, off_t len);
+ED_LOCAL     void ed_idx_filter_add(EdIdx *, uint64_t h);
+ED_LOCAL     void ed_idx_filter_remove(EdIdx *, EdTxnId xid, const uint64_t *h, unsigned n);
+ED_LOCAL     void ed_idx_filter_clear(EdIdx *, EdTxnId xid);
+ED_LOCAL     bool ed_idx_filter_has(EdIdx *, uint64_t h, EdTxnId xid);
+ED_LOCAL     void ed_idx_clock_mark(EdIdx *, EdBlkno no);
+ED_LOCAL     bool ed_idx_clock_take(EdIdx *, EdBlkno no);
+ED_LOCAL     void ed_idx_sketch_add(EdIdx *, uint64_t h);
+ED_LOCAL unsigned ed_idx_sketch_get(EdIdx *, uint64_t h);
 ED_LOCAL      int ed_idx_repair_leaks(EdIdx *, EdStat *, uint64_t flags);
 
 /** @} */
@@ -1049,8 +1173,15 @@ ed_power2(unsigned p)
 
 struct EdCache {
 	EdIdx        idx;
-	EdTxn *      txn;
+	EdTxn *      txn;              /**< Pool of idle transactions */
 	int          ref;
+	pthread_mutex_t mtx;           /**< Thread lock for #txn */
+	pthread_mutex_t lckmtx;        /**< Thread lock for #lcks */
+	pthread_cond_t lckcond;        /**< Signaled when a pending region in #lcks completes */
+	EdSlabLck *  lcks;             /**< Slab regions locked by the process */
+	unsigned     nlcks;            /**< Number of regions in #lcks */
+	unsigned     nlckslot;         /**< Number of slots in the #lcks array */
+	uint8_t *    slab;             /**< Mapping of the entire slab with #ED_FMAPSLAB */
 	EdBlkno      slab_block_count; /**< Number of blocks in the slab */
 	uint16_t     slab_block_size;  /**< Size of the blocks in the slab */
 };
@@ -1066,6 +1197,9 @@ struct EdObject {
 	uint32_t     datalen;
 	uint32_t     dataseek;
 	uint32_t     datacrc;
+	uint32_t     dataread;
+	uint32_t     pipelen;
+	int          pipe[2];
 	EdObjectHdr *hdr;
 	EdTxnId      xid;
 	EdBlkno      vno;
@@ -1074,10 +1208,229 @@ struct EdObject {
 	size_t       nbytes;
 	EdTime       exp;
 	bool         rdonly;
+	bool         locked;
 	char         id[34];
 	uint8_t      newkey[1];
 };
 
+/**
+ * @brief  Slab region locked by the process
+ *
+ * File locks belong to the process, so they cannot exclude threads sharing a
+ * cache, and unlocking a region releases any overlapping region that another
+ * thread still holds. Regions are tracked so that the file lock is taken by
+ * the first holder and only the uncovered ranges are released by the last.
+ *
+ * The file lock is changed without holding the thread lock. The region stays
+ * in the table as pending meanwhile, and overlapping regions wait for it.
+ */
+struct EdSlabLck {
+	off_t        start;            /**< Byte offset of the region */
+	off_t        len;              /**< Byte length of the region */
+	int          count;            /**< Number of shared holders, or -1 when exclusive */
+	int          pending;          /**< 1 while taking the file lock, -1 while releasing it, or 0 */
+};
+
+/**
+ * @brief  Slab region locked through the shared table in the index
+ *
+ * With #ED_FSLABPIN, slab regions are locked by claiming a slot in a table of
+ * pages following the index header rather than with file locks. A slot is
+ * claimed by its process ID, and the mode is published last so that a slot
+ * being filled in is never mistaken for a conflict. Slots owned by processes
+ * that no longer exist are reclaimed when they are found. Slots are claimed
+ * from the start of the table, and #EdPgIdx.npins shrinks again as the last
+ * slots are released, so conflict scans only cover the slots in use.
+ */
+struct EdSlabPin {
+	volatile int pid;              /**< Owning process ID, or 0 when free */
+	volatile int mode;             /**< #ED_PIN_SH or #ED_PIN_EX, or 0 while being claimed */
+	int64_t      start;            /**< Byte offset of the region */
+	int64_t      len;              /**< Byte length of the region */
+};
+
+#define ED_PIN_SH 1
+#define ED_PIN_EX 2
+#define ED_PIN_MAX (ED_PIN_PAGES * PAGESIZE / sizeof(EdSlabPin))
+
+/**
+ * @brief  Page describing the tier slab
+ *
+ * With #ED_FTIER, live objects evicted from the slab are copied to the write
+ * position of a second, typically larger and slower, slab. The same key b+tree
+ * indexes both slabs. Key entries for the tier slab have #ED_VNO_TIER set in
+ * their virtual block number, and the tier slab has its own block b+tree.
+ * Opening a key found in the tier slab copies it back into the slab first.
+ *
+ * The tier slab is only read and written while holding the index write lock,
+ * so its regions are never locked.
+ */
+struct EdPgTier {
+	uint64_t     ino;              /**< Inode number of the tier slab */
+	EdBlkno      block_count;      /**< Number of blocks in the tier slab */
+	EdBlknoV     vno;              /**< Current tier slab write block */
+	char         path[1024];       /**< Path to the tier slab */
+};
+
+#define ED_VNO_TIER (UINT64_C(1) << 63)
+#define ed_vno_istier(vno) (((vno) & ED_VNO_TIER) != 0)
+
+/**
+ * @brief  Ring of the slab for objects up to a size
+ *
+ * With #ED_FRING, the slab is partitioned into rings, and each object is
+ * written to the first ring that allows its size. Each ring has its own write
+ * position, so large objects only evict objects of a similar size. Virtual
+ * block numbers carry the ring index above #ED_VNO_RING_SHIFT, and the
+ * position within the ring below it.
+ *
+ * The first ring keeps using the write position, reservation, and access bit
+ * counts in #EdPgIdx, so those fields of its entry are unused.
+ */
+struct EdRing {
+	EdBlkno      start;            /**< First slab block of the ring */
+	EdBlkno      count;            /**< Number of slab blocks in the ring */
+	EdBlkno      limit;            /**< Largest object in blocks written to the ring */
+	EdBlknoV     vno;              /**< Current write block of the ring */
+	EdBlknoV     vres;             /**< End of the ring blocks reserved for writing */
+	EdBlkno      clock_lap;        /**< Ring pass that #clock_used is counted for */
+	EdBlkno      clock_used;       /**< Number of blocks reinserted in the current pass */
+};
+
+/**
+ * @brief  Page describing the rings of the slab
+ */
+struct EdPgRing {
+	uint64_t     count;            /**< Number of rings */
+	EdRing       rings[ED_RING_MAX]; /**< Ring descriptions ordered by object size */
+};
+
+#define ED_VNO_RING_SHIFT 61
+#define ed_vno_ring(vno) ((unsigned)(((vno) & ~ED_VNO_TIER) >> ED_VNO_RING_SHIFT))
+#define ed_vno_make(ring, pos) (((EdBlkno)(ring) << ED_VNO_RING_SHIFT) | (pos))
+
+/**
+ * @defgroup  pack  Packed Objects
+ *
+ * With #ED_FPACK, objects written whole that are no larger than
+ * #EdPgIdx.pack_size are appended to a shared block rather than each using a
+ * block of their own. The open pack block is tracked by the index, and a new
+ * one is reserved once the block is full or the write position has passed it.
+ *
+ * A packed object is addressed by its block and the byte offset of its header
+ * within the block, in units of #ED_PACK_ALIGN. The offset and #ED_VNO_PACK
+ * are kept in the virtual block number above #ED_VNO_SLOT_SHIFT. Headers in a
+ * block follow each other, and each is marked with #ED_HDR_FPACK so that a
+ * rebuild can walk the block. Each object has its own block entry, so all of
+ * the objects in a block are evicted together once it is reached.
+ *
+ * @{
+ */
+#define ED_PACK_ALIGN (ED_MAX_ALIGN > 16 ? ED_MAX_ALIGN : 16)
+#define ED_PACK_MAX (ED_BPT_DATA / sizeof(EdEntryBlock) / 2)
+
+#define ED_VNO_PACK (UINT64_C(1) << 60)
+#define ED_VNO_SLOT_SHIFT 48
+#define ED_VNO_SLOT_MASK (UINT64_C(0x1fff) << ED_VNO_SLOT_SHIFT)
+#define ED_VNO_POS_MASK ((UINT64_C(1) << ED_VNO_SLOT_SHIFT) - 1)
+#define ed_vno_pos(vno) ((vno) & ED_VNO_POS_MASK)
+#define ed_vno_ispacked(vno) (((vno) & ED_VNO_PACK) != 0)
+#define ed_vno_slot(vno) ((uint32_t)(((vno) & ED_VNO_SLOT_MASK) >> ED_VNO_SLOT_SHIFT))
+#define ed_vno_offset(vno) ((size_t)(ed_vno_slot(vno) & 0xfff) * ED_PACK_ALIGN)
+#define ed_vno_block(vno) ((vno) & ~ED_VNO_SLOT_MASK)
+#define ed_vno_pack(vno, off) \
+	(ed_vno_block(vno) | ED_VNO_PACK | ((EdBlkno)((off) / ED_PACK_ALIGN) << ED_VNO_SLOT_SHIFT))
+/** @} */
+
+/**
+ * @defgroup  filter  Key Filter
+ *
+ * With #ED_FFILTER, the index holds a counting Bloom filter of key hashes in
+ * pages following the index header. Each key maps to a single cache line of
+ * 8-bit counters, so a probe reads one line rather than descending the key
+ * b+tree. Counters saturate and are never decremented after that point.
+ *
+ * Keys are added as soon as they are inserted, but removals are applied only
+ * as the removing transaction commits. The #EdPgIdx.filter_xid is advanced
+ * before any counter is decremented, so a reader with an older snapshot does
+ * not trust a negative result and falls back to the b+tree.
+ *
+ * @{
+ */
+#define ED_FILTER_LINE 64    /**< Size in bytes of a filter block */
+#define ED_FILTER_PROBES 4   /**< Number of counters set for each key */
+#define ED_FILTER_RATIO 8    /**< Number of counters allocated for each slab block */
+/** @} */
+
+/**
+ * @defgroup  clock  Access Bits
+ *
+ * With #ED_FCLOCK, the index holds one bit for each slab block in pages
+ * following the index header. Opening an object by key sets the bit for its
+ * first block. When the write position reaches an object with its bit set,
+ * the bit is cleared and the write position moves past the object rather than
+ * evicting it. The key entry is moved to the current pass through the slab, so
+ * the object is treated as if it had just been written. The number of blocks
+ * skipped this way in each pass is limited by #EdPgIdx.clock_budget.
+ *
+ * @{
+ */
+#define ED_CLOCK_MAX_PERCENT 50 /**< Upper limit for #EdConfig.clock_percent */
+/** @} */
+
+/**
+ * @defgroup  sketch  Frequency Sketch
+ *
+ * With #ED_FADMIT, the index holds a count-min sketch of how often each key
+ * hash is looked up, laid out in cache lines like the key filter. Every lookup
+ * by key adds to the sketch, whether or not the key is found. After
+ * #EdPgIdx.sketch_limit lookups, all counts are halved so that the sketch
+ * follows recent popularity.
+ *
+ * A new key is rejected when its estimate is lower than that of a live object
+ * it would evict. Replacing an existing key is always admitted.
+ *
+ * @{
+ */
+#define ED_SKETCH_LINE 64    /**< Size in bytes of a sketch block */
+#define ED_SKETCH_PROBES 4   /**< Number of counters for each key */
+#define ED_SKETCH_RATIO 2    /**< Number of counters allocated for each slab block */
+#define ED_SKETCH_SAMPLE 10  /**< Number of lookups for each slab block before halving */
+/** @} */
+
+/**
+ * @brief  Slab change made by a write transaction
+ *
+ * Written objects remain locked until the transaction completes. Changes to
+ * the headers of existing objects are deferred until just before the commit,
+ * and are reverted if the commit fails.
+ */
+struct EdBatchSlab {
+	EdBlkno      no;               /**< Slab block number of the object */
+	EdBlkno      count;            /**< Number of locked blocks, or 0 for a header change */
+	EdTime       exp;              /**< Expiry to write into the object header, or the replaced expiry once written */
+	uint16_t     off;              /**< Byte offset of a packed object in the block */
+	uint16_t     len;              /**< Number of locked bytes at #off, or 0 for whole blocks */
+};
+
+/**
+ * @brief  Collection of changes applied in a single transaction
+ */
+struct EdBatch {
+	EdCache *    cache;            /**< Reference to the cache handle */
+	EdTxn *      txn;              /**< Open write transaction */
+	EdBatchSlab *slab;             /**< Array of pending slab changes */
+	unsigned     nslab;            /**< Number of changes in #slab */
+	unsigned     nslabslot;        /**< Number of slots in the #slab array */
+	int          error;            /**< First error encountered by the batch */
+	uint64_t *   removed;          /**< Hashes of key entries removed by the batch */
+	unsigned     nremoved;         /**< Number of hashes in #removed */
+	unsigned     nremovedslot;     /**< Number of slots in the #removed array */
+	uint64_t *   added;            /**< Hashes of key entries added by the batch */
+	unsigned     nadded;           /**< Number of hashes in #added */
+	unsigned     naddedslot;       /**< Number of slots in the #added array */
+};
+
 struct EdList {
 	EdCache *    cache;            /**< Reference to the cache handle */
 	EdTxn *      txn;              /**< Open read transaction */
@@ -1145,6 +1498,21 @@ struct EdPgGcList {
 #define ED_GC_LIST_SIZE(npages) \
 	ed_align_type(offsetof(EdPgGcList, pages) + (npages)*ED_GC_LIST_PAGE_SIZE, EdPgGcList)
 
+/**
+ * @brief  Overflow list of pages allocated to the active transaction
+ *
+ * Once #EdPgIdx.active is full, further allocations are recorded in a linked
+ * list of these pages. The overflow pages are owned by the transaction as well,
+ * so abandoning the transaction reclaims both the list and its contents.
+ */
+struct EdPgActive {
+	EdPg         base;             /**< Page number and type */
+	EdPgno       next;             /**< Linked list of further active pages */
+	EdPgno       npages;           /**< Number of pages in #pages */
+#define ED_ACTIVE_DATA ((PAGESIZE - sizeof(EdPg) - 2*sizeof(EdPgno)) / sizeof(EdPgno))
+	EdPgno       pages[ED_ACTIVE_DATA]; /**< Allocated pages in the active transaction */
+};
+
 /**
  * @brief  Connection handle for each active process
  */
@@ -1178,20 +1546,51 @@ struct EdPgIdx {
 	EdPgnoV      gc_tail;          /**< Page pointer for the garbage collector tail */
 	union {
 		uint64_t vtree;            /**< Atomic CAS value for the first 2 trees */
-		EdPgno   tree[4];          /**< Page pointer for the key and slab b+trees */
+		EdPgno   tree[4];          /**< Page pointer for the key, slab, expiry, and tier b+trees */
 	};
 	EdTxnIdV     xid;              /**< Global transaction ID */
+	EdTxnIdV     xid_written;      /**< Latest transaction ID with all pages written */
+	EdTxnIdV     xid_synced;       /**< Latest transaction ID synced with #ED_FGROUPSYNC */
 	EdBlknoV     vno;              /**< Current slab write block */
+	EdBlknoV     vres;             /**< End of the slab blocks reserved for writing */
 	EdBlkno      slab_block_count; /**< Number of blocks in the slab */
 	uint64_t     slab_ino;         /**< Inode number of the slab */
 	char         slab_path[912];   /**< Path to the slab */
 	EdPgnoV      nactive;          /**< Number of pages in #active */
-	EdPgno       active[255];      /**< Allocated pages in the active transaction */
+	EdPgnoV      active_next;      /**< Page pointer for the #EdPgActive overflow list */
+	union {
+		uint64_t vpins;            /**< Atomic CAS value for #npins and #pin_gen */
+		struct {
+			EdPgnoV npins;         /**< Number of #EdSlabPin slots up to the last claimed slot */
+			EdPgnoV pin_gen;       /**< Number of times a slot has been claimed */
+		};
+	};
+	EdPgno       pin_start;        /**< First page of the #EdSlabPin table or #ED_PG_NONE */
+	uint32_t     _pad;
+	EdPgno       filter_start;     /**< First page of the key filter or #ED_PG_NONE */
+	EdPgno       filter_count;     /**< Number of pages in the key filter */
+	EdTxnIdV     filter_xid;       /**< Latest transaction ID that removed keys from the filter */
+	EdPgno       clock_start;      /**< First page of the access bits or #ED_PG_NONE */
+	EdPgno       clock_count;      /**< Number of pages in the access bits */
+	EdBlkno      clock_budget;     /**< Number of blocks that may be reinserted per pass */
+	EdBlkno      clock_lap;        /**< Slab pass that #clock_used is counted for */
+	EdBlkno      clock_used;       /**< Number of blocks reinserted in the current pass */
+	EdPgno       sketch_start;     /**< First page of the frequency sketch or #ED_PG_NONE */
+	EdPgno       sketch_count;     /**< Number of pages in the frequency sketch */
+	uint64_t     sketch_limit;     /**< Number of lookups before the sketch counts are halved */
+	volatile uint64_t sketch_ops;  /**< Number of lookups since the sketch counts were halved */
+	EdPgno       tier_start;       /**< Page number of the #EdPgTier or #ED_PG_NONE */
+	EdPgno       ring_start;       /**< Page number of the #EdPgRing or #ED_PG_NONE */
+	EdBlknoV     pack_vno;         /**< Next slot of the open pack block or #ED_BLK_NONE */
+	uint32_t     pack_count;       /**< Number of objects in the open pack block */
+	uint32_t     pack_size;        /**< Largest object in bytes packed with #ED_FPACK, or 0 */
+	EdPgno       active[220];      /**< Allocated pages in the active transaction */
 	EdConn       conns[1];         /**< Flexible array of active process connections */
 };
 
 #define ED_IDX_LCK_OPEN base
 #define ED_IDX_LCK_WRITE xid
+#define ED_IDX_LCK_SYNC xid_synced
 
 #define ED_IDX_LCK_OPEN_OFF offsetof(EdPgIdx, ED_IDX_LCK_OPEN)
 #define ED_IDX_LCK_OPEN_LEN sizeof(((EdPgIdx *)0)->ED_IDX_LCK_OPEN)
@@ -1199,6 +1598,9 @@ struct EdPgIdx {
 #define ED_IDX_LCK_WRITE_OFF offsetof(EdPgIdx, ED_IDX_LCK_WRITE)
 #define ED_IDX_LCK_WRITE_LEN sizeof(((EdPgIdx *)0)->ED_IDX_LCK_WRITE)
 
+#define ED_IDX_LCK_SYNC_OFF offsetof(EdPgIdx, ED_IDX_LCK_SYNC)
+#define ED_IDX_LCK_SYNC_LEN sizeof(((EdPgIdx *)0)->ED_IDX_LCK_SYNC)
+
 /**
  * @brief  On-disk value for an entry in the slab
  */
@@ -1206,7 +1608,7 @@ struct EdObjectHdr {
 	EdTxnId      xid;              /**< Transaction ID that create this object */
 	EdTime       created;          /**< Timestamp when the object was created */
 	EdTime       exp;              /**< Timestamp when the object expires */
-	uint64_t     flags;            /**< Flags for the object, currently unused */
+	uint64_t     flags;            /**< Flags for the object, #ED_HDR_FPACK or 0 */
 	uint16_t     keylen;           /**< Number of bytes for the key */
 	uint16_t     metalen;          /**< Number of bytes for the metadata */
 	uint32_t     datalen;          /**< Number of bytes for the data */
@@ -1215,6 +1617,8 @@ struct EdObjectHdr {
 	uint32_t     datacrc;          /**< Optional CRC-32c of the object body data */
 };
 
+#define ED_HDR_FPACK UINT64_C(0x0000000000000001) /** The object is packed into a shared block. */
+
 /**
  * @brief  Page type for b+tree branches and leaves
  *
@@ -1266,8 +1670,9 @@ struct EdBpt {
 struct EdEntryBlock {
 	EdBlkno      no;               /**< Physical block number for the entry */
 	EdPgno       count;            /**< Number of blocks used by the entry */
-	uint32_t     flags;            /**< Currently unused */
+	uint32_t     slot;             /**< Slot of a packed object from #ed_vno_slot(), or 0 */
 	EdTxnId      xid;              /**< Transaction ID that created the entry */
+	uint64_t     keyhash;          /**< Hash of the key for the entry */
 };
 
 /**
@@ -1276,9 +1681,10 @@ struct EdEntryBlock {
  * @param  c  Number of blocks in the entry
  * @param  t  Total number of blocks in the slab
  * @param  x  Transaction ID
+ * @param  h  Hash value of the key
  */
-#define ed_entry_block_make(n, c, t, x) \
-	((EdEntryBlock){ ((n) % (t)), (c), 0, (x) })
+#define ed_entry_block_make(n, c, t, x, h) \
+	((EdEntryBlock){ ((n) % (t)), (c), 0, (x), (h) })
 
 /**
  * @brief  B+Tree value type for indexing the slab by key
@@ -1286,16 +1692,19 @@ struct EdEntryBlock {
  * The full hash result is stored in the key entry, but the key itself is
  * stored in the slab. This does not generally result in an unecessary mapping
  * of the slab, however. When an entry is opened, the desired goal is to map
- * the entry, so this works reasonable well in most cases. There are two downsides,
- * however: hash collision resolution requires extra mappings, membership-only
- * tests are not optimal. This is one of the design decisions I may remove in a
- * future version.
+ * the entry, so this works reasonable well in most cases.
+ *
+ * A second, independent hash of the key is stored as the #tag. Hash collisions
+ * are rejected by comparing tags before mapping the slab, and membership tests
+ * are answered from the index alone. Opening an object still compares the full
+ * key, but a membership test treats a matching hash and tag as a match.
  */
 struct EdEntryKey {
 	uint64_t     hash;             /**< Hash of the key */
 	EdBlkno      vno;              /**< Virtual block number for the entry */
 	EdPgno       count;            /**< Number of blocks used by the entry */
 	EdTime       exp;              /**< Expiration of the entry */
+	uint64_t     tag;              /**< Independent hash of the key */
 };
 
 /**
@@ -1304,9 +1713,48 @@ struct EdEntryKey {
  * @param  n  Virtual block number
  * @param  c  Number of blocks in the entry
  * @param  e  Internal expiration time
+ * @param  t  Tag value of the key
+ */
+#define ed_entry_key_make(h, n, c, e, t) \
+	((EdEntryKey){ (h), (n), (c), (e), (t) })
+
+/**
+ * @brief  Calculates the tag value of a key
+ * @param  k  Key bytes
+ * @param  len  Length of the key
+ * @param  seed  Seed of the index
+ */
+#define ed_entry_key_tag(k, len, seed) \
+	ed_hash((const uint8_t *)(k), (len), ~(uint64_t)(seed))
+
+/**
+ * @brief  B+Tree value type for indexing keys by expiration
+ *
+ * Only key entries with a finite expiration have an expiry entry. The tree
+ * key orders entries by expiration, so the expired entries can be removed
+ * from the front of the tree without searching the other trees.
+ */
+struct EdEntryExp {
+	uint64_t     key;              /**< Expiration in the high 32 bits and the low bits of #vno */
+	uint64_t     hash;             /**< Hash of the key */
+	EdBlkno      vno;              /**< Virtual block number for the entry */
+};
+
+/**
+ * @brief  Creates a new entry expiry value
+ * @param  h  Hash value of the key
+ * @param  n  Virtual block number
+ * @param  e  Internal expiration time
+ */
+#define ed_entry_exp_make(h, n, e) \
+	((EdEntryExp){ ((uint64_t)(e) << 32) | ((n) & UINT32_MAX), (h), (n) })
+
+/**
+ * @brief  Gets the internal expiration time of an expiry entry
+ * @param  ent  Expiry entry
  */
-#define ed_entry_key_make(h, n, c, e) \
-	((EdEntryKey){ (h), (n), (c), (e) })
+#define ed_entry_exp_time(ent) \
+	((EdTime)((ent)->key >> 32))
 
 #pragma GCC diagnostic pop
 
@@ -6,11 +6,13 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <errno.h>
 
 #define ED_EXPORT extern __attribute__((visibility ("default")))
 
 #define ED_MAX_KEY 1024
+#define ED_RING_MAX 4
 
 /** @defgroup  cacheflags  EdConfig and ed_cache_open flags
  * @{
@@ -18,6 +20,13 @@
 #define ED_FCHECKSUM     UINT32_C(        0x00000001) /** Calculate checksums for entries. */
 #define ED_FPAGEALIGN    UINT32_C(        0x00000002) /** Force file data to a page boundary. */
 #define ED_FKEEPOLD      UINT32_C(        0x00000004) /** Don't mark replaced objects as expired. */
+#define ED_FSLABPIN      UINT32_C(        0x00000008) /** Lock slab objects through a shared table in the index. */
+#define ED_FFILTER       UINT32_C(        0x00000010) /** Keep a filter of keys in the index to answer misses. */
+#define ED_FCLOCK        UINT32_C(        0x00000020) /** Give recently read objects another pass through the slab. */
+#define ED_FADMIT        UINT32_C(        0x00000040) /** Reject new objects that are read less often than those they would evict. */
+#define ED_FTIER         UINT32_C(        0x00000080) /** Move evicted objects to a second slab rather than discarding them. */
+#define ED_FRING         UINT32_C(        0x00000100) /** Write objects of different sizes to separate rings of the slab. */
+#define ED_FPACK         UINT32_C(        0x00000200) /** Pack small objects into shared slab blocks. */
 #define ED_FVERBOSE      UINT64_C(0x0000000800000000) /** Print informational messages to stderr. */
 #define ED_FCREATE       UINT64_C(0x0000001000000000) /** Create a new index if missing. */
 #define ED_FALLOCATE     UINT64_C(0x0000002000000000) /** Allocate slab space when opening. */
@@ -30,6 +39,8 @@
 #define ED_FNOBLOCK      UINT64_C(0x0000100000000000) /** May return EAGAIN for open or create. */
 #define ED_FRDONLY       UINT64_C(0x0000200000000000) /** The operation does not need to write. */
 #define ED_FNOVERIFY     UINT64_C(0x0000400000000000) /** Disable verifying checksums if they are enabled. */
+#define ED_FMAPSLAB      UINT64_C(0x0000800000000000) /** Map the entire slab once rather than for each object. */
+#define ED_FGROUPSYNC    UINT64_C(0x0001000000000000) /** Share index syncs between concurrent writers. */
 #define ED_FRESET        UINT64_C(0x8000000000000000) /** Reset the transaction when closing. */
 /** @} */
 
@@ -37,6 +48,7 @@
  * @{
  */
 #define ED_OID           (1<<0) /** Open using an object ID instead of key. */
+#define ED_OOPTIMISTIC   (1<<1) /** Open without locking the slab; reads must be checked with ed_validate. */
 /** @} */
 
 /** @brief  Seconds in UNIX time */
@@ -50,6 +62,7 @@ typedef struct EdCache EdCache;
 typedef struct EdObject EdObject;
 typedef struct EdObjectAttr EdObjectAttr;
 typedef struct EdList EdList;
+typedef struct EdBatch EdBatch;
 
 /** @brief  Configuration object used when opening/creating a cache.
  *
@@ -65,6 +78,12 @@ struct EdConfig {
 	uint64_t     flags;
 	long long    slab_size;
 	uint16_t     slab_block_size;
+	uint8_t      clock_percent;    /**< Percent of the slab reinserted per pass with #ED_FCLOCK. */
+	const char * tier_path;        /**< Path to the tier slab with #ED_FTIER (default is the index path with "-tier" suffix). */
+	long long    tier_size;        /**< Size of the tier slab (default is the slab size). */
+	long long    ring_limit[ED_RING_MAX-1];  /**< Largest object in bytes for each ring but the last with #ED_FRING. */
+	uint8_t      ring_percent[ED_RING_MAX-1];/**< Percent of the slab for each ring but the last with #ED_FRING. */
+	uint16_t     pack_size;        /**< Largest object in bytes packed with #ED_FPACK (default is a quarter of the block size). */
 };
 
 struct EdObjectAttr {
@@ -92,14 +111,35 @@ ed_cache_ref(EdCache *cache);
 ED_EXPORT int
 ed_cache_stat(EdCache *cache, FILE *out, uint64_t flags);
 
+ED_EXPORT int
+ed_cache_rebuild(EdCache *cache, unsigned nthreads);
+
+ED_EXPORT int
+ed_cache_reap(EdCache *cache, unsigned budget);
+
 
 
 ED_EXPORT int
 ed_open(EdCache *cache, EdObject **objp, const void *key, size_t len, int flags);
 
+ED_EXPORT int
+ed_open_many(EdCache *cache, const void *const *keys, const size_t *lens, size_t n, EdObject **objs);
+
+ED_EXPORT int
+ed_exists(EdCache *cache, const void *k, size_t klen);
+
+ED_EXPORT int
+ed_contains_many(EdCache *cache, const void *const *keys, const size_t *lens, size_t n, bool *found);
+
 ED_EXPORT int
 ed_create(EdCache *cache, EdObject **objp, const EdObjectAttr *attr);
 
+ED_EXPORT int
+ed_set(EdCache *cache, const EdObjectAttr *attr, const void *data, size_t len, EdTimeTTL ttl);
+
+ED_EXPORT int
+ed_setv(EdCache *cache, const EdObjectAttr *attr, const struct iovec *iov, int iovcnt, EdTimeTTL ttl);
+
 ED_EXPORT int
 ed_update_ttl(EdCache *cache, const void *key, size_t len, EdTimeTTL ttl, bool restore);
 
@@ -109,6 +149,30 @@ ed_update_expiry(EdCache *cache, const void *key, size_t len, EdTimeUnix expiry,
 ED_EXPORT int
 ed_unlink(EdCache *cache, const void *key, size_t len);
 
+ED_EXPORT int
+ed_batch_open(EdCache *cache, EdBatch **batchp);
+
+ED_EXPORT int
+ed_batch_set(EdBatch *batch, const EdObjectAttr *attr, const void *data, size_t len, EdTimeTTL ttl);
+
+ED_EXPORT int
+ed_batch_setv(EdBatch *batch, const EdObjectAttr *attr, const struct iovec *iov, int iovcnt, EdTimeTTL ttl);
+
+ED_EXPORT int
+ed_batch_update_ttl(EdBatch *batch, const void *key, size_t len, EdTimeTTL ttl, bool restore);
+
+ED_EXPORT int
+ed_batch_update_expiry(EdBatch *batch, const void *key, size_t len, EdTimeUnix expiry, bool restore);
+
+ED_EXPORT int
+ed_batch_unlink(EdBatch *batch, const void *key, size_t len);
+
+ED_EXPORT int
+ed_batch_commit(EdBatch **batchp);
+
+ED_EXPORT void
+ed_batch_discard(EdBatch **batchp);
+
 ED_EXPORT int64_t
 ed_write(EdObject *obj, const void *buf, size_t len);
 
@@ -130,6 +194,9 @@ ed_meta(EdObject *obj, size_t *len);
 ED_EXPORT uint32_t
 ed_meta_crc(const EdObject *obj);
 
+ED_EXPORT int
+ed_validate(const EdObject *obj);
+
 ED_EXPORT int
 ed_close(EdObject **objp);
 
@@ -252,6 +319,7 @@ ed_list_close(EdList **list);
 
 #define ED_ECONFIG_SLAB_NAME     ed_econfig(0) /** Error code for an invalid slab path. */
 #define ED_ECONFIG_INDEX_NAME    ed_econfig(1) /** Error code for an invalid index path. */
+#define ED_ECONFIG_RING          ed_econfig(2) /** Error code for invalid ring sizes. */
 
 #define ED_EINDEX_MODE           ed_eindex(0)  /** Error code when the index file mode is invalid. */
 #define ED_EINDEX_SIZE           ed_eindex(1)  /** Error code when the index size requested is invalid. */
@@ -271,6 +339,7 @@ ed_list_close(EdList **list);
 #define ED_EINDEX_DUPKEY         ed_eindex(15) /** Error code if too many duplicate keys are added */
 #define ED_EINDEX_FORK           ed_eindex(16) /** Error code if the index is used across a fork */
 #define ED_EINDEX_TXN_CLOSED     ed_eindex(17) /** Error code if the transaction is closed */
+#define ED_EINDEX_SEED           ed_eindex(18) /** Error code if the index seed does not match the slab objects */
 
 #define ED_ESLAB_MODE            ed_eslab(0)   /** Error code when the slab file mode is invalid. */
 #define ED_ESLAB_SIZE            ed_eslab(1)   /** Error code when the slab size requested is invalid. */
@@ -286,6 +355,8 @@ ed_list_close(EdList **list);
 #define ED_EOBJECT_ID            ed_eobject(3) /** Error code for invalid object ids */
 #define ED_EOBJECT_METACRC       ed_eobject(4) /** Error code when meta data crc doesn't match */
 #define ED_EOBJECT_DATACRC       ed_eobject(5) /** Error code when body data crc doesn't match */
+#define ED_EOBJECT_CHANGED       ed_eobject(6) /** Error code when an unlocked object was replaced while reading */
+#define ED_EOBJECT_REJECTED      ed_eobject(7) /** Error code when a new object is not admitted with ED_FADMIT */
 
 #define ED_EMIME_FILE            ed_emime(0)   /** Error code when the mime.cache file can't be loaded. */
 
@@ -3,6 +3,7 @@
 static const char *const econfig[] = {
 	[ed_ecode(ED_ECONFIG_SLAB_NAME)]    = "slab name is too long",
 	[ed_ecode(ED_ECONFIG_INDEX_NAME)]    = "index name is too long",
+	[ed_ecode(ED_ECONFIG_RING)]          = "ring sizes do not fit in the slab",
 };
 
 static const char *const eindex[] = {
@@ -24,6 +25,7 @@ static const char *const eindex[] = {
 	[ed_ecode(ED_EINDEX_DUPKEY)]         = "too many duplicate key",
 	[ed_ecode(ED_EINDEX_FORK)]           = "the index must be re-opened after a fork",
 	[ed_ecode(ED_EINDEX_TXN_CLOSED)]     = "the index transaction is not open",
+	[ed_ecode(ED_EINDEX_SEED)]           = "the index seed does not match the slab",
 };
 
 static const char *const ekey[] = {
@@ -45,6 +47,8 @@ static const char *const eobject[] = {
 	[ed_ecode(ED_EOBJECT_ID)]            = "object id is invalid",
 	[ed_ecode(ED_EOBJECT_METACRC)]       = "object meta-data CRC32c doesn't match",
 	[ed_ecode(ED_EOBJECT_DATACRC)]       = "object data CRC32c doesn't match",
+	[ed_ecode(ED_EOBJECT_CHANGED)]       = "object was replaced while reading",
+	[ed_ecode(ED_EOBJECT_REJECTED)]      = "object is read less often than those it would evict",
 };
 
 static const char *const emime[] = {
@@ -4,6 +4,8 @@ _Static_assert(sizeof(EdPgIdx) <= PAGESIZE,
 		"EdPgIdx too big");
 _Static_assert(offsetof(EdPgIdx, tree) % 16 == 0,
 		"EdPgIdx tree member is not 16-bytes aligned");
+_Static_assert(offsetof(EdPgIdx, vpins) % 8 == 0,
+		"EdPgIdx vpins member is not 8-bytes aligned");
 _Static_assert(sizeof(EdBpt) + ED_ENTRY_BLOCK_COUNT*sizeof(EdEntryBlock) <= PAGESIZE,
 		"ED_PAGE_BLOCK_COUNT is too high");
 _Static_assert(sizeof(EdBpt) + ED_ENTRY_KEY_COUNT*sizeof(EdEntryKey) <= PAGESIZE,
@@ -27,14 +29,24 @@ static const EdPgIdx INDEX_DEFAULT = {
 # error Unkown byte order
 #endif
 	.mark = 0xfc,
-	.version = 2,
+	.version = 16,
 	.size_page = PAGESIZE,
 	.slab_block_size = PAGESIZE,
 	.nconns = 32,
 	.xid = 1,
+	.xid_written = 1,
+	.xid_synced = 1,
 	.gc_head = ED_PG_NONE,
 	.gc_tail = ED_PG_NONE,
 	.tree = { ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE },
+	.active_next = ED_PG_NONE,
+	.pin_start = ED_PG_NONE,
+	.filter_start = ED_PG_NONE,
+	.clock_start = ED_PG_NONE,
+	.sketch_start = ED_PG_NONE,
+	.tier_start = ED_PG_NONE,
+	.ring_start = ED_PG_NONE,
+	.pack_vno = ED_BLK_NONE,
 	.active = {
 		ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE,
 		ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE,
@@ -63,11 +75,7 @@ static const EdPgIdx INDEX_DEFAULT = {
 		ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE,
 		ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE,
 		ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE,
-		ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE,
-		ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE,
-		ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE,
-		ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE,
-		ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE,
+		ED_PG_NONE, ED_PG_NONE, ED_PG_NONE, ED_PG_NONE,
 	},
 };
 
@@ -118,14 +126,14 @@ allocate_file(uint64_t flags, int fd, long long size, const char *type)
 }
 
 static int64_t
-slab_init(int fd, const EdConfig *cfg, const struct stat *s)
+slab_init(int fd, long long want, uint64_t flags, const struct stat *s, const char *type)
 {
 	if (ED_IS_FILE(s->st_mode)) {
 		if ((intmax_t)s->st_size > (intmax_t)INT64_MAX) {
 			return ED_ESLAB_SIZE;
 		}
-		if (cfg->slab_size && s->st_size != cfg->slab_size && (cfg->flags & ED_FALLOCATE)) {
-			return allocate_file(cfg->flags, fd, cfg->slab_size, "slab");
+		if (want && s->st_size != want && (flags & ED_FALLOCATE)) {
+			return allocate_file(flags, fd, want, type);
 		}
 		return (int64_t)s->st_size;
 	}
@@ -165,6 +173,114 @@ slab_init(int fd, const EdConfig *cfg, const struct stat *s)
 #define OPEN(path, f, ifset) \
 	open(path, (O_CLOEXEC|O_RDWR | (((f) & (ifset)) ? O_CREAT : 0)), 0600)
 
+/**
+ * @brief  Maps the tier page and opens the tier slab
+ *
+ * When creating, the tier page is initialized from the config. Otherwise, the
+ * tier slab is verified against the saved page.
+ *
+ * @param  idx  Index object with the header mapped
+ * @param  cfg  Config used to open the index
+ * @param  index_path  Absolute path to the index
+ * @param  size  Size of the tier slab when creating, or 0
+ * @return  0 on success, <0 on error
+ */
+static int
+tier_open(EdIdx *idx, const EdConfig *cfg, const char *index_path, long long size)
+{
+	const bool create = size > 0;
+	EdPgTier *tier = ed_pg_map(idx->fd, idx->hdr->tier_start, 1, true);
+	if (tier == MAP_FAILED) { return ED_ERRNO; }
+	idx->tier = tier;
+
+	if (create) {
+		memset(tier, 0, sizeof(*tier));
+		if (cfg->tier_path == NULL) {
+			int len = snprintf(tier->path, sizeof(tier->path), "%s-tier", index_path);
+			if (len < 0) { return ED_ERRNO; }
+			if (len >= (int)sizeof(tier->path)) { return ED_ECONFIG_SLAB_NAME; }
+		}
+		else {
+			ssize_t len = ed_path_abs(tier->path, sizeof(tier->path)-1,
+					cfg->tier_path, strnlen(cfg->tier_path, sizeof(tier->path)));
+			if (len < 0) { return ED_ECONFIG_SLAB_NAME; }
+			tier->path[len] = '\0';
+		}
+	}
+
+	struct stat stat;
+	int fd = idx->tierfd = OPEN(tier->path, cfg->flags, create ? ED_FALLOCATE : 0);
+	if (fd < 0 || fstat(fd, &stat) < 0) { return ED_ERRNO; }
+
+	int64_t tier_size = slab_init(fd, size, cfg->flags, &stat, "tier");
+	if (tier_size < 0) { return (int)tier_size; }
+
+	EdBlkno count = (EdBlkno)(tier_size/idx->hdr->slab_block_size);
+	if (create) {
+		if (count == 0) { return ED_ESLAB_SIZE; }
+		tier->ino = (uint64_t)stat.st_ino;
+		tier->block_count = count;
+		tier->vno = 0;
+		return 0;
+	}
+	if (tier->block_count != count) { return ED_ESLAB_BLOCK_COUNT; }
+	if (tier->ino != (uint64_t)stat.st_ino) { return ED_ESLAB_INODE; }
+	return 0;
+}
+
+/**
+ * @brief  Partitions the slab into rings as described by the config
+ *
+ * Each ring but the last is given its percent of the slab, and the last ring
+ * is given the remaining blocks for objects of any size.
+ *
+ * @param  ring  Ring page contents to initialize
+ * @param  cfg  Config used to create the index
+ * @param  block_count  Number of blocks in the slab
+ * @param  block_size  Size of the blocks in the slab
+ * @return  0 on success, <0 on error
+ */
+static int
+ring_init(EdPgRing *ring, const EdConfig *cfg, EdBlkno block_count, uint16_t block_size)
+{
+	EdBlkno start = 0, limit = 0;
+	unsigned n = 0;
+
+	memset(ring, 0, sizeof(*ring));
+	for (; n < ED_RING_MAX-1; n++) {
+		long long size = cfg->ring_limit[n];
+		if (size == 0 && n == 0) { size = ED_RING_LIMIT; }
+		if (size == 0) { break; }
+		if (size < 0) { return ED_ECONFIG_RING; }
+
+		unsigned pct = cfg->ring_percent[n] ? cfg->ring_percent[n] : ED_RING_PERCENT;
+		EdBlkno count = (EdBlkno)((uint64_t)block_count * pct / 100);
+		EdBlkno max = ED_COUNT_SIZE((uint64_t)size, block_size);
+		if (max <= limit || count < max || count >= block_count - start) {
+			return ED_ECONFIG_RING;
+		}
+		ring->rings[n] = (EdRing){
+			.start = start,
+			.count = count,
+			.limit = max,
+			.vno = ed_vno_make(n, 0),
+			.vres = ed_vno_make(n, 0),
+		};
+		start += count;
+		limit = max;
+	}
+	if (block_count - start <= limit) { return ED_ECONFIG_RING; }
+	ring->rings[n] = (EdRing){
+		.start = start,
+		.count = block_count - start,
+		.limit = block_count - start,
+		.vno = ed_vno_make(n, 0),
+		.vres = ed_vno_make(n, 0),
+	};
+	ring->count = n + 1;
+	return 0;
+}
+
 /**
  * @brief  Locks the next available process connection slot
  *
@@ -228,6 +344,171 @@ conn_release(EdPgIdx *hdr, EdConn **connp, int fd)
 	ed_flck(fd, ED_LCK_UN, (uint8_t *)conn - (uint8_t *)hdr, sizeof(*conn), ED_FNOBLOCK);
 }
 
+/**
+ * @brief  Frees a pin slot owned by a process that has exited
+ *
+ * The slot is first moved to an invalid owner so that only one process may
+ * clear it, and a new owner cannot claim it before the mode is reset.
+ *
+ * @param  pin  Pin slot
+ * @param  pid  Process ID observed as the owner
+ */
+static void
+pin_reclaim(EdSlabPin *pin, int pid)
+{
+	if (__sync_bool_compare_and_swap(&pin->pid, pid, -1)) {
+		pin->mode = 0;
+		__sync_synchronize();
+		pin->pid = 0;
+	}
+}
+
+/**
+ * @brief  Tests if the process owning a pin slot has exited
+ * @param  pid  Process ID of the owner
+ * @return  true if the process no longer exists
+ */
+static bool
+pin_owner_dead(int pid)
+{
+	return pid > 0 && kill(pid, 0) < 0 && errno == ESRCH;
+}
+
+/**
+ * @brief  Releases a claimed pin slot
+ * @param  pin  Pin slot
+ */
+static void
+pin_release(EdSlabPin *pin)
+{
+	pin->mode = 0;
+	__sync_synchronize();
+	pin->pid = 0;
+}
+
+/**
+ * @brief  Atomic value of the pin slot count and claim generation
+ */
+typedef union {
+	uint64_t v;                    /**< Value swapped with #EdPgIdx.vpins */
+	struct {
+		EdPgno n;                  /**< Number of slots up to the last claimed slot */
+		EdPgno gen;                /**< Number of claims */
+	};
+} PinCount;
+
+/**
+ * @brief  Raises the pin slot count to include a claimed slot
+ *
+ * The generation is advanced by every claim, even when the count already
+ * includes the slot. A trim that read the count before this claim will then
+ * fail to swap it, so a count can never be lowered past a claimed slot.
+ *
+ * @param  hdr  Index header
+ * @param  i  Index of the claimed slot
+ */
+static void
+pin_count_claim(EdPgIdx *hdr, EdPgno i)
+{
+	PinCount old, new;
+	do {
+		old.v = hdr->vpins;
+		new.n = old.n > i ? old.n : i+1;
+		new.gen = old.gen + 1;
+	} while (!__sync_bool_compare_and_swap(&hdr->vpins, old.v, new.v));
+}
+
+/**
+ * @brief  Lowers the pin slot count past free slots at the end of the table
+ *
+ * Slots are claimed from the start of the table, so once a burst of pins is
+ * released the count shrinks back and later scans only cover live slots.
+ *
+ * @param  idx  Index object
+ */
+static void
+pin_count_trim(EdIdx *idx)
+{
+	EdPgIdx *hdr = idx->hdr;
+	EdSlabPin *pins = idx->pins;
+	PinCount old, new;
+	do {
+		old.v = hdr->vpins;
+		__sync_synchronize();
+		new = old;
+		while (new.n > 0 && pins[new.n-1].pid == 0) { new.n--; }
+		if (new.n == old.n) { return; }
+	} while (!__sync_bool_compare_and_swap(&hdr->vpins, old.v, new.v));
+}
+
+/**
+ * @brief  Releases all pin slots owned by a process
+ * @param  idx  Index object
+ * @param  pid  Process ID
+ */
+static void
+pin_release_pid(EdIdx *idx, int pid)
+{
+	EdSlabPin *pins = idx->pins;
+	EdPgno n = idx->hdr->npins;
+	for (EdPgno i = 0; i < n; i++) {
+		if (pins[i].pid == pid) { pin_release(&pins[i]); }
+	}
+	pin_count_trim(idx);
+}
+
+/**
+ * @brief  Calculates the number of pages for the key filter
+ *
+ * Each slab block could hold one object, so the filter is sized for
+ * #ED_FILTER_RATIO counters per block. The count is a power of 2 so that a
+ * filter line may be selected with a mask.
+ *
+ * @param  block_count  Number of blocks in the slab
+ * @return  Number of pages
+ */
+static EdPgno
+filter_pages(EdBlkno block_count)
+{
+	uint64_t size = (uint64_t)block_count * ED_FILTER_RATIO;
+	EdPgno count = 1;
+	while (count < ED_FILTER_MAX_PAGES && (uint64_t)count * PAGESIZE < size) {
+		count *= 2;
+	}
+	return count;
+}
+
+/**
+ * @brief  Calculates the number of pages for the access bits
+ * @param  block_count  Number of blocks in the slab
+ * @return  Number of pages
+ */
+static EdPgno
+clock_pages(EdBlkno block_count)
+{
+	return ed_count_pg((block_count + 7) / 8);
+}
+
+/**
+ * @brief  Calculates the number of pages for the frequency sketch
+ *
+ * Like the key filter, the count is a power of 2 so that a line may be
+ * selected with a mask.
+ *
+ * @param  block_count  Number of blocks in the slab
+ * @return  Number of pages
+ */
+static EdPgno
+sketch_pages(EdBlkno block_count)
+{
+	uint64_t size = (uint64_t)block_count * ED_SKETCH_RATIO;
+	EdPgno count = 1;
+	while (count < ED_SKETCH_MAX_PAGES && (uint64_t)count * PAGESIZE < size) {
+		count *= 2;
+	}
+	return count;
+}
+
 static void
 ed_idx_clear(EdIdx *idx)
 {
@@ -235,6 +516,7 @@ ed_idx_clear(EdIdx *idx)
 	idx->path = NULL;
 	idx->fd = -1;
 	idx->slabfd = -1;
+	idx->tierfd = -1;
 	idx->gc_head = NULL;
 	idx->gc_tail = NULL;
 	idx->flags = 0;
@@ -242,6 +524,17 @@ ed_idx_clear(EdIdx *idx)
 	idx->nconns = 0;
 	idx->pid = -1;
 	idx->seed = 0;
+	idx->map = NULL;
+	idx->mapcount = 0;
+	idx->pins = NULL;
+	idx->filter = NULL;
+	idx->clock = NULL;
+	idx->sketch = NULL;
+	idx->tier = NULL;
+	idx->ring = NULL;
+	idx->readers = NULL;
+	idx->nreaders = 0;
+	idx->nreaderslot = 0;
 	idx->epoch = -1;
 }
 
@@ -250,8 +543,10 @@ ed_idx_open(EdIdx *idx, const EdConfig *cfg)
 {
 	ed_idx_clear(idx);
 	ed_lck_init(&idx->lck, ED_IDX_LCK_WRITE_OFF, ED_IDX_LCK_WRITE_LEN);
+	pthread_mutex_init(&idx->mtx, NULL);
 
 	EdPgIdx *hdr = MAP_FAILED, hdrnew = INDEX_DEFAULT;
+	EdPgRing ringnew;
 	struct stat stat;
 	int fd = -1, sfd = -1, rc = 0, pid = getpid();
 	uint64_t flags = cfg->flags;
@@ -276,6 +571,10 @@ ed_idx_open(EdIdx *idx, const EdConfig *cfg)
 	hdrnew.gc_head = PG_ROOT_GC;
 	hdrnew.gc_tail = PG_ROOT_GC;
 	hdrnew.tail_start = PG_NINIT(nconns);
+	if (flags & ED_FSLABPIN) {
+		hdrnew.pin_start = hdrnew.tail_start;
+		hdrnew.tail_start += ED_PIN_PAGES;
+	}
 	hdrnew.tail_count = ED_ALLOC_COUNT;
 	if (cfg->slab_block_size > 0) {
 		hdrnew.slab_block_size = cfg->slab_block_size;
@@ -324,7 +623,7 @@ ed_idx_open(EdIdx *idx, const EdConfig *cfg)
 			idx->slabfd = sfd = OPEN(slab_path, flags, ED_FALLOCATE);
 			if (sfd < 0 || fstat(sfd, &stat) < 0) { rc = ED_ERRNO; break; }
 
-			int64_t slab_size = slab_init(sfd, cfg, &stat);
+			int64_t slab_size = slab_init(sfd, cfg->slab_size, cfg->flags, &stat, "slab");
 			if (slab_size < 0) { rc = (int)slab_size; break; }
 
 			if (!(flags & ED_FREPLACE)) {
@@ -334,13 +633,48 @@ ed_idx_open(EdIdx *idx, const EdConfig *cfg)
 
 			hdrnew.slab_block_count = (EdBlkno)(slab_size/hdrnew.slab_block_size);
 			hdrnew.slab_ino = (uint64_t)stat.st_ino;
+			if (flags & ED_FFILTER) {
+				hdrnew.filter_start = hdrnew.tail_start;
+				hdrnew.filter_count = filter_pages(hdrnew.slab_block_count);
+				hdrnew.tail_start += hdrnew.filter_count;
+			}
+			if (flags & ED_FCLOCK) {
+				unsigned pct = cfg->clock_percent ? cfg->clock_percent : ED_CLOCK_PERCENT;
+				if (pct > ED_CLOCK_MAX_PERCENT) { pct = ED_CLOCK_MAX_PERCENT; }
+				hdrnew.clock_start = hdrnew.tail_start;
+				hdrnew.clock_count = clock_pages(hdrnew.slab_block_count);
+				hdrnew.clock_budget = (EdBlkno)((uint64_t)hdrnew.slab_block_count * pct / 100);
+				hdrnew.tail_start += hdrnew.clock_count;
+			}
+			if (flags & ED_FADMIT) {
+				hdrnew.sketch_start = hdrnew.tail_start;
+				hdrnew.sketch_count = sketch_pages(hdrnew.slab_block_count);
+				hdrnew.sketch_limit = (uint64_t)hdrnew.slab_block_count * ED_SKETCH_SAMPLE;
+				hdrnew.tail_start += hdrnew.sketch_count;
+			}
+			if (flags & ED_FTIER) {
+				hdrnew.tier_start = hdrnew.tail_start;
+				hdrnew.tail_start += 1;
+			}
+			if (flags & ED_FRING) {
+				rc = ring_init(&ringnew, cfg, hdrnew.slab_block_count, hdrnew.slab_block_size);
+				if (rc < 0) { break; }
+				hdrnew.ring_start = hdrnew.tail_start;
+				hdrnew.tail_start += 1;
+			}
+			// Page aligned data leaves no room to share a block.
+			if ((flags & ED_FPACK) && !(flags & ED_FPAGEALIGN)) {
+				unsigned size = cfg->pack_size ? cfg->pack_size : hdrnew.slab_block_size / 4;
+				if (size > hdrnew.slab_block_size / 2) { size = hdrnew.slab_block_size / 2; }
+				hdrnew.pack_size = size;
+			}
 
 			if (ftruncate(fd, 0) < 0){
 				rc = ED_ERRNO;
 				break;
 			}
 
-			size_t size = PG_NINIT(nconns) * PAGESIZE;
+			size_t size = (size_t)hdrnew.tail_start * PAGESIZE;
 			rc = allocate_file(flags, fd, size + (ED_ALLOC_COUNT * PAGESIZE), "index");
 			if (rc < 0) { break; }
 
@@ -352,6 +686,16 @@ ed_idx_open(EdIdx *idx, const EdConfig *cfg)
 			gc->base.type = ED_PG_GC;
 			gc->next = ED_PG_NONE;
 
+			if (hdr->tier_start != ED_PG_NONE) {
+				rc = tier_open(idx, cfg, index_path, cfg->tier_size ? cfg->tier_size : slab_size);
+				if (rc < 0) { break; }
+			}
+			if (hdr->ring_start != ED_PG_NONE) {
+				idx->ring = ed_pg_map(fd, hdr->ring_start, 1, true);
+				if (idx->ring == MAP_FAILED) { rc = ED_ERRNO; break; }
+				memcpy(idx->ring, &ringnew, sizeof(ringnew));
+			}
+
 			if (!(cfg->flags & ED_FNOSYNC)) {
 				fsync(fd);
 			}
@@ -366,6 +710,58 @@ ed_idx_open(EdIdx *idx, const EdConfig *cfg)
 	}
 	if (rc < 0) { goto error; }
 
+	if (hdr->tier_start != ED_PG_NONE && idx->tier == NULL) {
+		rc = tier_open(idx, cfg, index_path, 0);
+		if (rc < 0) { goto error; }
+	}
+
+	if (hdr->ring_start != ED_PG_NONE && idx->ring == NULL) {
+		idx->ring = ed_pg_map(fd, hdr->ring_start, 1, true);
+		if (idx->ring == MAP_FAILED) {
+			idx->ring = NULL;
+			rc = ED_ERRNO;
+			goto error;
+		}
+	}
+
+	if (hdr->pin_start != ED_PG_NONE) {
+		idx->pins = ed_pg_map(fd, hdr->pin_start, ED_PIN_PAGES, true);
+		if (idx->pins == MAP_FAILED) {
+			idx->pins = NULL;
+			rc = ED_ERRNO;
+			goto error;
+		}
+		// A previous process with the same ID could not have released its pins.
+		pin_release_pid(idx, pid);
+	}
+
+	if (hdr->filter_start != ED_PG_NONE) {
+		idx->filter = ed_pg_map(fd, hdr->filter_start, hdr->filter_count, true);
+		if (idx->filter == MAP_FAILED) {
+			idx->filter = NULL;
+			rc = ED_ERRNO;
+			goto error;
+		}
+	}
+
+	if (hdr->clock_start != ED_PG_NONE) {
+		idx->clock = ed_pg_map(fd, hdr->clock_start, hdr->clock_count, true);
+		if (idx->clock == MAP_FAILED) {
+			idx->clock = NULL;
+			rc = ED_ERRNO;
+			goto error;
+		}
+	}
+
+	if (hdr->sketch_start != ED_PG_NONE) {
+		idx->sketch = ed_pg_map(fd, hdr->sketch_start, hdr->sketch_count, true);
+		if (idx->sketch == MAP_FAILED) {
+			idx->sketch = NULL;
+			rc = ED_ERRNO;
+			goto error;
+		}
+	}
+
 	idx->flags = ed_idx_flags(hdr->flags | ed_fopen(flags));
 	idx->pid = pid;
 	idx->path = strdup(index_path);
@@ -388,10 +784,13 @@ ed_idx_close(EdIdx *idx)
 
 	if (idx == NULL) { return; }
 	if (idx->pid == getpid()) {
+		if (idx->pins) { pin_release_pid(idx, idx->pid); }
 		conn_release(idx->hdr, &idx->conn, idx->fd);
 		if (idx->fd > -1) { close(idx->fd); }
 		if (idx->slabfd > -1) { close(idx->slabfd); }
+		if (idx->tierfd > -1) { close(idx->tierfd); }
 		ed_lck_final(&idx->lck);
+		pthread_mutex_destroy(&idx->mtx);
 	}
 	if (idx->gc_tail && idx->gc_tail != MAP_FAILED && idx->gc_tail != idx->gc_head) {
 		ed_pg_unmap(idx->gc_tail, 1);
@@ -399,9 +798,31 @@ ed_idx_close(EdIdx *idx)
 	if (idx->gc_head && idx->gc_head != MAP_FAILED) {
 		ed_pg_unmap(idx->gc_head, 1);
 	}
+	if (idx->filter) {
+		ed_pg_unmap(idx->filter, idx->hdr->filter_count);
+	}
+	if (idx->clock) {
+		ed_pg_unmap(idx->clock, idx->hdr->clock_count);
+	}
+	if (idx->sketch) {
+		ed_pg_unmap(idx->sketch, idx->hdr->sketch_count);
+	}
+	if (idx->tier && idx->tier != MAP_FAILED) {
+		ed_pg_unmap(idx->tier, 1);
+	}
+	if (idx->ring && idx->ring != MAP_FAILED) {
+		ed_pg_unmap(idx->ring, 1);
+	}
 	if (idx->hdr && idx->hdr != MAP_FAILED) {
 		ed_pg_unmap(idx->hdr, ED_IDX_PAGES(idx->nconns));
 	}
+	if (idx->map) {
+		munmap(idx->map, (size_t)ED_IDX_MAP_MAX*PAGESIZE);
+	}
+	if (idx->pins) {
+		ed_pg_unmap(idx->pins, ED_PIN_PAGES);
+	}
+	free(idx->readers);
 	free(idx->path);
 	ed_idx_clear(idx);
 }
@@ -441,56 +862,456 @@ ed_idx_lock(EdIdx *idx, EdLckType type)
 	return ed_lck(&idx->lck, idx->fd, type, idx->flags);
 }
 
-EdTxnId
-ed_idx_acquire_xid(EdIdx *idx)
+/**
+ * @brief  Publishes the oldest snapshot held by any thread in the process
+ *
+ * The connection is shared by every thread, so its xid must not advance past
+ * a reader that is still active. This must be called with the thread lock held,
+ * so the time is read by the caller beforehand.
+ *
+ * @param  idx  Index object
+ * @param  now  Current time
+ */
+static void
+idx_update_conn(EdIdx *idx, EdTime now)
 {
-	ed_idx_assert(idx);
 	EdConn *conn = idx->conn;
-	conn->xid = idx->hdr->xid;
-	conn->active = ed_time_from_unix(idx->epoch, ed_now_unix());
-	return conn->xid;
+	conn->xid = idx->nreaders > 0 ? idx->readers[0] : 0;
+	conn->active = now;
+}
+
+int
+ed_idx_acquire_xid(EdIdx *idx, EdTxnId *xidp)
+{
+	ed_idx_assert(idx);
+
+	const EdTime now = ed_time_from_unix(idx->epoch, ed_now_unix());
+	pthread_mutex_lock(&idx->mtx);
+	if (idx->nreaders == idx->nreaderslot) {
+		unsigned nslot = idx->nreaderslot ? idx->nreaderslot * 2 : 16;
+		EdTxnId *readers = realloc(idx->readers, nslot * sizeof(readers[0]));
+		if (readers == NULL) {
+			// The snapshot cannot be used unless its xid is published.
+			int rc = ED_ERRNO;
+			pthread_mutex_unlock(&idx->mtx);
+			return rc;
+		}
+		idx->readers = readers;
+		idx->nreaderslot = nslot;
+	}
+
+	// The global xid only increases, so new readers almost always append.
+	EdTxnId xid = idx->hdr->xid;
+	unsigned i = idx->nreaders;
+	for (; i > 0 && idx->readers[i-1] > xid; i--) {
+		idx->readers[i] = idx->readers[i-1];
+	}
+	idx->readers[i] = xid;
+	idx->nreaders++;
+	idx_update_conn(idx, now);
+	pthread_mutex_unlock(&idx->mtx);
+	*xidp = xid;
+	return 0;
 }
 
 void
-ed_idx_release_xid(EdIdx *idx)
+ed_idx_release_xid(EdIdx *idx, EdTxnId xid)
 {
 	ed_idx_assert(idx);
-	EdConn *conn = idx->conn;
-	if (conn->xid > 0) {
-		conn->xid = 0;
-		conn->active = ed_time_from_unix(idx->epoch, ed_now_unix());
+	if (xid == 0) { return; }
+
+	const EdTime now = ed_time_from_unix(idx->epoch, ed_now_unix());
+	pthread_mutex_lock(&idx->mtx);
+	for (unsigned i = 0; i < idx->nreaders; i++) {
+		if (idx->readers[i] == xid) {
+			idx->nreaders--;
+			memmove(idx->readers+i, idx->readers+i+1,
+					(idx->nreaders - i) * sizeof(idx->readers[0]));
+			idx_update_conn(idx, now);
+			break;
+		}
 	}
+	pthread_mutex_unlock(&idx->mtx);
 }
 
 int
-ed_idx_acquire_snapshot(EdIdx *idx, EdBpt **trees)
+ed_idx_acquire_snapshot(EdIdx *idx, EdBpt **trees, EdTxnId *xidp)
 {
 	ed_idx_assert(idx);
-	ed_idx_acquire_xid(idx);
+	EdTxnId xid;
+	int rc = ed_idx_acquire_xid(idx, &xid);
+	if (rc < 0) { return rc; }
 	for (int i = 0; i < ED_NDB; i++) {
-		if (ed_pg_load(idx->fd, (EdPg **)&trees[i], idx->hdr->tree[i], true)
-				== MAP_FAILED) {
-			int rc = ED_ERRNO;
-			for (; i >= 0; i--) {
-				if (trees[i]) { ed_pg_unmap(trees[i], 1); }
-			}
-			ed_idx_release_xid(idx);
+		EdPgno no = idx->hdr->tree[i];
+		if (trees[i] != NULL) {
+			if (trees[i]->base.no == no) { continue; }
+			ed_idx_unmap(idx, trees[i]);
+			trees[i] = NULL;
+		}
+		if (no == ED_PG_NONE) { continue; }
+		EdPg *pg = ed_idx_map(idx, no);
+		if (pg == MAP_FAILED) {
+			rc = ED_ERRNO;
+			ed_idx_release_snapshot(idx, trees, xid);
 			return rc;
 		}
+		trees[i] = (EdBpt *)pg;
 	}
+	*xidp = xid;
 	return 0;
 }
 
 void
-ed_idx_release_snapshot(EdIdx *idx, EdBpt **trees)
+ed_idx_release_snapshot(EdIdx *idx, EdBpt **trees, EdTxnId xid)
 {
 	for (size_t i = 0; i < ED_NDB; i++) {
 		if (trees[i]) {
-			ed_pg_unmap(trees[i], 1);
+			ed_idx_unmap(idx, trees[i]);
 			trees[i] = NULL;
 		}
 	}
-	ed_idx_release_xid(idx);
+	ed_idx_release_xid(idx, xid);
+}
+
+int
+ed_idx_sync(EdIdx *idx, EdTxnId xid, uint64_t flags)
+{
+	ed_idx_assert(idx);
+	EdPgIdx *hdr = idx->hdr;
+	if (hdr->xid_synced >= xid) { return 0; }
+
+	// Only one writer syncs at a time. The others wait on the lock, and will
+	// usually find their transaction was covered by the sync they waited on.
+	int rc = ed_flck(idx->fd, ED_LCK_EX, ED_IDX_LCK_SYNC_OFF, ED_IDX_LCK_SYNC_LEN, flags);
+	if (rc < 0) { return rc; }
+	if (hdr->xid_synced < xid) {
+		EdTxnId written = hdr->xid_written;
+		if (fsync(idx->fd) < 0) {
+			rc = ED_ERRNO;
+		}
+		else if (written > hdr->xid_synced) {
+			hdr->xid_synced = written;
+		}
+	}
+	ed_flck(idx->fd, ED_LCK_UN, ED_IDX_LCK_SYNC_OFF, ED_IDX_LCK_SYNC_LEN, flags);
+	return rc;
+}
+
+/**
+ * @brief  Claims a free pin slot
+ * @param  idx  Index object
+ * @param  reclaim  Reclaim slots owned by processes that have exited
+ * @return  Index of the claimed slot or #ED_PIN_MAX if the table is full
+ */
+static EdPgno
+pin_claim(EdIdx *idx, bool reclaim)
+{
+	EdSlabPin *pins = idx->pins;
+	for (EdPgno i = 0; i < ED_PIN_MAX; i++) {
+		int owner = pins[i].pid;
+		if (reclaim && pin_owner_dead(owner)) {
+			pin_reclaim(&pins[i], owner);
+			owner = pins[i].pid;
+		}
+		if (owner == 0 && __sync_bool_compare_and_swap(&pins[i].pid, 0, idx->pid)) {
+			return i;
+		}
+	}
+	return ED_PIN_MAX;
+}
+
+int
+ed_idx_pin(EdIdx *idx, EdLckType type, off_t start, off_t len)
+{
+	ed_idx_assert(idx);
+	EdPgIdx *hdr = idx->hdr;
+	EdSlabPin *pins = idx->pins;
+	const int mode = type == ED_LCK_EX ? ED_PIN_EX : ED_PIN_SH;
+	const off_t end = start + len;
+
+	EdPgno i = pin_claim(idx, false);
+	if (i == ED_PIN_MAX) { i = pin_claim(idx, true); }
+	if (i == ED_PIN_MAX) { return ed_esys(ENOLCK); }
+
+	EdSlabPin *pin = &pins[i];
+	pin->start = start;
+	pin->len = len;
+	pin_count_claim(hdr, i);
+
+	// The pin is published before looking for conflicts. If two processes pin
+	// conflicting regions at once, at least one of them will see the other.
+	__sync_synchronize();
+	pin->mode = mode;
+	__sync_synchronize();
+
+	EdPgno n = hdr->npins;
+	for (EdPgno j = 0; j < n; j++) {
+		EdSlabPin *p = &pins[j];
+		int m = p->mode;
+		if (p == pin || m == 0 || (m == ED_PIN_SH && mode == ED_PIN_SH)) { continue; }
+		if (p->start >= end || p->start + p->len <= start) { continue; }
+		int owner = p->pid;
+		if (owner != idx->pid && pin_owner_dead(owner)) {
+			pin_reclaim(p, owner);
+			continue;
+		}
+		pin_release(pin);
+		pin_count_trim(idx);
+		return ed_esys(EAGAIN);
+	}
+	return 0;
+}
+
+void
+ed_idx_unpin(EdIdx *idx, off_t start, off_t len)
+{
+	ed_idx_assert(idx);
+	EdSlabPin *pins = idx->pins;
+	EdPgno n = idx->hdr->npins;
+	for (EdPgno i = 0; i < n; i++) {
+		EdSlabPin *p = &pins[i];
+		if (p->pid == idx->pid && p->mode != 0 && p->start == start && p->len == len) {
+			pin_release(p);
+			pin_count_trim(idx);
+			return;
+		}
+	}
+}
+
+/**
+ * @brief  Gets the filter line for a key hash
+ * @param  idx  Index object
+ * @param  h  Key hash
+ * @return  Pointer to the first counter of the line
+ */
+static inline uint8_t *
+filter_line(EdIdx *idx, uint64_t h)
+{
+	size_t nlines = (size_t)idx->hdr->filter_count * (PAGESIZE / ED_FILTER_LINE);
+	return idx->filter + ((h >> 32) & (nlines - 1)) * ED_FILTER_LINE;
+}
+
+/**
+ * @brief  Gets the counter position within a filter line for a probe
+ * @param  h  Key hash
+ * @param  i  Probe number
+ * @return  Offset of the counter in the line
+ */
+static inline unsigned
+filter_probe(uint64_t h, unsigned i)
+{
+	return (unsigned)(h >> (i * 6)) % ED_FILTER_LINE;
+}
+
+void
+ed_idx_filter_add(EdIdx *idx, uint64_t h)
+{
+	uint8_t *line = filter_line(idx, h);
+	for (unsigned i = 0; i < ED_FILTER_PROBES; i++) {
+		uint8_t *c = &line[filter_probe(h, i)];
+		for (uint8_t v = *c; v < UINT8_MAX; v = *c) {
+			if (__sync_bool_compare_and_swap(c, v, v+1)) { break; }
+		}
+	}
+}
+
+/**
+ * @brief  Raises the transaction ID that negative filter answers are valid from
+ * @param  idx  Index object
+ * @param  xid  Transaction ID that is about to remove keys
+ */
+static void
+filter_advance(EdIdx *idx, EdTxnId xid)
+{
+	EdPgIdx *hdr = idx->hdr;
+	for (EdTxnId x = hdr->filter_xid; x < xid; x = hdr->filter_xid) {
+		if (__sync_bool_compare_and_swap(&hdr->filter_xid, x, xid)) { break; }
+	}
+	__sync_synchronize();
+}
+
+void
+ed_idx_filter_remove(EdIdx *idx, EdTxnId xid, const uint64_t *h, unsigned n)
+{
+	filter_advance(idx, xid);
+
+	for (unsigned k = 0; k < n; k++) {
+		uint8_t *line = filter_line(idx, h[k]);
+		for (unsigned i = 0; i < ED_FILTER_PROBES; i++) {
+			uint8_t *c = &line[filter_probe(h[k], i)];
+			// Saturated counters have lost track of their keys and remain set.
+			for (uint8_t v = *c; v > 0 && v < UINT8_MAX; v = *c) {
+				if (__sync_bool_compare_and_swap(c, v, v-1)) { break; }
+			}
+		}
+	}
+}
+
+void
+ed_idx_filter_clear(EdIdx *idx, EdTxnId xid)
+{
+	filter_advance(idx, xid);
+	memset(idx->filter, 0, (size_t)idx->hdr->filter_count * PAGESIZE);
+}
+
+bool
+ed_idx_filter_has(EdIdx *idx, uint64_t h, EdTxnId xid)
+{
+	const volatile uint8_t *line = filter_line(idx, h);
+	for (unsigned i = 0; i < ED_FILTER_PROBES; i++) {
+		if (line[filter_probe(h, i)] == 0) {
+			// Keys in the snapshot may have been removed by a newer transaction.
+			__sync_synchronize();
+			return idx->hdr->filter_xid > xid;
+		}
+	}
+	return true;
+}
+
+void
+ed_idx_clock_mark(EdIdx *idx, EdBlkno no)
+{
+	uint8_t *b = &idx->clock[no / 8];
+	uint8_t m = (uint8_t)(1 << (no % 8));
+	// Avoid dirtying the cache line when the bit is already set.
+	if (!(*(volatile uint8_t *)b & m)) {
+		__sync_fetch_and_or(b, m);
+	}
+}
+
+bool
+ed_idx_clock_take(EdIdx *idx, EdBlkno no)
+{
+	uint8_t *b = &idx->clock[no / 8];
+	uint8_t m = (uint8_t)(1 << (no % 8));
+	if (!(*(volatile uint8_t *)b & m)) { return false; }
+	return __sync_fetch_and_and(b, (uint8_t)~m) & m;
+}
+
+/**
+ * @brief  Gets the sketch line for a key hash
+ * @param  idx  Index object
+ * @param  h  Key hash
+ * @return  Pointer to the first counter of the line
+ */
+static inline uint8_t *
+sketch_line(EdIdx *idx, uint64_t h)
+{
+	size_t nlines = (size_t)idx->hdr->sketch_count * (PAGESIZE / ED_SKETCH_LINE);
+	return idx->sketch + ((h >> 32) & (nlines - 1)) * ED_SKETCH_LINE;
+}
+
+/**
+ * @brief  Halves every counter in the sketch
+ * @param  idx  Index object
+ */
+static void
+sketch_age(EdIdx *idx)
+{
+	uint8_t *c = idx->sketch;
+	uint8_t *e = c + (size_t)idx->hdr->sketch_count * PAGESIZE;
+	// Increments racing with this are lost, which only lowers a few estimates.
+	for (; c < e; c++) {
+		if (*c) { *c >>= 1; }
+	}
+}
+
+void
+ed_idx_sketch_add(EdIdx *idx, uint64_t h)
+{
+	EdPgIdx *hdr = idx->hdr;
+	uint8_t *line = sketch_line(idx, h);
+	for (unsigned i = 0; i < ED_SKETCH_PROBES; i++) {
+		uint8_t *c = &line[(unsigned)(h >> (i * 6)) % ED_SKETCH_LINE];
+		for (uint8_t v = *c; v < UINT8_MAX; v = *c) {
+			if (__sync_bool_compare_and_swap(c, v, v+1)) { break; }
+		}
+	}
+	// Only the lookup that reaches the limit ages the sketch.
+	if (__sync_add_and_fetch(&hdr->sketch_ops, 1) == hdr->sketch_limit) {
+		sketch_age(idx);
+		__sync_sub_and_fetch(&hdr->sketch_ops, hdr->sketch_limit);
+	}
+}
+
+unsigned
+ed_idx_sketch_get(EdIdx *idx, uint64_t h)
+{
+	const volatile uint8_t *line = sketch_line(idx, h);
+	unsigned min = UINT8_MAX;
+	for (unsigned i = 0; i < ED_SKETCH_PROBES; i++) {
+		uint8_t v = line[(unsigned)(h >> (i * 6)) % ED_SKETCH_LINE];
+		if (v < min) { min = v; }
+	}
+	return min;
+}
+
+/**
+ * @brief  Extends the persistent mapping to cover the current file size
+ *
+ * The address range is reserved up front so that pointers into the mapping
+ * remain stable as it grows. Other processes may have extended the file, so
+ * the size is taken from the file rather than the header.
+ *
+ * @param  idx  Index object
+ * @return  0 on success, <0 error code
+ */
+static int
+idx_map_grow(EdIdx *idx)
+{
+	if (idx->map == NULL) {
+		void *p = mmap(NULL, (size_t)ED_IDX_MAP_MAX*PAGESIZE, PROT_NONE,
+				MAP_PRIVATE|MAP_ANON|MAP_NORESERVE, -1, 0);
+		if (p == MAP_FAILED) { return ED_ERRNO; }
+		idx->map = p;
+		idx->mapcount = 0;
+	}
+
+	struct stat stat;
+	if (fstat(idx->fd, &stat) < 0) { return ED_ERRNO; }
+	off_t size = stat.st_size / PAGESIZE;
+	EdPgno count = size < ED_IDX_MAP_MAX ? (EdPgno)size : ED_IDX_MAP_MAX;
+	if (count <= idx->mapcount) { return 0; }
+
+	void *p = mmap(idx->map + (size_t)idx->mapcount*PAGESIZE,
+			(size_t)(count - idx->mapcount)*PAGESIZE, PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_FIXED, idx->fd, (off_t)idx->mapcount*PAGESIZE);
+	if (p == MAP_FAILED) { return ED_ERRNO; }
+	__atomic_store_n(&idx->mapcount, count, __ATOMIC_RELEASE);
+	return 0;
+}
+
+EdPg *
+ed_idx_map(EdIdx *idx, EdPgno no)
+{
+	if (no == ED_PG_NONE) {
+		errno = EINVAL;
+		return MAP_FAILED;
+	}
+	EdPgno mapcount = __atomic_load_n(&idx->mapcount, __ATOMIC_ACQUIRE);
+	if (no >= mapcount && no < ED_IDX_MAP_MAX) {
+		pthread_mutex_lock(&idx->mtx);
+		int rc = no < idx->mapcount ? 0 : idx_map_grow(idx);
+		mapcount = idx->mapcount;
+		pthread_mutex_unlock(&idx->mtx);
+		// The only failures are system calls, so errno is already set.
+		if (rc < 0) { return MAP_FAILED; }
+	}
+	if (no < mapcount) {
+		return (EdPg *)(idx->map + (size_t)no*PAGESIZE);
+	}
+	return ed_pg_map(idx->fd, no, 1, true);
+}
+
+void
+ed_idx_unmap(EdIdx *idx, void *pg)
+{
+	uint8_t *p = pg;
+	EdPgno mapcount = __atomic_load_n(&idx->mapcount, __ATOMIC_ACQUIRE);
+	if (mapcount == 0 || p < idx->map ||
+			p >= idx->map + (size_t)mapcount*PAGESIZE) {
+		ed_pg_unmap(pg, 1);
+	}
 }
 
 int
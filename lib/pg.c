@@ -25,6 +25,30 @@ ed_blk_unmap(void *p, EdBlkno count, uint16_t size)
 	return ed_pg_unmap(m, pgcount);
 }
 
+/**
+ * @brief  Writes back the pages of a mapped block range
+ *
+ * Only the pages spanning the blocks are synced, so dirty pages written by
+ * other objects in the same file are not forced out with them. When #ED_FASYNC
+ * is set, the writeback is started without waiting for it to complete.
+ *
+ * @param  p  Mapped address of the first block
+ * @param  count  Number of blocks
+ * @param  size  Size of each block
+ * @param  flags  Behavior modification flags
+ * @return  0 on success, <0 on error
+ */
+int
+ed_blk_sync(void *p, EdBlkno count, uint16_t size, uint64_t flags)
+{
+	uint8_t *m = (uint8_t *)p - ((uintptr_t)p % PAGESIZE);
+	size_t len = (size_t)ed_count_pg((count * size) + ((uint8_t *)p - m)) * PAGESIZE;
+	if (msync(m, len, (flags & ED_FASYNC) ? MS_ASYNC : MS_SYNC) < 0) {
+		return ED_ERRNO;
+	}
+	return 0;
+}
+
 void *
 ed_pg_map(int fd, EdPgno no, EdPgno count, bool need)
 {
@@ -363,6 +387,29 @@ ed_pg_mark_gc(EdIdx *idx, EdStat *stat)
 	return rc;
 }
 
+int
+ed_pg_mark_active(EdIdx *idx, EdStat *stat)
+{
+	int rc = 0;
+	for (EdPgno n = 0; n < idx->hdr->nactive; n++) {
+		ed_stat_mark(stat, idx->hdr->active[n]);
+	}
+
+	EdPgno no = idx->hdr->active_next;
+	while (no != ED_PG_NONE) {
+		EdPgActive *act = ed_pg_map(idx->fd, no, 1, true);
+		if (act == MAP_FAILED) { return ED_ERRNO; }
+		rc = ed_stat_mark(stat, no);
+		for (EdPgno n = 0; rc >= 0 && n < act->npages; n++) {
+			rc = ed_stat_mark(stat, act->pages[n]);
+		}
+		no = act->next;
+		ed_pg_unmap(act, 1);
+		if (rc < 0) { break; }
+	}
+	return rc;
+}
+
 int
 ed_alloc(EdIdx *idx, EdPg **pg, EdPgno npg, bool need)
 {
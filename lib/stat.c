@@ -34,6 +34,7 @@ ed_stat_new(EdStat **statp, EdIdx *idx, uint64_t flags)
 	if (rc < 0) { return rc; }
 
 	EdBpt *trees[ED_NDB] = { NULL };
+	EdTxnId xid = 0;
 	EdPgno tail_start = idx->hdr->tail_start;
 	EdPgno tail_count = idx->hdr->tail_count;
 	EdPgno no = tail_start + tail_count;
@@ -54,11 +55,37 @@ ed_stat_new(EdStat **statp, EdIdx *idx, uint64_t flags)
 		for (size_t p = 0; p < hdr; p++) {
 			ED_BIT_SET(stat->vec, p);
 		}
+		if (idx->hdr->filter_start != ED_PG_NONE) {
+			for (EdPgno p = 0; p < idx->hdr->filter_count; p++) {
+				ED_BIT_SET(stat->vec, idx->hdr->filter_start + p);
+			}
+		}
+		if (idx->hdr->clock_start != ED_PG_NONE) {
+			for (EdPgno p = 0; p < idx->hdr->clock_count; p++) {
+				ED_BIT_SET(stat->vec, idx->hdr->clock_start + p);
+			}
+		}
+		if (idx->hdr->sketch_start != ED_PG_NONE) {
+			for (EdPgno p = 0; p < idx->hdr->sketch_count; p++) {
+				ED_BIT_SET(stat->vec, idx->hdr->sketch_start + p);
+			}
+		}
+		if (idx->hdr->tier_start != ED_PG_NONE) {
+			ED_BIT_SET(stat->vec, idx->hdr->tier_start);
+		}
+		if (idx->hdr->ring_start != ED_PG_NONE) {
+			ED_BIT_SET(stat->vec, idx->hdr->ring_start);
+		}
+		if (idx->hdr->pin_start != ED_PG_NONE) {
+			for (EdPgno p = 0; p < ED_PIN_PAGES; p++) {
+				ED_BIT_SET(stat->vec, idx->hdr->pin_start + p);
+			}
+		}
 		for (EdPgno p = idx->hdr->tail_start; p < no; p++) {
 			ED_BIT_SET(stat->vec, p);
 		}
 
-		rc = ed_idx_acquire_snapshot(idx, trees);
+		rc = ed_idx_acquire_snapshot(idx, trees, &xid);
 
 		if (rc == 0) {
 			EdConn *conn = idx->hdr->conns;
@@ -74,10 +101,10 @@ ed_stat_new(EdStat **statp, EdIdx *idx, uint64_t flags)
 			}
 
 			stat->mark = &stat->nactive;
-			for (EdPgno n = 0; n < idx->hdr->nactive; n++) {
-				ed_stat_mark(stat, idx->hdr->active[n]);
-			}
+			rc = ed_pg_mark_active(idx, stat);
+		}
 
+		if (rc == 0) {
 			stat->mark = &stat->ngc;
 			rc = ed_pg_mark_gc(idx, stat);
 		}
@@ -92,7 +119,7 @@ ed_stat_new(EdStat **statp, EdIdx *idx, uint64_t flags)
 		}
 	}
 
-	ed_idx_release_snapshot(idx, trees);
+	ed_idx_release_snapshot(idx, trees, xid);
 
 	if (rc < 0) { free(stat); }
 	else { *statp = stat; }
@@ -184,6 +211,13 @@ ed_stat_print(EdStat *stat, FILE *out)
 	if (stat->flags & ED_FCHECKSUM) { fprintf(out, "  - ED_FCHECKSUM\n"); }
 	if (stat->flags & ED_FPAGEALIGN) { fprintf(out, "  - ED_FPAGEALIGN\n"); }
 	if (stat->flags & ED_FKEEPOLD) { fprintf(out, "  - ED_FKEEPOLD\n"); }
+	if (stat->flags & ED_FSLABPIN) { fprintf(out, "  - ED_FSLABPIN\n"); }
+	if (stat->flags & ED_FFILTER) { fprintf(out, "  - ED_FFILTER\n"); }
+	if (stat->flags & ED_FCLOCK) { fprintf(out, "  - ED_FCLOCK\n"); }
+	if (stat->flags & ED_FADMIT) { fprintf(out, "  - ED_FADMIT\n"); }
+	if (stat->flags & ED_FTIER) { fprintf(out, "  - ED_FTIER\n"); }
+	if (stat->flags & ED_FRING) { fprintf(out, "  - ED_FRING\n"); }
+	if (stat->flags & ED_FPACK) { fprintf(out, "  - ED_FPACK\n"); }
 	fprintf(out,
 		"  pages:\n"
 		"    total: %zu\n"
@@ -57,6 +57,121 @@ node_wrap(EdTxn *txn, EdPg *pg, EdNode *par, uint16_t pidx)
 	return n;
 }
 
+/**
+ * @brief  Records newly allocated pages in the active list
+ *
+ * Pages are recorded in the index header until it is full. Any remaining
+ * pages are recorded in the #EdPgActive overflow list, allocating new overflow
+ * pages as needed. New overflow pages are pushed onto the head of the list.
+ *
+ * @param  idx  Index object
+ * @param  pg  Array of allocated pages
+ * @param  n  Number of pages in #pg
+ * @return  0 on success, <0 on error
+ */
+static int
+active_add(EdIdx *idx, EdPg **pg, unsigned n)
+{
+	EdPgIdx *hdr = idx->hdr;
+	EdPgno nactive = hdr->nactive;
+	unsigned i = 0;
+
+	for (; i < n && nactive < ed_len(hdr->active); i++) {
+		hdr->active[nactive++] = pg[i]->no;
+	}
+	hdr->nactive = nactive;
+	if (i == n) { return 0; }
+
+	EdPgActive *act = NULL;
+	if (hdr->active_next != ED_PG_NONE) {
+		act = ed_pg_map(idx->fd, hdr->active_next, 1, true);
+		if (act == MAP_FAILED) { return ED_ERRNO; }
+	}
+
+	int rc = 0;
+	while (i < n) {
+		if (act == NULL || act->npages == ed_len(act->pages)) {
+			EdPg *next = NULL;
+			rc = ed_alloc(idx, &next, 1, true);
+			if (rc < 0) { break; }
+			rc = 0;
+
+			// The new page is only referenced by the header once it is a valid
+			// empty list. A failure prior to this leaks the page.
+			EdPgActive *head = (EdPgActive *)next;
+			head->base.type = ED_PG_ACTIVE;
+			head->next = hdr->active_next;
+			head->npages = 0;
+			hdr->active_next = head->base.no;
+			if (act != NULL) { ed_pg_unmap(act, 1); }
+			act = head;
+		}
+		act->pages[act->npages] = pg[i++]->no;
+		act->npages++;
+	}
+
+	if (act != NULL) { ed_pg_unmap(act, 1); }
+	return rc;
+}
+
+/**
+ * @brief  Releases the active overflow list into the free list
+ *
+ * The overflow list must already be detached from the index header.
+ *
+ * @param  idx  Index object
+ * @param  no  Page number of the head of the overflow list
+ * @param  all  Also free the pages recorded in the list
+ * @return  0 on success, <0 on error
+ */
+static int
+active_free(EdIdx *idx, EdPgno no, bool all)
+{
+	int rc = 0;
+	while (rc == 0 && no != ED_PG_NONE) {
+		EdPgActive *act = ed_pg_map(idx->fd, no, 1, true);
+		if (act == MAP_FAILED) { return ED_ERRNO; }
+		EdPgno next = act->next;
+		if (all) {
+			rc = ed_free_pgno(idx, 0, act->pages, act->npages);
+		}
+		ed_pg_unmap(act, 1);
+		if (rc == 0) {
+			rc = ed_free_pgno(idx, 0, &no, 1);
+		}
+		no = next;
+	}
+	return rc;
+}
+
+/**
+ * @brief  Releases cached pages that are no longer pending for the connection
+ *
+ * Pages kept by a reset transaction are recorded as pending for the connection.
+ * If another transaction on the same connection has since been opened for
+ * writing, these pages were returned to the free list and must not be used.
+ *
+ * @param  txn  Transaction object holding the write lock
+ */
+static void
+pending_retain(EdTxn *txn)
+{
+	EdConn *conn = txn->idx->conn;
+	EdPgno npg = txn->npg, npending = conn->npending;
+	for (EdPgno j = 0, i; j < npg; ) {
+		EdPgno no = txn->pg[j]->no;
+		for (i = 0; i < npending && no != conn->pending[i]; i++) {}
+		if (i == npending) {
+			ed_pg_unmap(txn->pg[j], 1);
+			txn->pg[j] = txn->pg[--npg];
+		}
+		else {
+			j++;
+		}
+	}
+	txn->npg = npg;
+}
+
 int
 ed_txn_new(EdTxn **txnp, EdIdx *idx)
 {
@@ -82,6 +197,8 @@ ed_txn_new(EdTxn **txnp, EdIdx *idx)
 
 	txn->db[ED_DB_KEYS].entry_size = sizeof(EdEntryKey);
 	txn->db[ED_DB_BLOCKS].entry_size = sizeof(EdEntryBlock);
+	txn->db[ED_DB_EXPIRY].entry_size = sizeof(EdEntryExp);
+	txn->db[ED_DB_TIER].entry_size = sizeof(EdEntryBlock);
 
 	for (unsigned i = 0; i < ed_len(txn->db); i++) {
 		EdPgno *no = &idx->hdr->tree[i];
@@ -117,8 +234,11 @@ ed_txn_open(EdTxn *txn, uint64_t flags)
 		if (rc < 0) { return rc; }
 	}
 
-	rc = ed_idx_acquire_snapshot(txn->idx, txn->roots);
-	if (rc < 0) { return rc; };
+	rc = ed_idx_acquire_snapshot(txn->idx, txn->roots, &txn->rxid);
+	if (rc < 0) {
+		if (!rdonly) { ed_lck(&txn->idx->lck, txn->idx->fd, ED_LCK_UN, flags); }
+		return rc;
+	}
 
 	for (int i = 0; i < ED_NDB; i++) {
 		txn->db[i].find = txn->db[i].root = txn->roots[i] ?
@@ -129,7 +249,13 @@ ed_txn_open(EdTxn *txn, uint64_t flags)
 	if (!rdonly) {
 		EdPgIdx *hdr = txn->idx->hdr;
 		txn->xid = hdr->xid + 1;
-		txn->vno = txn->idx->hdr->vno;
+		txn->vno[0] = hdr->vno;
+		for (unsigned i = 1; txn->idx->ring && i < txn->idx->ring->count; i++) {
+			txn->vno[i] = txn->idx->ring->rings[i].vno;
+		}
+		txn->tvno = txn->idx->tier ? txn->idx->tier->vno : 0;
+		txn->pvno = hdr->pack_vno;
+		txn->pcount = hdr->pack_count;
 
 		// Any active pages at this point are a result from an abandoned transaction.
 		// These could be reused right away, but for simlicity they are moved into
@@ -141,24 +267,28 @@ ed_txn_open(EdTxn *txn, uint64_t flags)
 			rc = ed_free_pgno(txn->idx, 0, hdr->active, nactive);
 			if (rc < 0) {
 				hdr->nactive = nactive;
-				ed_lck(&txn->idx->lck, txn->idx->fd, ED_LCK_UN, flags);
-				return rc;
+				goto error;
 			}
 			memset(hdr->active, 0xff, sizeof(hdr->active));
 		}
+		EdPgno active_next = hdr->active_next;
+		if (active_next != ED_PG_NONE) {
+			hdr->active_next = ED_PG_NONE;
+			rc = active_free(txn->idx, active_next, true);
+			if (rc < 0) { goto error; }
+		}
 
 		// Split pending pages into active and inactive groups. Active pages are the
 		// pages mapped into the transaction page cache. Inactive pages need to be
 		// returned to the free list, and active pages get recorded in the active list.
 		EdConn *conn = txn->idx->conn;
 		assert(conn->npending <= ed_len(conn->pending));
+		pending_retain(txn);
 		EdPgno inactive[ed_len(conn->pending)], ninactive = 0;
 		EdPgno npg = txn->npg, npending = conn->npending;
 		for (EdPgno i = 0, j; i < npending; i++) {
 			EdPgno no = conn->pending[i];
-			for (j = 0; j < npg && no == txn->pg[j]->no; j++) {
-				if (no == txn->pg[j]->no) { break; }
-			}
+			for (j = 0; j < npg && no != txn->pg[j]->no; j++) {}
 			if (j == npg) { inactive[ninactive++] = no; }
 		}
 		if (npending > 0) {
@@ -179,15 +309,30 @@ ed_txn_open(EdTxn *txn, uint64_t flags)
 	txn->isrdonly = rdonly;
 	txn->state = ED_TXN_OPEN;
 	return 0;
+
+error:
+	ed_idx_release_xid(txn->idx, txn->rxid);
+	txn->rxid = 0;
+	ed_lck(&txn->idx->lck, txn->idx->fd, ED_LCK_UN, flags);
+	return rc;
 }
 
 static void
-flush_active(EdPgIdx *hdr)
+flush_active(EdIdx *idx)
 {
+	EdPgIdx *hdr = idx->hdr;
 	if (hdr->nactive) {
 		hdr->nactive = 0;
 		memset(hdr->active, 0xff, sizeof(hdr->active));
 	}
+
+	// The overflow pages are no longer needed, but the pages listed within them
+	// are now owned by the transaction. If this fails, the overflow pages leak.
+	EdPgno active_next = hdr->active_next;
+	if (active_next != ED_PG_NONE) {
+		hdr->active_next = ED_PG_NONE;
+		active_free(idx, active_next, false);
+	}
 }
 
 int
@@ -209,7 +354,7 @@ ed_txn_commit(EdTxn **txnp, uint64_t flags)
 
 	// Unmark all the active pages. This will leave them unreferenced until the
 	// close completes. A crash/kill during this period necessitates a repair.
-	flush_active(hdr);
+	flush_active(txn->idx);
 	ed_fault_trigger(ACTIVE_CLEARED);
 
 	// Shift over any unused pages to the start of the array. When closed, these
@@ -228,11 +373,21 @@ ed_txn_commit(EdTxn **txnp, uint64_t flags)
 
 	// Updating the tree pages first means a reader could hold an xid that is
 	// older than the committed tree pages. This is still a valid state, however,
-	// the opposite is not.
+	// the opposite is not. Only the first two trees fit in the atomic update, so
+	// the others are written just before it.
+	for (unsigned i = sizeof(update.vtree)/sizeof(update.tree[0]); i < ed_len(txn->db); i++) {
+		hdr->tree[i] = update.tree[i];
+	}
 	hdr->vtree = update.vtree;
 	ed_fault_trigger(UPDATE_TREE);
 	hdr->xid = txn->xid;
-	hdr->vno = txn->vno;
+	for (unsigned i = 1; txn->idx->ring && i < txn->idx->ring->count; i++) {
+		txn->idx->ring->rings[i].vno = txn->vno[i];
+	}
+	hdr->vno = txn->vno[0];
+	if (txn->idx->tier) { txn->idx->tier->vno = txn->tvno; }
+	hdr->pack_vno = txn->pvno;
+	hdr->pack_count = txn->pcount;
 
 	// Pass all replaced pages to be reused. If this fails they are leaked.
 	ed_free_pgno(txn->idx, txn->xid, txn->gc, txn->ngcused);
@@ -274,7 +429,7 @@ ed_txn_close(EdTxn **txnp, uint64_t flags)
 		for (int i = (int)nodes->nused-1; i >= 0; i--) {
 			EdNode *node = &nodes->nodes[i];
 			if (node->page && (state == ED_TXN_COMMITTED || node->tree->xid != xid)) {
-				ed_pg_unmap(node->page, 1);
+				ed_idx_unmap(txn->idx, node->page);
 			}
 			node->page = NULL;
 		}
@@ -301,20 +456,21 @@ ed_txn_close(EdTxn **txnp, uint64_t flags)
 	else if (npg > 0) {
 		if (ed_lck(&txn->idx->lck, txn->idx->fd, ED_LCK_EX, flags) == 0) {
 			locked = true;
+			pending_retain(txn);
+			npg = txn->npg;
 		}
 	}
 
 	if (flags & ED_FRESET) {
-		if (txn->state ) {
-			ed_idx_release_xid(txn->idx);
-		}
+		ed_idx_release_xid(txn->idx, txn->rxid);
 	}
 	else {
-		ed_idx_release_snapshot(txn->idx, txn->roots);
+		ed_idx_release_snapshot(txn->idx, txn->roots, txn->rxid);
 	}
+	txn->rxid = 0;
 
 	if (locked) {
-		flush_active(txn->idx->hdr);
+		flush_active(txn->idx);
 
 		EdConn *conn = txn->idx->conn;
 		ed_fault_trigger(PENDING_BEGIN);
@@ -337,9 +493,20 @@ ed_txn_close(EdTxn **txnp, uint64_t flags)
 		ed_fault_trigger(PENDING_FINISH);
 		ed_free(txn->idx, 0, pg, npg);
 
+		// Publish that all pages for the current xid are written. Any sync that
+		// starts after this point includes them.
+		EdPgIdx *hdr = txn->idx->hdr;
+		__sync_synchronize();
+		hdr->xid_written = hdr->xid;
+
 		ed_lck(&txn->idx->lck, txn->idx->fd, ED_LCK_UN, flags);
 		if (!(flags & ED_FNOSYNC)) {
-			fsync(txn->idx->fd);
+			if (state == ED_TXN_COMMITTED && (flags & ED_FGROUPSYNC)) {
+				ed_idx_sync(txn->idx, xid, flags);
+			}
+			else {
+				fsync(txn->idx->fd);
+			}
 		}
 	}
 
@@ -377,14 +544,16 @@ ed_txn_close(EdTxn **txnp, uint64_t flags)
 }
 
 EdBlkno
-ed_txn_vno(const EdTxn *txn)
+ed_txn_vno(const EdTxn *txn, unsigned ring)
 {
 	ED_TXN_CHECK_RD(txn);
 
+	if (ring >= ED_RING_MAX) { return 0; }
 	if (ed_txn_isrdonly(txn)) {
-		return txn->idx->hdr->vno;
+		if (ring == 0) { return txn->idx->hdr->vno; }
+		return txn->idx->ring ? txn->idx->ring->rings[ring].vno : 0;
 	}
-	return txn->vno;
+	return txn->vno[ring];
 }
 
 int
@@ -395,7 +564,57 @@ ed_txn_set_vno(EdTxn *txn, EdBlkno vno)
 	if (ed_txn_isrdonly(txn)) {
 		return ED_EINDEX_RDONLY;
 	}
-	txn->vno = vno;
+	txn->vno[ed_vno_ring(vno)] = vno;
+	return 0;
+}
+
+EdBlkno
+ed_txn_tvno(const EdTxn *txn)
+{
+	ED_TXN_CHECK_RD(txn);
+
+	if (txn->idx->tier == NULL) { return 0; }
+	if (ed_txn_isrdonly(txn)) {
+		return txn->idx->tier->vno;
+	}
+	return txn->tvno;
+}
+
+int
+ed_txn_set_tvno(EdTxn *txn, EdBlkno vno)
+{
+	ED_TXN_CHECK_WR(txn);
+
+	if (ed_txn_isrdonly(txn)) {
+		return ED_EINDEX_RDONLY;
+	}
+	txn->tvno = vno;
+	return 0;
+}
+
+EdBlkno
+ed_txn_pvno(const EdTxn *txn, unsigned *count)
+{
+	ED_TXN_CHECK_RD(txn);
+
+	if (ed_txn_isrdonly(txn)) {
+		*count = txn->idx->hdr->pack_count;
+		return txn->idx->hdr->pack_vno;
+	}
+	*count = txn->pcount;
+	return txn->pvno;
+}
+
+int
+ed_txn_set_pvno(EdTxn *txn, EdBlkno vno, unsigned count)
+{
+	ED_TXN_CHECK_WR(txn);
+
+	if (ed_txn_isrdonly(txn)) {
+		return ED_EINDEX_RDONLY;
+	}
+	txn->pvno = vno;
+	txn->pcount = count;
 	return 0;
 }
 
@@ -432,7 +651,7 @@ ed_txn_map(EdTxn *txn, EdPgno no, EdNode *par, uint16_t pidx, EdNode **out)
 		if (rc < 0) { return (txn->error = rc); }
 	}
 
-	EdPg *pg = ed_pg_map(txn->idx->fd, no, 1, true);
+	EdPg *pg = ed_idx_map(txn->idx, no);
 	if (pg == MAP_FAILED) { return (txn->error = ED_ERRNO); }
 	*out = node_wrap(txn, pg, par, pidx);
 	return 0;
@@ -464,25 +683,16 @@ ed_txn_alloc(EdTxn *txn, EdNode *par, uint16_t pidx, EdNode **out)
 			}
 		}
 
-		EdPgIdx *hdr = txn->idx->hdr;
-		EdPgno nactive = hdr->nactive;
-
 		unsigned nalloc = txn->npgslot - npg;
 		int rc = ed_alloc(txn->idx, txn->pg+npg, nalloc, true);
 		if (rc < 0) { return (txn->error = rc); }
-
-		if (nactive + nalloc > ed_len(hdr->active)) {
-			nalloc = ed_len(hdr->active) - nactive;
-		}
-
-		// Mark as many pages as active that will fit. If the transaction is
-		// abandoned, excess pages can only be recovered during a repair.
-		for (unsigned i = 0; i < nalloc; i++) {
-			hdr->active[nactive++] = txn->pg[npg+i]->no;
-		}
 		txn->npg = txn->npgslot;
-		assert(nactive <= ed_len(hdr->active));
-		hdr->nactive = nactive;
+
+		// Mark the pages as active. If this fails, the pages are still owned by
+		// the transaction, but they can only be recovered during a repair if the
+		// transaction is abandoned.
+		rc = active_add(txn->idx, txn->pg+npg, nalloc);
+		if (rc < 0) { return (txn->error = rc); }
 	}
 
 	assert(txn->nodes != NULL);
@@ -64,6 +64,23 @@ verify_tree(int fd, EdPgno no, bool tryprint)
 	return rc;
 }
 
+static int
+tree_depth(int fd, EdPgno no)
+{
+	int depth = 0;
+	while (no != ED_PG_NONE) {
+		EdBpt *bt = NULL;
+		if (ed_pg_load(fd, (EdPg **)&bt, no, true) == MAP_FAILED) {
+			return ED_ERRNO;
+		}
+		depth++;
+		// The first pointer of a branch leads to its left-most child.
+		no = bt->base.type == ED_PG_BRANCH ? ed_fetch32(bt->data) : ED_PG_NONE;
+		ed_pg_unload((EdPg **)&bt);
+	}
+	return depth;
+}
+
 static void
 cleanup(void)
 {
@@ -88,6 +105,7 @@ setup(EdTxn **txn)
 	// Testing hack. Don't do this!
 	x->db[0].entry_size = sizeof(Entry);
 	x->db[1].entry_size = sizeof(Entry);
+	x->db[2].entry_size = sizeof(Entry);
 
 	*txn = x;
 }
@@ -760,6 +778,90 @@ test_remove_large(void)
 	finish(&txn);
 }
 
+static void
+test_remove_rebalance(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdTxn *txn;
+
+	setup(&txn);
+
+	for (unsigned seed = 0, i = 0; i < LARGE; i++) {
+		Entry ent = { .key = get_random(&seed) };
+		snprintf(ent.name, sizeof(ent.name), "a%u", i);
+		if (i % 1000 == 0) { mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0); }
+		mu_assert_int_eq(ed_bpt_find(txn, 0, ent.key, NULL), 0);
+		mu_assert_int_eq(ed_bpt_set(txn, 0, &ent, false), 0);
+		if (i % 1000 == 999 || i == LARGE-1) { mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0); }
+	}
+
+	mu_assert_int_eq(verify_tree(idx.fd, idx.hdr->tree[0], false), 0);
+	mu_assert_int_eq(tree_depth(idx.fd, idx.hdr->tree[0]), 3);
+
+	// Remove all but every 50th entry.
+	for (unsigned seed = 0, i = 0; i < LARGE; i++) {
+		int key = get_random(&seed);
+		if (i % 500 == 0) { mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0); }
+		if (i % 50 != 0) {
+			mu_assert_int_eq(ed_bpt_find(txn, 0, key, NULL), 1);
+			mu_assert_int_eq(ed_bpt_del(txn, 0), 1);
+		}
+		if (i % 500 == 499 || i == LARGE-1) { mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0); }
+	}
+
+	mu_assert_int_eq(verify_tree(idx.fd, idx.hdr->tree[0], false), 0);
+	mu_assert_int_eq(tree_depth(idx.fd, idx.hdr->tree[0]), 2);
+
+	for (unsigned seed = 0, i = 0; i < LARGE; i++) {
+		Entry *ent;
+		int key = get_random(&seed);
+		mu_assert_int_eq(ed_txn_open(txn, ED_FRDONLY|FOPEN), 0);
+		if (i % 50 == 0) {
+			char name[64];
+			snprintf(name, sizeof(name), "a%u", i);
+			mu_assert_int_eq(ed_bpt_find(txn, 0, key, (void **)&ent), 1);
+			mu_assert_str_eq(ent->name, name);
+		}
+		else {
+			mu_assert_int_eq(ed_bpt_find(txn, 0, key, NULL), 0);
+		}
+		ed_txn_close(&txn, FRESET);
+	}
+
+	// Remove all but every 40th remaining entry while iterating. This leaves
+	// too few entries to fill more than one leaf.
+	unsigned remain = (LARGE + 49) / 50;
+	Entry *ent;
+	mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
+	mu_assert_int_eq(ed_bpt_first(txn, 0, (void **)&ent), 0);
+	for (unsigned i = 0; i < remain; i++) {
+		if (i % 40 != 0) {
+			mu_assert_int_eq(ed_bpt_del(txn, 0), 1);
+		}
+		mu_assert_int_eq(ed_bpt_next(txn, 0, (void **)&ent), 0);
+	}
+	mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
+
+	mu_assert_int_eq(verify_tree(idx.fd, idx.hdr->tree[0], true), 0);
+	mu_assert_int_eq(tree_depth(idx.fd, idx.hdr->tree[0]), 1);
+
+	uint64_t last = 0;
+	unsigned count = 0;
+	mu_assert_int_eq(ed_txn_open(txn, ED_FRDONLY|FOPEN), 0);
+	for (int rc = ed_bpt_first(txn, 0, (void **)&ent);
+			rc == 0 && ed_bpt_loop(txn, 0) == 0;
+			rc = ed_bpt_next(txn, 0, (void **)&ent), count++) {
+		mu_assert_uint_gt(ent->key, last);
+		last = ent->key;
+	}
+	ed_txn_close(&txn, FRESET);
+	mu_assert_uint_eq(count, (remain + 39) / 40);
+
+	finish(&txn);
+}
+
 static void
 test_multi(void)
 {
@@ -1456,6 +1558,118 @@ test_no_find(void)
 	finish(&txn);
 }
 
+static int
+cmp_key(const void *a, const void *b)
+{
+	uint64_t ka = ed_fetch64(a), kb = ed_fetch64(b);
+	return ka < kb ? -1 : ka > kb;
+}
+
+static uint32_t
+search_linear(const uint8_t *k, uint32_t n, size_t stride, uint64_t key)
+{
+	uint32_t i = 0;
+	while (i < n && ed_fetch64(k + i*stride) < key) { i++; }
+	return i;
+}
+
+static void
+check_search(const uint8_t *k, uint32_t n, size_t stride)
+{
+	for (uint32_t i = 0; i < n; i++) {
+		uint64_t key = ed_fetch64(k + i*stride);
+		mu_assert_uint_eq(ed_bpt_search(k, n, stride, key), search_linear(k, n, stride, key));
+		mu_assert_uint_eq(ed_bpt_search(k, n, stride, key-1), search_linear(k, n, stride, key-1));
+		mu_assert_uint_eq(ed_bpt_search(k, n, stride, key+1), search_linear(k, n, stride, key+1));
+	}
+	mu_assert_uint_eq(ed_bpt_search(k, n, stride, 0), search_linear(k, n, stride, 0));
+	mu_assert_uint_eq(ed_bpt_search(k, n, stride, UINT64_MAX), search_linear(k, n, stride, UINT64_MAX));
+}
+
+static double
+elapsed(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)(now.tv_sec - start->tv_sec) +
+		(double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void
+test_search(void)
+{
+	uint32_t n = ed_leaf_order(sizeof(Entry));
+	Entry *ents = calloc(n, sizeof(*ents));
+	uint8_t *branch = calloc(ed_branch_order(), 12);
+	mu_assert_ptr_ne(ents, NULL);
+	mu_assert_ptr_ne(branch, NULL);
+
+	// Hash keys, as in the key tree.
+	for (uint32_t i = 0; i < n; i++) {
+		ents[i].key = ed_hash((const uint8_t *)&i, sizeof(i), 0);
+	}
+	qsort(ents, n, sizeof(*ents), cmp_key);
+	check_search((uint8_t *)ents, n, sizeof(*ents));
+
+	// Sequential keys, as in the block tree.
+	for (uint32_t i = 0; i < n; i++) {
+		ents[i].key = 1000 + i*3;
+	}
+	check_search((uint8_t *)ents, n, sizeof(*ents));
+
+	// Clustered keys with duplicates.
+	for (uint32_t i = 0; i < n; i++) {
+		ents[i].key = i < n/2 ? i/4 : UINT64_MAX - (n - i)/3;
+	}
+	check_search((uint8_t *)ents, n, sizeof(*ents));
+
+	// Hash keys at the branch stride.
+	uint32_t bn = ed_branch_order() - 1;
+	for (uint32_t i = 0; i < bn; i++) {
+		uint64_t key = ed_hash((const uint8_t *)&i, sizeof(i), 1);
+		memcpy(branch + i*12, &key, sizeof(key));
+	}
+	qsort(branch, bn, 12, cmp_key);
+	check_search(branch, bn, 12);
+
+	// Compare against a linear scan on hash keys. The timings are only
+	// printed with BENCH=1, but the results are checked either way.
+	for (uint32_t i = 0; i < n; i++) {
+		ents[i].key = ed_hash((const uint8_t *)&i, sizeof(i), 0);
+	}
+	qsort(ents, n, sizeof(*ents), cmp_key);
+
+	enum { ROUNDS = 200000 };
+	struct timespec start;
+	uint64_t slinear = 0, ssearch = 0;
+	double tlinear, tsearch;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (uint32_t i = 0; i < ROUNDS; i++) {
+		uint64_t key = ed_hash((const uint8_t *)&i, sizeof(i), 2);
+		slinear += search_linear((uint8_t *)ents, n, sizeof(*ents), key);
+	}
+	tlinear = elapsed(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (uint32_t i = 0; i < ROUNDS; i++) {
+		uint64_t key = ed_hash((const uint8_t *)&i, sizeof(i), 2);
+		ssearch += ed_bpt_search(ents, n, sizeof(*ents), key);
+	}
+	tsearch = elapsed(&start);
+
+	mu_assert_uint_eq(ssearch, slinear);
+
+	char *p = getenv("BENCH");
+	if (p && strcmp(p, "1") == 0) {
+		fprintf(stderr, "leaf search (%u keys, %d rounds): linear %.3fms, interpolation %.3fms\n",
+				n, ROUNDS, tlinear*1000.0, tsearch*1000.0);
+	}
+
+	free(branch);
+	free(ents);
+}
+
 int
 main(void)
 {
@@ -1482,6 +1696,7 @@ main(void)
 	mu_run(test_split_middle_branch);
 	mu_run(test_remove_small);
 	mu_run(test_remove_large);
+	mu_run(test_remove_rebalance);
 	mu_run(test_multi);
 	mu_run(test_iter);
 	mu_run(test_iter_reverse);
@@ -1492,6 +1707,7 @@ main(void)
 	mu_run(test_key_range_set_less);
 	mu_run(test_key_range_del);
 	mu_run(test_no_find);
+	mu_run(test_search);
 	return 0;
 }
 
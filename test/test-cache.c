@@ -1,6 +1,9 @@
 #include "../lib/eddy-private.h"
 #include "mu.h"
 
+#include <sys/socket.h>
+#include <sys/wait.h>
+
 static EdConfig cfg = {
 	.index_path = "./test/tmp/test_cache",
 	.slab_path = "./test/tmp/slab",
@@ -48,11 +51,1668 @@ test_create(void)
 	ed_cache_close(&cache);
 }
 
+static void
+create_pattern(EdCache *cache, const char *key, size_t len)
+{
+	EdObject *obj = NULL;
+	EdObjectAttr attr = {
+		.datalen = len,
+		.key = key,
+		.keylen = strlen(key),
+		.metalen = 0,
+	};
+
+	mu_assert_int_eq(ed_create(cache, &obj, &attr), 0);
+	for (size_t i = 0; i < len; i++) {
+		uint8_t c = (uint8_t)(i % 251);
+		mu_assert_int_eq(ed_write(obj, &c, 1), 1);
+	}
+	mu_assert_int_eq(ed_close(&obj), 0);
+}
+
+static void
+assert_pattern(const uint8_t *buf, size_t off, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		mu_assert_uint_eq(buf[i], (off + i) % 251);
+	}
+}
+
+static void
+test_splice(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &cfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	create_pattern(cache, "splice", 12000);
+
+	EdObject *obj = NULL;
+	uint8_t buf[12000];
+	int fds[2];
+
+	// Splice directly into a pipe, resuming from the object cursor.
+	mu_assert_int_eq(pipe(fds), 0);
+	mu_assert_int_eq(ed_open(cache, &obj, "splice", 6, 0), 1);
+	mu_assert_int_eq(ed_splice(obj, fds[1], 1000), 1000);
+	mu_assert_int_eq(read(fds[0], buf, sizeof(buf)), 1000);
+	assert_pattern(buf, 0, 1000);
+	mu_assert_int_eq(ed_splice(obj, fds[1], SIZE_MAX), 11000);
+	mu_assert_int_eq(ed_splice(obj, fds[1], SIZE_MAX), 0);
+	mu_assert_int_eq(read(fds[0], buf, sizeof(buf)), 11000);
+	assert_pattern(buf, 1000, 11000);
+	mu_assert_int_eq(ed_close(&obj), 0);
+	close(fds[0]);
+	close(fds[1]);
+
+	// Splice into a regular file through the intermediate pipe.
+	const char *path = "./test/tmp/test_splice";
+	int fd = open(path, O_CREAT|O_TRUNC|O_RDWR, 0640);
+	mu_assert_int_ge(fd, 0);
+	mu_assert_int_eq(ed_open(cache, &obj, "splice", 6, 0), 1);
+	size_t total = 0;
+	ssize_t n;
+	while ((n = ed_splice(obj, fd, 5000)) > 0) {
+		total += (size_t)n;
+	}
+	mu_assert_int_eq(n, 0);
+	mu_assert_uint_eq(total, 12000);
+	mu_assert_int_eq(ed_close(&obj), 0);
+	mu_assert_int_eq(pread(fd, buf, sizeof(buf), 0), 12000);
+	assert_pattern(buf, 0, 12000);
+	close(fd);
+	unlink(path);
+
+	ed_cache_close(&cache);
+}
+
+static void
+test_sendfile(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &cfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	create_pattern(cache, "sendfile", 8000);
+
+	EdObject *obj = NULL;
+	uint8_t buf[8000];
+	int fds[2];
+
+	mu_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+	mu_assert_int_eq(ed_open(cache, &obj, "sendfile", 8, 0), 1);
+	mu_assert_int_eq(ed_sendfile(obj, fds[0], 3000), 3000);
+	mu_assert_int_eq(ed_sendfile(obj, fds[0], SIZE_MAX), 5000);
+	mu_assert_int_eq(ed_sendfile(obj, fds[0], SIZE_MAX), 0);
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	size_t total = 0;
+	while (total < sizeof(buf)) {
+		ssize_t n = read(fds[1], buf+total, sizeof(buf)-total);
+		mu_assert_int_gt(n, 0);
+		total += (size_t)n;
+	}
+	assert_pattern(buf, 0, sizeof(buf));
+	close(fds[0]);
+	close(fds[1]);
+
+	ed_cache_close(&cache);
+}
+
+static void
+test_open_many(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &cfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	char buf[200][16];
+	const void *keys[200];
+	size_t lens[200];
+	EdObject *objs[200];
+
+	for (int i = 0; i < 200; i++) {
+		lens[i] = snprintf(buf[i], sizeof(buf[i]), "key-%d", i);
+		keys[i] = buf[i];
+		if (i % 4 != 3) {
+			create_pattern(cache, buf[i], 100 + i);
+		}
+	}
+
+	mu_assert_int_eq(ed_open_many(cache, keys, lens, ed_len(keys), objs), 150);
+	for (int i = 0; i < 200; i++) {
+		if (i % 4 == 3) {
+			mu_assert_ptr_eq(objs[i], NULL);
+			continue;
+		}
+		mu_assert_ptr_ne(objs[i], NULL);
+		mu_assert_int_eq(objs[i]->keylen, lens[i]);
+		mu_assert(memcmp(objs[i]->key, keys[i], lens[i]) == 0);
+		size_t len;
+		const void *val = ed_value(objs[i], &len);
+		mu_assert_uint_eq(len, 100 + i);
+		assert_pattern(val, 0, len);
+		mu_assert_int_eq(ed_close(&objs[i]), 0);
+	}
+
+	mu_assert_int_eq(ed_open_many(cache, keys, lens, 0, objs), 0);
+
+	ed_cache_close(&cache);
+}
+
+static void
+test_exists(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &cfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	char buf[200][16];
+	const void *keys[200];
+	size_t lens[200];
+	bool found[200];
+
+	for (int i = 0; i < 200; i++) {
+		lens[i] = snprintf(buf[i], sizeof(buf[i]), "key-%d", i);
+		keys[i] = buf[i];
+		if (i % 4 != 3) {
+			create_pattern(cache, buf[i], 100 + i);
+		}
+	}
+
+	mu_assert_int_eq(ed_exists(cache, "key-0", 5), 1);
+	mu_assert_int_eq(ed_exists(cache, "key-3", 5), 0);
+	mu_assert_int_eq(ed_exists(cache, "other", 5), 0);
+
+	mu_assert_int_eq(ed_contains_many(cache, keys, lens, ed_len(keys), found), 150);
+	for (int i = 0; i < 200; i++) {
+		mu_assert_int_eq(found[i], i % 4 != 3);
+	}
+
+	// Neither check holds a slab lock.
+	mu_assert_uint_eq(cache->nlcks, 0);
+
+	mu_assert_int_eq(ed_unlink(cache, "key-0", 5), 1);
+	mu_assert_int_eq(ed_exists(cache, "key-0", 5), 0);
+	mu_assert_int_eq(ed_contains_many(cache, keys, lens, ed_len(keys), found), 149);
+	mu_assert(!found[0]);
+
+	mu_assert_int_eq(ed_contains_many(cache, keys, lens, 0, found), 0);
+
+	ed_cache_close(&cache);
+}
+
+static void
+test_filter(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdConfig fcfg = cfg;
+	fcfg.flags |= ED_FFILTER;
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &fcfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+	mu_assert_ptr_ne(cache->idx.filter, NULL);
+	mu_assert_uint_ne(cache->idx.hdr->filter_start, ED_PG_NONE);
+
+	EdIdx *idx = &cache->idx;
+	char key[32];
+	int nmiss = 0;
+
+	for (int i = 0; i < 200; i++) {
+		snprintf(key, sizeof(key), "key-%d", i);
+		if (i % 4 != 3) {
+			create_pattern(cache, key, 100 + i);
+		}
+	}
+	for (int i = 0; i < 200; i++) {
+		int len = snprintf(key, sizeof(key), "key-%d", i);
+		bool has = ed_idx_filter_has(idx, ed_hash((uint8_t *)key, len, idx->seed), idx->hdr->xid);
+		if (i % 4 != 3) {
+			mu_assert(has);
+			mu_assert_int_eq(ed_exists(cache, key, len), 1);
+		}
+		else {
+			if (!has) { nmiss++; }
+			mu_assert_int_eq(ed_exists(cache, key, len), 0);
+		}
+	}
+	mu_assert_int_gt(nmiss, 40);
+
+	// Removals from an abandoned batch are not applied.
+	EdBatch *batch;
+	mu_assert_int_eq(ed_batch_open(cache, &batch), 0);
+	mu_assert_int_eq(ed_batch_unlink(batch, "key-1", 5), 1);
+	ed_batch_discard(&batch);
+	mu_assert(ed_idx_filter_has(idx, ed_hash((uint8_t *)"key-1", 5, idx->seed), idx->hdr->xid));
+	mu_assert_int_eq(ed_exists(cache, "key-1", 5), 1);
+
+	// Additions from an abandoned batch leave the filter counts unchanged.
+	size_t fsize = (size_t)idx->hdr->filter_count * PAGESIZE;
+	uint8_t *fcopy = malloc(fsize);
+	mu_assert_ptr_ne(fcopy, NULL);
+	memcpy(fcopy, idx->filter, fsize);
+	EdObjectAttr attr = { .key = "key-3", .keylen = 5 };
+	mu_assert_int_eq(ed_batch_open(cache, &batch), 0);
+	mu_assert_int_eq(ed_batch_set(batch, &attr, "value", 5, -1), 0);
+	mu_assert_int_eq(memcmp(fcopy, idx->filter, fsize), 0);
+	ed_batch_discard(&batch);
+	mu_assert_int_eq(memcmp(fcopy, idx->filter, fsize), 0);
+	mu_assert_int_eq(ed_exists(cache, "key-3", 5), 0);
+	free(fcopy);
+
+	// A key removed and set again in the same batch remains.
+	attr.key = "key-2";
+	mu_assert_int_eq(ed_batch_open(cache, &batch), 0);
+	mu_assert_int_eq(ed_batch_unlink(batch, "key-2", 5), 1);
+	mu_assert_int_eq(ed_batch_set(batch, &attr, "value", 5, -1), 0);
+	mu_assert_int_eq(ed_batch_commit(&batch), 0);
+	mu_assert(ed_idx_filter_has(idx, ed_hash((uint8_t *)"key-2", 5, idx->seed), idx->hdr->xid));
+	mu_assert_int_eq(ed_exists(cache, "key-2", 5), 1);
+
+	EdTxnId xid = idx->hdr->xid;
+	mu_assert_int_eq(ed_unlink(cache, "key-0", 5), 1);
+	mu_assert_int_gt(idx->hdr->filter_xid, xid);
+	mu_assert_int_eq(ed_exists(cache, "key-0", 5), 0);
+
+	// Wrap the slab so that objects are evicted. Every remaining key entry must
+	// still pass the filter.
+	static uint8_t buf[10000];
+	for (int i = 0; i < 2000; i++) {
+		attr.key = key;
+		attr.keylen = snprintf(key, sizeof(key), "wrap-%d", i);
+		mu_assert_int_eq(ed_set(cache, &attr, buf, sizeof(buf), -1), 0);
+	}
+
+	EdTxn *txn;
+	EdEntryKey *ent;
+	int n = 0;
+	mu_assert_int_eq(ed_txn_new(&txn, idx), 0);
+	mu_assert_int_eq(ed_txn_open(txn, idx->flags|ED_FRDONLY), 0);
+	for (rc = ed_bpt_first(txn, ED_DB_KEYS, (void **)&ent);
+			rc >= 0 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
+			rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&ent)) {
+		mu_assert(ed_idx_filter_has(idx, ent->hash, txn->rxid));
+		n++;
+	}
+	mu_assert_int_ge(rc, 0);
+	mu_assert_int_gt(n, 1000);
+	ed_txn_close(&txn, idx->flags);
+	mu_assert_int_eq(ed_exists(cache, "key-4", 5), 0);
+
+	EdStat *stat;
+	mu_assert_int_eq(ed_stat_new(&stat, idx, 0), 0);
+	mu_assert(!ed_stat_has_leaks(stat));
+	mu_assert_uint_eq(stat->nmultused, 0);
+	ed_stat_free(&stat);
+
+	ed_cache_close(&cache);
+}
+
+static size_t
+read_entries(EdCache *cache, unsigned db, void *ents, size_t esize, size_t max)
+{
+	EdTxn *txn;
+	void *ent;
+	size_t n = 0;
+	int rc;
+	mu_assert_int_eq(ed_txn_new(&txn, &cache->idx), 0);
+	mu_assert_int_eq(ed_txn_open(txn, cache->idx.flags|ED_FRDONLY), 0);
+	for (rc = ed_bpt_first(txn, db, &ent);
+			rc >= 0 && ed_bpt_loop(txn, db) == 0;
+			rc = ed_bpt_next(txn, db, &ent)) {
+		mu_assert_uint_lt(n, max);
+		memcpy((uint8_t *)ents + n*esize, ent, esize);
+		n++;
+	}
+	mu_assert_int_ge(rc, 0);
+	ed_txn_close(&txn, cache->idx.flags);
+	return n;
+}
+
+static void
+assert_rebuilt(EdCache *cache)
+{
+	EdObject *obj = NULL;
+	const void *val;
+	size_t len;
+	char key[32];
+
+	for (int i = 2900; i < 3000; i++) {
+		int n = snprintf(key, sizeof(key), "key-%d", i);
+		if (i % 10 == 1) {
+			mu_assert_int_eq(ed_open(cache, &obj, key, n, 0), 0);
+			continue;
+		}
+		mu_assert_int_eq(ed_open(cache, &obj, key, n, 0), 1);
+		val = ed_value(obj, &len);
+		mu_assert_uint_eq(len, 10000);
+		mu_assert_uint_eq(((const uint8_t *)val)[len-1], (i % 10 == 2 ? i+1 : i) % 256);
+		mu_assert_int_eq(ed_close(&obj), 0);
+	}
+	mu_assert_int_eq(ed_open(cache, &obj, "key-0", 5, 0), 0);
+
+	EdStat *stat;
+	mu_assert_int_eq(ed_stat_new(&stat, &cache->idx, 0), 0);
+	mu_assert(!ed_stat_has_leaks(stat));
+	mu_assert_uint_eq(stat->nmultused, 0);
+	ed_stat_free(&stat);
+}
+
+static void
+test_rebuild(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdConfig fcfg = cfg;
+	fcfg.flags |= ED_FFILTER;
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &fcfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	// Wrap the slab, then replace and remove some of the remaining keys.
+	static uint8_t buf[10000];
+	char key[32];
+	EdObjectAttr attr = { .key = key };
+	for (int i = 0; i < 3000; i++) {
+		memset(buf, i % 256, sizeof(buf));
+		attr.keylen = snprintf(key, sizeof(key), "key-%d", i);
+		mu_assert_int_eq(ed_set(cache, &attr, buf, sizeof(buf), -1), 0);
+	}
+	for (int i = 2900; i < 3000; i += 10) {
+		memset(buf, (i+3) % 256, sizeof(buf));
+		attr.keylen = snprintf(key, sizeof(key), "key-%d", i+2);
+		mu_assert_int_eq(ed_set(cache, &attr, buf, sizeof(buf), -1), 0);
+		attr.keylen = snprintf(key, sizeof(key), "key-%d", i+1);
+		mu_assert_int_eq(ed_unlink(cache, key, attr.keylen), 1);
+	}
+
+	static EdEntryKey keys[2][4096];
+	static EdEntryBlock blocks[2][4096];
+	size_t nkeys = read_entries(cache, ED_DB_KEYS, keys[0], sizeof(keys[0][0]), 4096);
+	size_t nblocks = read_entries(cache, ED_DB_BLOCKS, blocks[0], sizeof(blocks[0][0]), 4096);
+	EdBlkno vno = cache->idx.hdr->vno;
+	mu_assert_uint_gt(nkeys, 1000);
+	mu_assert_uint_ge(nblocks, nkeys);
+
+	// Rebuilding the current index reproduces the same key entries. Block
+	// entries of replaced objects are left out.
+	mu_assert_int_eq(ed_cache_rebuild(cache, 4), 0);
+	mu_assert_uint_eq(cache->idx.hdr->vno, vno);
+	mu_assert_uint_eq(read_entries(cache, ED_DB_KEYS, keys[1], sizeof(keys[1][0]), 4096), nkeys);
+	mu_assert(memcmp(keys[0], keys[1], nkeys * sizeof(keys[0][0])) == 0);
+	nblocks = read_entries(cache, ED_DB_BLOCKS, blocks[1], sizeof(blocks[1][0]), 4096);
+	mu_assert_uint_eq(nblocks, nkeys);
+	for (size_t i = 0, j = 0; i < nblocks; i++, j++) {
+		while (blocks[0][j].no != blocks[1][i].no) { j++; }
+		mu_assert(memcmp(&blocks[0][j], &blocks[1][i], sizeof(blocks[0][0])) == 0);
+	}
+	assert_rebuilt(cache);
+	const uint64_t seed = cache->idx.seed;
+	ed_cache_close(&cache);
+
+	// The key hashes only match with the seed of the slab.
+	fcfg.flags |= ED_FREPLACE;
+	fcfg.flags &= ~ED_FALLOCATE;
+	fcfg.seed = seed + 1;
+	rc = ed_cache_open(&cache, &fcfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+	mu_assert_int_eq(ed_cache_rebuild(cache, 0), ED_EINDEX_SEED);
+	ed_cache_close(&cache);
+
+	// A new index for the same slab recovers the objects.
+	fcfg.seed = seed;
+	rc = ed_cache_open(&cache, &fcfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+	mu_assert_int_eq(ed_cache_rebuild(cache, 0), 0);
+	mu_assert_uint_eq(read_entries(cache, ED_DB_KEYS, keys[1], sizeof(keys[1][0]), 4096), nkeys);
+	mu_assert_uint_eq(cache->idx.hdr->vno % cache->slab_block_count, vno % cache->slab_block_count);
+	assert_rebuilt(cache);
+
+	// New objects continue from the recovered slab position.
+	memset(buf, 0, sizeof(buf));
+	attr.keylen = snprintf(key, sizeof(key), "key-%d", 2999);
+	mu_assert_int_eq(ed_set(cache, &attr, buf, sizeof(buf), -1), 0);
+	mu_assert_int_eq(ed_exists(cache, "key-2998", 8), 1);
+	mu_assert_int_eq(ed_exists(cache, "key-2999", 8), 1);
+
+	// An object written by a batch that was never committed is left out.
+	EdBatch *batch;
+	attr.key = "abandoned";
+	attr.keylen = 9;
+	mu_assert_int_eq(ed_batch_open(cache, &batch), 0);
+	mu_assert_int_eq(ed_batch_set(batch, &attr, buf, sizeof(buf), -1), 0);
+	ed_batch_discard(&batch);
+	mu_assert_int_eq(ed_cache_rebuild(cache, 2), 0);
+	mu_assert_int_eq(ed_exists(cache, "abandoned", 9), 0);
+	mu_assert_int_eq(ed_exists(cache, "key-2999", 8), 1);
+
+	ed_cache_close(&cache);
+}
+
+static void
+assert_expiry(EdCache *cache, size_t nexp)
+{
+	static EdEntryKey keys[4096];
+	static EdEntryExp exps[4096];
+	size_t nkeys = read_entries(cache, ED_DB_KEYS, keys, sizeof(keys[0]), ed_len(keys));
+	size_t n = read_entries(cache, ED_DB_EXPIRY, exps, sizeof(exps[0]), ed_len(exps));
+	size_t nfinite = 0;
+	for (size_t i = 0; i < nkeys; i++) {
+		if (keys[i].exp != ED_TIME_INF) { nfinite++; }
+	}
+	mu_assert_uint_eq(n, nfinite);
+	if (nexp > 0) {
+		mu_assert_uint_eq(n, nexp);
+	}
+	for (size_t i = 0; i < n; i++) {
+		if (i > 0) {
+			mu_assert_uint_le(exps[i-1].key, exps[i].key);
+		}
+		size_t j = 0;
+		while (j < nkeys && (keys[j].hash != exps[i].hash || keys[j].vno != exps[i].vno)) { j++; }
+		mu_assert_uint_lt(j, nkeys);
+		mu_assert_uint_eq(keys[j].exp, ed_entry_exp_time(&exps[i]));
+	}
+}
+
+static void
+test_reap(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdConfig fcfg = cfg;
+	fcfg.flags |= ED_FFILTER;
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &fcfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	// Nothing is reaped from an empty index.
+	mu_assert_int_eq(ed_cache_reap(cache, 0), 0);
+
+	char key[32];
+	EdObjectAttr attr = { .key = key };
+	for (int i = 0; i < 200; i++) {
+		attr.keylen = snprintf(key, sizeof(key), "key-%d", i);
+		mu_assert_int_eq(ed_set(cache, &attr, "value", 5, i % 4 == 0 ? -1 : 1000), 0);
+	}
+	assert_expiry(cache, 150);
+
+	// Expire half of the keys.
+	EdTimeUnix past = ed_now_unix() - 10;
+	for (int i = 0; i < 200; i++) {
+		if (i % 4 < 2) { continue; }
+		attr.keylen = snprintf(key, sizeof(key), "key-%d", i);
+		mu_assert_int_eq(ed_update_expiry(cache, key, attr.keylen, past, false), 1);
+	}
+	assert_expiry(cache, 150);
+
+	mu_assert_int_eq(ed_cache_reap(cache, 10), 10);
+	mu_assert_int_eq(ed_cache_reap(cache, 0), 90);
+	mu_assert_int_eq(ed_cache_reap(cache, 0), 0);
+	assert_expiry(cache, 50);
+
+	static EdEntryBlock blocks[4096];
+	mu_assert_uint_eq(read_entries(cache, ED_DB_BLOCKS, blocks, sizeof(blocks[0]), ed_len(blocks)), 100);
+	for (int i = 0; i < 200; i++) {
+		int n = snprintf(key, sizeof(key), "key-%d", i);
+		mu_assert_int_eq(ed_exists(cache, key, n), i % 4 < 2);
+	}
+
+	// Replacing and updating keys moves their expiry entries.
+	attr.keylen = snprintf(key, sizeof(key), "key-%d", 1);
+	mu_assert_int_eq(ed_set(cache, &attr, "value", 5, -1), 0);
+	assert_expiry(cache, 49);
+	mu_assert_int_eq(ed_update_ttl(cache, "key-0", 5, 500, false), 1);
+	assert_expiry(cache, 50);
+	mu_assert_int_eq(ed_unlink(cache, "key-0", 5), 1);
+	assert_expiry(cache, 49);
+
+	// Objects evicted by wrapping the slab remove their expiry entries.
+	static uint8_t buf[10000];
+	for (int i = 0; i < 2000; i++) {
+		attr.keylen = snprintf(key, sizeof(key), "wrap-%d", i);
+		mu_assert_int_eq(ed_set(cache, &attr, buf, sizeof(buf), i % 2 ? 1000 : -1), 0);
+	}
+	assert_expiry(cache, 0);
+	mu_assert_int_eq(ed_exists(cache, "wrap-1999", 9), 1);
+
+	EdStat *stat;
+	mu_assert_int_eq(ed_stat_new(&stat, &cache->idx, 0), 0);
+	mu_assert(!ed_stat_has_leaks(stat));
+	mu_assert_uint_eq(stat->nmultused, 0);
+	ed_stat_free(&stat);
+
+	ed_cache_close(&cache);
+}
+
+static void
+test_clock(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdConfig ccfg = cfg;
+	ccfg.flags |= ED_FCLOCK;
+	ccfg.clock_percent = 10;
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &ccfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+	mu_assert_uint_eq(cache->idx.hdr->clock_budget, cache->slab_block_count / 10);
+
+	static uint8_t buf[10000];
+	char key[32];
+	EdObjectAttr attr = { .key = key };
+
+	for (int i = 0; i < 10; i++) {
+		attr.keylen = snprintf(key, sizeof(key), "hot-%d", i);
+		memset(buf, i, sizeof(buf));
+		mu_assert_int_eq(ed_set(cache, &attr, buf, sizeof(buf), 1000), 0);
+	}
+	mu_assert_int_eq(ed_set(cache, &(EdObjectAttr){ .key = "cold", .keylen = 4 },
+				buf, sizeof(buf), 1000), 0);
+
+	// Write over two passes through the slab while reading the hot keys.
+	EdBlkno passes = 2 * cache->slab_block_count / ED_COUNT_SIZE(sizeof(buf), PAGESIZE);
+	for (EdBlkno n = 0; n < passes; n++) {
+		attr.keylen = snprintf(key, sizeof(key), "fill-%u", (unsigned)n);
+		mu_assert_int_eq(ed_set(cache, &attr, buf, sizeof(buf), -1), 0);
+		if (n % 100 == 0) {
+			for (int i = 0; i < 10; i++) {
+				int len = snprintf(key, sizeof(key), "hot-%d", i);
+				EdObject *obj;
+				mu_assert_int_eq(ed_open(cache, &obj, key, len, 0), 1);
+				ed_close(&obj);
+			}
+		}
+	}
+	mu_assert_uint_le(cache->idx.hdr->clock_used, cache->idx.hdr->clock_budget);
+
+	mu_assert_int_eq(ed_exists(cache, "cold", 4), 0);
+
+	// Every key still in the index must refer to its own object.
+	int nfill = 0;
+	for (EdBlkno n = 0; n < passes; n++) {
+		int len = snprintf(key, sizeof(key), "fill-%u", (unsigned)n);
+		EdObject *obj;
+		int exists = ed_exists(cache, key, len);
+		mu_assert_int_eq(ed_open(cache, &obj, key, len, 0), exists);
+		if (obj != NULL) { ed_close(&obj); }
+		nfill += exists;
+	}
+	mu_assert_int_gt(nfill, 0);
+
+	for (int i = 0; i < 10; i++) {
+		int len = snprintf(key, sizeof(key), "hot-%d", i);
+		EdObject *obj;
+		mu_assert_int_eq(ed_open(cache, &obj, key, len, 0), 1);
+		size_t vlen;
+		const uint8_t *val = ed_value(obj, &vlen);
+		mu_assert_uint_eq(vlen, sizeof(buf));
+		mu_assert_uint_eq(val[0], i);
+		mu_assert_uint_eq(val[vlen-1], i);
+		ed_close(&obj);
+	}
+	assert_expiry(cache, 10);
+
+	// The reinserted objects belong to the current pass when rebuilding.
+	mu_assert_int_eq(ed_cache_rebuild(cache, 2), 0);
+	for (int i = 0; i < 10; i++) {
+		int len = snprintf(key, sizeof(key), "hot-%d", i);
+		mu_assert_int_eq(ed_exists(cache, key, len), 1);
+	}
+
+	EdStat *stat;
+	mu_assert_int_eq(ed_stat_new(&stat, &cache->idx, 0), 0);
+	mu_assert(!ed_stat_has_leaks(stat));
+	ed_stat_free(&stat);
+
+	ed_cache_close(&cache);
+}
+
+static void
+test_admit(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdConfig acfg = cfg;
+	acfg.flags |= ED_FADMIT;
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &acfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	static uint8_t buf[10000];
+	char key[32];
+	EdObjectAttr attr = { .key = key };
+	EdObject *obj;
+
+	for (int i = 0; i < 10; i++) {
+		attr.keylen = snprintf(key, sizeof(key), "hot-%d", i);
+		mu_assert_int_eq(ed_set(cache, &attr, buf, sizeof(buf), -1), 0);
+		for (int n = 0; n < 5; n++) {
+			mu_assert_int_eq(ed_open(cache, &obj, key, attr.keylen, 0), 1);
+			ed_close(&obj);
+		}
+	}
+	uint64_t h = ed_hash((const uint8_t *)"hot-9", 5, cache->idx.seed);
+	mu_assert_uint_ge(ed_idx_sketch_get(&cache->idx, h), 5);
+
+	// Unread objects are admitted until the hot objects would be evicted.
+	int n = 0;
+	for (;; n++) {
+		attr.keylen = snprintf(key, sizeof(key), "fill-%d", n);
+		rc = ed_set(cache, &attr, buf, sizeof(buf), -1);
+		if (rc == ED_EOBJECT_REJECTED) { break; }
+		mu_assert_int_eq(rc, 0);
+	}
+	mu_assert_int_gt(n, 1000);
+	mu_assert_int_eq(ed_exists(cache, key, attr.keylen), 0);
+	for (int i = 0; i < 10; i++) {
+		int len = snprintf(key, sizeof(key), "hot-%d", i);
+		mu_assert_int_eq(ed_exists(cache, key, len), 1);
+	}
+
+	attr.keylen = snprintf(key, sizeof(key), "new");
+	attr.datalen = sizeof(buf);
+	mu_assert_int_eq(ed_create(cache, &obj, &attr), ED_EOBJECT_REJECTED);
+	mu_assert_ptr_eq(obj, NULL);
+
+	// Replacing an existing key is always admitted.
+	attr.keylen = snprintf(key, sizeof(key), "fill-%d", n - 1);
+	mu_assert_int_eq(ed_set(cache, &attr, buf, sizeof(buf), -1), 0);
+
+	// A rejected object does not fail the rest of the batch.
+	EdBatch *batch;
+	mu_assert_int_eq(ed_batch_open(cache, &batch), 0);
+	attr.keylen = snprintf(key, sizeof(key), "new");
+	mu_assert_int_eq(ed_batch_set(batch, &attr, buf, sizeof(buf), -1), ED_EOBJECT_REJECTED);
+	attr.keylen = snprintf(key, sizeof(key), "fill-%d", n - 2);
+	mu_assert_int_eq(ed_batch_set(batch, &attr, buf, sizeof(buf), -1), 0);
+	mu_assert_int_eq(ed_batch_commit(&batch), 0);
+	mu_assert_int_eq(ed_exists(cache, "new", 3), 0);
+
+	// A key looked up more often than the victims is admitted.
+	for (int i = 0; i < 10; i++) {
+		mu_assert_int_eq(ed_open(cache, &obj, "new", 3, 0), 0);
+	}
+	attr.keylen = snprintf(key, sizeof(key), "new");
+	mu_assert_int_eq(ed_set(cache, &attr, buf, sizeof(buf), -1), 0);
+	mu_assert_int_eq(ed_exists(cache, "new", 3), 1);
+	mu_assert_int_eq(ed_exists(cache, "hot-0", 5), 0);
+
+	// Counts are halved once enough lookups have been made.
+	unsigned freq = ed_idx_sketch_get(&cache->idx, h);
+	cache->idx.hdr->sketch_ops = cache->idx.hdr->sketch_limit - 1;
+	mu_assert_int_eq(ed_open(cache, &obj, "hot-9", 5, 0), 1);
+	ed_close(&obj);
+	mu_assert_uint_eq(ed_idx_sketch_get(&cache->idx, h), (freq + 1) / 2);
+	mu_assert_uint_eq(cache->idx.hdr->sketch_ops, 0);
+
+	EdStat *stat;
+	mu_assert_int_eq(ed_stat_new(&stat, &cache->idx, 0), 0);
+	mu_assert(!ed_stat_has_leaks(stat));
+	ed_stat_free(&stat);
+
+	ed_cache_close(&cache);
+}
+
+static void
+assert_tier(EdCache *cache)
+{
+	static EdEntryKey keys[4096];
+	static EdEntryBlock blocks[4096];
+	size_t nkeys = read_entries(cache, ED_DB_KEYS, keys, sizeof(keys[0]), ed_len(keys));
+	size_t n = read_entries(cache, ED_DB_TIER, blocks, sizeof(blocks[0]), ed_len(blocks));
+	size_t ntier = 0;
+	for (size_t i = 0; i < nkeys; i++) {
+		if (!ed_vno_istier(keys[i].vno)) { continue; }
+		ntier++;
+		size_t j = 0;
+		while (j < n && blocks[j].no != (keys[i].vno & ~ED_VNO_TIER) % cache->idx.tier->block_count) { j++; }
+		mu_assert_uint_lt(j, n);
+		mu_assert_uint_eq(blocks[j].keyhash, keys[i].hash);
+	}
+	mu_assert_uint_eq(n, ntier);
+	assert_expiry(cache, 0);
+
+	EdStat *stat;
+	mu_assert_int_eq(ed_stat_new(&stat, &cache->idx, 0), 0);
+	if (ed_stat_has_leaks(stat)) { ed_stat_print(stat, stderr); }
+	mu_assert(!ed_stat_has_leaks(stat));
+	ed_stat_free(&stat);
+}
+
+static void
+assert_tier_value(EdCache *cache, int i)
+{
+	EdObject *obj = NULL;
+	const void *val;
+	size_t len;
+	char key[32];
+	int n = snprintf(key, sizeof(key), "key-%d", i);
+	mu_assert_int_eq(ed_open(cache, &obj, key, n, 0), 1);
+	mu_assert(!ed_vno_istier(obj->vno));
+	val = ed_value(obj, &len);
+	mu_assert_uint_eq(len, 10000);
+	mu_assert_uint_eq(((const uint8_t *)val)[len-1], i % 256);
+	mu_assert_int_eq(ed_close(&obj), 0);
+}
+
+static void
+test_tier(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+	unlink("./test/tmp/tier");
+
+	EdConfig tcfg = cfg;
+	tcfg.flags |= ED_FTIER;
+	tcfg.tier_path = "./test/tmp/tier";
+	tcfg.tier_size = 24*1024*1024;
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &tcfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+	mu_assert_ptr_ne(cache->idx.tier, NULL);
+	mu_assert_uint_eq(cache->idx.tier->block_count, 6144);
+
+	static uint8_t buf[10000];
+	char key[32];
+	EdObjectAttr attr = { .key = key };
+
+	// Objects lapped by the write position remain reachable in the tier slab.
+	for (int i = 0; i < 2000; i++) {
+		attr.keylen = snprintf(key, sizeof(key), "key-%d", i);
+		memset(buf, i, sizeof(buf));
+		mu_assert_int_eq(ed_set(cache, &attr, buf, sizeof(buf), 1000), 0);
+	}
+	mu_assert_uint_gt(cache->idx.tier->vno, 0);
+	for (int i = 0; i < 2000; i++) {
+		int n = snprintf(key, sizeof(key), "key-%d", i);
+		mu_assert_int_eq(ed_exists(cache, key, n), 1);
+	}
+	assert_tier(cache);
+
+	// Opening a tier object copies it back into the slab.
+	EdTxnId xid = cache->idx.hdr->xid;
+	assert_tier_value(cache, 0);
+	mu_assert_uint_gt(cache->idx.hdr->xid, xid);
+	xid = cache->idx.hdr->xid;
+	assert_tier_value(cache, 0);
+	mu_assert_uint_eq(cache->idx.hdr->xid, xid);
+
+	EdObject *objs[3];
+	const void *keys[3] = { "key-1", "key-1999", "key-2" };
+	const size_t lens[3] = { 5, 8, 5 };
+	mu_assert_int_eq(ed_open_many(cache, keys, lens, 3, objs), 3);
+	for (int i = 0; i < 3; i++) {
+		mu_assert_ptr_ne(objs[i], NULL);
+		mu_assert_int_eq(ed_close(&objs[i]), 0);
+	}
+	assert_tier(cache);
+
+	// Tier objects may be updated and unlinked without promoting them.
+	EdBlkno vno = cache->idx.hdr->vno;
+	mu_assert_int_eq(ed_update_ttl(cache, "key-3", 5, 2000, false), 1);
+	mu_assert_int_eq(ed_unlink(cache, "key-4", 5), 1);
+	mu_assert_int_eq(ed_exists(cache, "key-4", 5), 0);
+	mu_assert_uint_eq(cache->idx.hdr->vno, vno);
+	attr.keylen = snprintf(key, sizeof(key), "key-5");
+	memset(buf, 5, sizeof(buf));
+	mu_assert_int_eq(ed_set(cache, &attr, buf, sizeof(buf), 1000), 0);
+	assert_tier(cache);
+
+	// The tier slab is verified when reopening.
+	ed_cache_close(&cache);
+	mu_assert_int_eq(ed_cache_open(&cache, &cfg), 0);
+	mu_assert_ptr_ne(cache->idx.tier, NULL);
+	assert_tier_value(cache, 3);
+
+	// Once the tier slab is also lapped, its oldest objects are evicted.
+	for (int i = 2000; i < 4000; i++) {
+		attr.keylen = snprintf(key, sizeof(key), "key-%d", i);
+		memset(buf, i, sizeof(buf));
+		mu_assert_int_eq(ed_set(cache, &attr, buf, sizeof(buf), 1000), 0);
+	}
+	mu_assert_int_eq(ed_exists(cache, "key-6", 5), 0);
+	assert_tier_value(cache, 1000);
+	assert_tier(cache);
+
+	ed_cache_close(&cache);
+	unlink("./test/tmp/tier");
+}
+
+static void
+test_ring(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	// Rings must leave room for their largest objects.
+	EdConfig rcfg = cfg;
+	rcfg.flags |= ED_FRING;
+	rcfg.ring_limit[0] = 8192;
+	rcfg.ring_percent[0] = 100;
+
+	EdCache *cache = NULL;
+	mu_assert_int_eq(ed_cache_open(&cache, &rcfg), ED_ECONFIG_RING);
+
+	rcfg.ring_percent[0] = 25;
+	int rc = ed_cache_open(&cache, &rcfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+	mu_assert_ptr_ne(cache->idx.ring, NULL);
+	mu_assert_uint_eq(cache->idx.ring->count, 2);
+	mu_assert_uint_eq(cache->idx.ring->rings[0].count, 1024);
+	mu_assert_uint_eq(cache->idx.ring->rings[1].start, 1024);
+	mu_assert_uint_eq(cache->idx.ring->rings[1].count, 3072);
+
+	static uint8_t buf[1024*1024];
+	char key[32];
+	EdObjectAttr attr = { .key = key };
+	EdObject *obj = NULL;
+
+	for (int i = 0; i < 500; i++) {
+		attr.keylen = snprintf(key, sizeof(key), "small-%d", i);
+		memset(buf, i, 100);
+		mu_assert_int_eq(ed_set(cache, &attr, buf, 100, -1), 0);
+	}
+
+	// Large objects lap their own ring without evicting the small objects.
+	for (int i = 0; i < 40; i++) {
+		attr.keylen = snprintf(key, sizeof(key), "large-%d", i);
+		memset(buf, i, sizeof(buf));
+		mu_assert_int_eq(ed_set(cache, &attr, buf, sizeof(buf), -1), 0);
+	}
+	mu_assert_uint_gt(ed_vno_pos(cache->idx.ring->rings[1].vno), 3072);
+	mu_assert_uint_eq(cache->idx.hdr->vno, 500);
+	for (int i = 0; i < 500; i++) {
+		int n = snprintf(key, sizeof(key), "small-%d", i);
+		mu_assert_int_eq(ed_exists(cache, key, n), 1);
+	}
+	mu_assert_int_eq(ed_exists(cache, "large-0", 7), 0);
+
+	mu_assert_int_eq(ed_open(cache, &obj, "large-39", 8, 0), 1);
+	mu_assert_uint_eq(ed_vno_ring(obj->vno), 1);
+	mu_assert_uint_ge(obj->byte / cache->slab_block_size, 1024);
+	mu_assert_uint_eq(obj->datalen, sizeof(buf));
+	mu_assert_uint_eq(((const uint8_t *)obj->data)[sizeof(buf)-1], 39);
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	// Only the first ring is listed.
+	EdList *list = NULL;
+	const EdObject *lobj;
+	int nlist = 0;
+	mu_assert_int_eq(ed_list_open(cache, &list, NULL), 0);
+	while ((rc = ed_list_next(list, &lobj)) == 1) {
+		mu_assert_uint_eq(ed_vno_ring(lobj->vno), 0);
+		nlist++;
+	}
+	mu_assert_int_eq(rc, 0);
+	mu_assert_int_eq(nlist, 500);
+	ed_list_close(&list);
+
+	// Objects larger than the last ring can never be written.
+	attr.keylen = snprintf(key, sizeof(key), "huge");
+	attr.datalen = 13*1024*1024;
+	mu_assert_int_eq(ed_create(cache, &obj, &attr), ED_EOBJECT_TOOBIG);
+	attr.datalen = 0;
+
+	// Rebuilding recovers the write position of each ring.
+	EdBlkno vno[2] = { cache->idx.hdr->vno, cache->idx.ring->rings[1].vno };
+	mu_assert_int_eq(ed_cache_rebuild(cache, 2), 0);
+	mu_assert_uint_eq(cache->idx.hdr->vno, vno[0]);
+	mu_assert_uint_eq(cache->idx.ring->rings[1].vno, vno[1]);
+	mu_assert_int_eq(ed_exists(cache, "small-0", 7), 1);
+	mu_assert_int_eq(ed_exists(cache, "large-39", 8), 1);
+
+	EdStat *stat;
+	mu_assert_int_eq(ed_stat_new(&stat, &cache->idx, 0), 0);
+	if (ed_stat_has_leaks(stat)) { ed_stat_print(stat, stderr); }
+	mu_assert(!ed_stat_has_leaks(stat));
+	ed_stat_free(&stat);
+
+	ed_cache_close(&cache);
+}
+
+static void
+test_pack(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdConfig pcfg = cfg;
+	pcfg.flags |= ED_FPACK;
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &pcfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+	mu_assert_uint_eq(cache->idx.hdr->pack_size, cache->slab_block_size / 4);
+
+	static uint8_t buf[1024*1024];
+	char key[32];
+	EdObjectAttr attr = { .key = key };
+	EdObject *obj = NULL, *byid = NULL;
+
+	for (int i = 0; i < 20; i++) {
+		attr.keylen = snprintf(key, sizeof(key), "pack-%d", i);
+		memset(buf, i, 50);
+		mu_assert_int_eq(ed_set(cache, &attr, buf, 50, -1), 0);
+	}
+	attr.keylen = snprintf(key, sizeof(key), "whole");
+	mu_assert_int_eq(ed_set(cache, &attr, buf, 2000, -1), 0);
+
+	// A batch keeps packing into any block it reserves.
+	EdBatch *batch = NULL;
+	mu_assert_int_eq(ed_batch_open(cache, &batch), 0);
+	for (int i = 0; i < 40; i++) {
+		attr.keylen = snprintf(key, sizeof(key), "batch-%d", i);
+		memset(buf, i, 50);
+		mu_assert_int_eq(ed_batch_set(batch, &attr, buf, 50, -1), 0);
+	}
+	mu_assert_int_eq(ed_batch_commit(&batch), 0);
+	for (int i = 0; i < 40; i++) {
+		int n = snprintf(key, sizeof(key), "batch-%d", i);
+		mu_assert_int_eq(ed_open(cache, &obj, key, n, 0), 1);
+		mu_assert(ed_vno_ispacked(obj->vno));
+		mu_assert_uint_eq(((const uint8_t *)obj->data)[49], i);
+		mu_assert_int_eq(ed_close(&obj), 0);
+	}
+
+	// Small objects share a block but keep their own ids.
+	mu_assert_int_eq(ed_open(cache, &obj, "pack-0", 6, 0), 1);
+	mu_assert(ed_vno_ispacked(obj->vno));
+	const EdBlkno no = obj->byte / cache->slab_block_size;
+	mu_assert_int_eq(ed_close(&obj), 0);
+	for (int i = 1; i < 20; i++) {
+		int n = snprintf(key, sizeof(key), "pack-%d", i);
+		mu_assert_int_eq(ed_open(cache, &obj, key, n, 0), 1);
+		mu_assert(ed_vno_ispacked(obj->vno));
+		mu_assert_uint_eq(obj->byte / cache->slab_block_size, no);
+		mu_assert_uint_eq(obj->datalen, 50);
+		mu_assert_uint_eq(((const uint8_t *)obj->data)[49], i);
+		mu_assert_int_eq(ed_open(cache, &byid, ed_id(obj), 0, ED_OID), 1);
+		mu_assert_uint_eq(byid->vno, obj->vno);
+		mu_assert_int_eq(ed_close(&byid), 0);
+		mu_assert_int_eq(ed_close(&obj), 0);
+	}
+	mu_assert_int_eq(ed_open(cache, &obj, "whole", 5, 0), 1);
+	mu_assert(!ed_vno_ispacked(obj->vno));
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	// Removing one object leaves the rest of the block.
+	mu_assert_int_eq(ed_update_ttl(cache, "pack-2", 6, 1000, false), 1);
+	mu_assert_int_eq(ed_unlink(cache, "pack-3", 6), 1);
+	mu_assert_int_eq(ed_open(cache, &obj, "pack-3", 6, 0), 0);
+	mu_assert_int_eq(ed_open(cache, &obj, "pack-4", 6, 0), 1);
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	EdList *list = NULL;
+	const EdObject *lobj;
+	int nlist = 0;
+	mu_assert_int_eq(ed_list_open(cache, &list, NULL), 0);
+	while ((rc = ed_list_next(list, &lobj)) == 1) {
+		nlist++;
+	}
+	mu_assert_int_eq(rc, 0);
+	mu_assert_int_eq(nlist, 60);
+	ed_list_close(&list);
+
+	// Rebuilding walks the headers within the block.
+	mu_assert_int_eq(ed_cache_rebuild(cache, 2), 0);
+	mu_assert_int_eq(ed_exists(cache, "pack-0", 6), 1);
+	mu_assert_int_eq(ed_exists(cache, "pack-3", 6), 0);
+	mu_assert_int_eq(ed_exists(cache, "batch-39", 8), 1);
+	mu_assert_int_eq(ed_open(cache, &obj, "pack-19", 7, 0), 1);
+	mu_assert(ed_vno_ispacked(obj->vno));
+	mu_assert_uint_eq(((const uint8_t *)obj->data)[49], 19);
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	// Lapping the slab evicts every object in the block.
+	memset(buf, 0xff, sizeof(buf));
+	for (int i = 0; i < 20; i++) {
+		attr.keylen = snprintf(key, sizeof(key), "large-%d", i);
+		mu_assert_int_eq(ed_set(cache, &attr, buf, sizeof(buf), -1), 0);
+	}
+	for (int i = 0; i < 20; i++) {
+		int n = snprintf(key, sizeof(key), "pack-%d", i);
+		mu_assert_int_eq(ed_exists(cache, key, n), 0);
+	}
+
+	EdStat *stat;
+	mu_assert_int_eq(ed_stat_new(&stat, &cache->idx, 0), 0);
+	if (ed_stat_has_leaks(stat)) { ed_stat_print(stat, stderr); }
+	mu_assert(!ed_stat_has_leaks(stat));
+	ed_stat_free(&stat);
+
+	ed_cache_close(&cache);
+}
+
+static void
+test_unlink(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &cfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	create_pattern(cache, "foo", 100);
+	create_pattern(cache, "bar", 100);
+
+	EdObject *obj = NULL;
+	mu_assert_int_eq(ed_open(cache, &obj, "foo", 3, 0), 1);
+	const uint64_t h = obj->hdr->keyhash;
+	const EdBlkno no = obj->vno % cache->slab_block_count;
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	mu_assert_int_eq(ed_unlink(cache, "foo", 3), 1);
+	mu_assert_int_eq(ed_unlink(cache, "foo", 3), 0);
+	mu_assert_int_eq(ed_open(cache, &obj, "foo", 3, 0), 0);
+	mu_assert_int_eq(ed_open(cache, &obj, "bar", 3, 0), 1);
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	// Both the key and block entries must be gone from the index.
+	mu_assert_int_eq(ed_txn_open(cache->txn, cache->idx.flags|ED_FRDONLY), 0);
+	mu_assert_int_eq(ed_bpt_find(cache->txn, ED_DB_KEYS, h, NULL), 0);
+	mu_assert_int_eq(ed_bpt_find(cache->txn, ED_DB_BLOCKS, no, NULL), 0);
+	ed_txn_close(&cache->txn, cache->idx.flags|ED_FRESET);
+
+	// The object can be recreated after unlinking.
+	create_pattern(cache, "foo", 100);
+	mu_assert_int_eq(ed_open(cache, &obj, "foo", 3, 0), 1);
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	ed_cache_close(&cache);
+}
+
+static void
+test_set(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &cfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	EdObject *obj = NULL;
+	EdObjectAttr attr = {
+		.key = "foo",
+		.keylen = 3,
+		.meta = "text/plain",
+		.metalen = 10,
+	};
+	size_t len;
+	const void *val;
+
+	mu_assert_int_eq(ed_set(cache, &attr, "value", 5, -1), 0);
+	mu_assert_int_eq(ed_open(cache, &obj, "foo", 3, 0), 1);
+	val = ed_value(obj, &len);
+	mu_assert_uint_eq(len, 5);
+	mu_assert(memcmp(val, "value", 5) == 0);
+	val = ed_meta(obj, &len);
+	mu_assert_uint_eq(len, 10);
+	mu_assert(memcmp(val, "text/plain", 10) == 0);
+	mu_assert_int_eq(ed_ttl(obj, -1), -1);
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	struct iovec iov[] = {
+		{ .iov_base = "new", .iov_len = 3 },
+		{ .iov_base = " ", .iov_len = 1 },
+		{ .iov_base = "value", .iov_len = 5 },
+	};
+	mu_assert_int_eq(ed_setv(cache, &attr, iov, ed_len(iov), 100), 0);
+	mu_assert_int_eq(ed_open(cache, &obj, "foo", 3, 0), 1);
+	val = ed_value(obj, &len);
+	mu_assert_uint_eq(len, 9);
+	mu_assert(memcmp(val, "new value", 9) == 0);
+	mu_assert_int_le(ed_ttl(obj, -1), 100);
+	mu_assert_int_ge(ed_ttl(obj, -1), 99);
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	// Wrap the slab multiple times.
+	static uint8_t buf[10000];
+	char key[32];
+	for (int i = 0; i < 5000; i++) {
+		memset(buf, i % 256, sizeof(buf));
+		attr.key = key;
+		attr.keylen = snprintf(key, sizeof(key), "key-%d", i);
+		mu_assert_int_eq(ed_set(cache, &attr, buf, sizeof(buf), -1), 0);
+	}
+	for (int i = 4900; i < 5000; i++) {
+		int n = snprintf(key, sizeof(key), "key-%d", i);
+		mu_assert_int_eq(ed_open(cache, &obj, key, n, 0), 1);
+		val = ed_value(obj, &len);
+		mu_assert_uint_eq(len, sizeof(buf));
+		mu_assert_uint_eq(((const uint8_t *)val)[len-1], i % 256);
+		mu_assert_int_eq(ed_close(&obj), 0);
+	}
+	mu_assert_int_eq(ed_open(cache, &obj, "key-0", 5, 0), 0);
+
+	EdStat *stat;
+	mu_assert_int_eq(ed_stat_new(&stat, &cache->idx, 0), 0);
+	mu_assert(!ed_stat_has_leaks(stat));
+	mu_assert_uint_eq(stat->nmultused, 0);
+	ed_stat_free(&stat);
+
+	ed_cache_close(&cache);
+}
+
+static void
+test_batch(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &cfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	EdObject *obj = NULL;
+	EdBatch *batch = NULL;
+	EdObjectAttr attr = { .key = "foo", .keylen = 3 };
+	char key[32];
+	size_t len;
+	const void *val;
+
+	create_pattern(cache, "old", 100);
+	create_pattern(cache, "ttl", 100);
+
+	// Changes are not visible until the batch is committed.
+	mu_assert_int_eq(ed_batch_open(cache, &batch), 0);
+	for (int i = 0; i < 1000; i++) {
+		attr.key = key;
+		attr.keylen = snprintf(key, sizeof(key), "key-%d", i);
+		mu_assert_int_eq(ed_batch_set(batch, &attr, key, attr.keylen, -1), 0);
+	}
+	attr.key = "foo";
+	attr.keylen = 3;
+	mu_assert_int_eq(ed_batch_set(batch, &attr, "first", 5, -1), 0);
+	mu_assert_int_eq(ed_batch_set(batch, &attr, "second", 6, -1), 0);
+	mu_assert_int_eq(ed_batch_update_ttl(batch, "ttl", 3, 100, false), 1);
+	mu_assert_int_eq(ed_batch_update_ttl(batch, "none", 4, 100, false), 0);
+	mu_assert_int_eq(ed_batch_unlink(batch, "old", 3), 1);
+	mu_assert_int_eq(ed_batch_unlink(batch, "old", 3), 0);
+	mu_assert_int_eq(ed_batch_unlink(batch, "key-999", 7), 1);
+	mu_assert_int_eq(ed_open(cache, &obj, "key-0", 5, 0), 0);
+	mu_assert_int_eq(ed_open(cache, &obj, "old", 3, 0), 1);
+	mu_assert_int_eq(ed_close(&obj), 0);
+	mu_assert_int_eq(ed_batch_commit(&batch), 0);
+	mu_assert_ptr_eq(batch, NULL);
+
+	for (int i = 0; i < 999; i++) {
+		int n = snprintf(key, sizeof(key), "key-%d", i);
+		mu_assert_int_eq(ed_open(cache, &obj, key, n, 0), 1);
+		val = ed_value(obj, &len);
+		mu_assert_uint_eq(len, (size_t)n);
+		mu_assert(memcmp(val, key, n) == 0);
+		mu_assert_int_eq(ed_close(&obj), 0);
+	}
+	mu_assert_int_eq(ed_open(cache, &obj, "key-999", 7, 0), 0);
+	mu_assert_int_eq(ed_open(cache, &obj, "old", 3, 0), 0);
+	mu_assert_int_eq(ed_open(cache, &obj, "foo", 3, 0), 1);
+	val = ed_value(obj, &len);
+	mu_assert_uint_eq(len, 6);
+	mu_assert(memcmp(val, "second", 6) == 0);
+	mu_assert_int_eq(ed_close(&obj), 0);
+	mu_assert_int_eq(ed_open(cache, &obj, "ttl", 3, 0), 1);
+	mu_assert_int_le(ed_ttl(obj, -1), 100);
+	mu_assert_int_ge(ed_ttl(obj, -1), 99);
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	// Discarded changes are never applied.
+	mu_assert_int_eq(ed_batch_open(cache, &batch), 0);
+	mu_assert_int_eq(ed_batch_set(batch, &attr, "third", 5, -1), 0);
+	mu_assert_int_eq(ed_batch_unlink(batch, "key-0", 5), 1);
+	ed_batch_discard(&batch);
+	mu_assert_ptr_eq(batch, NULL);
+	mu_assert_int_eq(ed_open(cache, &obj, "foo", 3, 0), 1);
+	val = ed_value(obj, &len);
+	mu_assert_uint_eq(len, 6);
+	mu_assert(memcmp(val, "second", 6) == 0);
+	mu_assert_int_eq(ed_close(&obj), 0);
+	mu_assert_int_eq(ed_open(cache, &obj, "key-0", 5, 0), 1);
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	// Single changes continue to work after a batch.
+	mu_assert_int_eq(ed_set(cache, &attr, "fourth", 6, -1), 0);
+	mu_assert_int_eq(ed_unlink(cache, "key-1", 5), 1);
+
+	EdStat *stat;
+	mu_assert_int_eq(ed_stat_new(&stat, &cache->idx, 0), 0);
+	mu_assert(!ed_stat_has_leaks(stat));
+	mu_assert_uint_eq(stat->nmultused, 0);
+	ed_stat_free(&stat);
+
+	ed_cache_close(&cache);
+}
+
+static void
+test_mapslab(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdConfig mcfg = cfg;
+	mcfg.flags |= ED_FMAPSLAB;
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &mcfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+	mu_assert_ptr_ne(cache->slab, NULL);
+
+	const uint8_t *start = cache->slab;
+	const uint8_t *end = start + cache->slab_block_count * cache->slab_block_size;
+	EdObject *obj = NULL;
+	EdObjectAttr attr = { .key = "foo", .keylen = 3 };
+	char key[32];
+
+	create_pattern(cache, "a", 100);
+	create_pattern(cache, "b", 100);
+	create_pattern(cache, "c", 100);
+
+	EdList *list;
+	const EdObject *lobj;
+	int n = 0;
+	mu_assert_int_eq(ed_list_open(cache, &list, NULL), 0);
+	while ((rc = ed_list_next(list, &lobj)) > 0) {
+		mu_assert((const uint8_t *)lobj->hdr >= start && (const uint8_t *)lobj->hdr < end);
+		n++;
+	}
+	mu_assert_int_eq(rc, 0);
+	mu_assert_int_eq(n, 3);
+	ed_list_close(&list);
+
+	// Wrap the slab so objects are evicted through the shared mapping.
+	static uint8_t buf[10000];
+	for (int i = 0; i < 2000; i++) {
+		memset(buf, i % 256, sizeof(buf));
+		attr.key = key;
+		attr.keylen = snprintf(key, sizeof(key), "key-%d", i);
+		mu_assert_int_eq(ed_set(cache, &attr, buf, sizeof(buf), -1), 0);
+	}
+	create_pattern(cache, "foo", 5000);
+
+	mu_assert_int_eq(ed_open(cache, &obj, "foo", 3, 0), 1);
+	mu_assert((const uint8_t *)obj->hdr >= start && (const uint8_t *)obj->hdr < end);
+	size_t len;
+	const void *val = ed_value(obj, &len);
+	mu_assert_uint_eq(len, 5000);
+	assert_pattern(val, 0, len);
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	mu_assert_int_eq(ed_open(cache, &obj, "key-1999", 8, 0), 1);
+	val = ed_value(obj, &len);
+	mu_assert_uint_eq(len, sizeof(buf));
+	mu_assert_uint_eq(((const uint8_t *)val)[0], 1999 % 256);
+	mu_assert_int_eq(ed_close(&obj), 0);
+	mu_assert_int_eq(ed_open(cache, &obj, "key-0", 5, 0), 0);
+
+	mu_assert_int_eq(ed_update_ttl(cache, "foo", 3, 100, false), 1);
+	mu_assert_int_eq(ed_unlink(cache, "foo", 3), 1);
+	mu_assert_int_eq(ed_open(cache, &obj, "foo", 3, 0), 0);
+
+	ed_cache_close(&cache);
+}
+
+static void
+test_sync(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	static const uint64_t modes[] = { 0, ED_FASYNC, ED_FMAPSLAB };
+
+	for (size_t m = 0; m < ed_len(modes); m++) {
+		EdConfig scfg = cfg;
+		scfg.flags = (scfg.flags & ~ED_FNOSYNC) | modes[m];
+
+		EdCache *cache = NULL;
+		int rc = ed_cache_open(&cache, &scfg);
+		mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+		EdObjectAttr attr = { .key = "set", .keylen = 3 };
+		EdBatch *batch = NULL;
+		EdObject *obj = NULL;
+		char key[32];
+		size_t len;
+
+		create_pattern(cache, "foo", 20000);
+		mu_assert_int_eq(ed_set(cache, &attr, "value", 5, -1), 0);
+
+		mu_assert_int_eq(ed_batch_open(cache, &batch), 0);
+		for (int i = 0; i < 20; i++) {
+			attr.key = key;
+			attr.keylen = snprintf(key, sizeof(key), "batch-%d", i);
+			mu_assert_int_eq(ed_batch_set(batch, &attr, key, attr.keylen, -1), 0);
+		}
+		mu_assert_int_eq(ed_batch_commit(&batch), 0);
+
+		mu_assert_int_eq(ed_open(cache, &obj, "foo", 3, 0), 1);
+		const void *val = ed_value(obj, &len);
+		mu_assert_uint_eq(len, 20000);
+		assert_pattern(val, 0, len);
+		mu_assert_int_eq(ed_close(&obj), 0);
+
+		mu_assert_int_eq(ed_open(cache, &obj, "set", 3, 0), 1);
+		val = ed_value(obj, &len);
+		mu_assert_uint_eq(len, 5);
+		mu_assert_int_eq(memcmp(val, "value", 5), 0);
+		mu_assert_int_eq(ed_close(&obj), 0);
+
+		mu_assert_int_eq(ed_open(cache, &obj, "batch-19", 8, 0), 1);
+		val = ed_value(obj, &len);
+		mu_assert_uint_eq(len, 8);
+		mu_assert_int_eq(memcmp(val, "batch-19", 8), 0);
+		mu_assert_int_eq(ed_close(&obj), 0);
+
+		ed_cache_close(&cache);
+	}
+}
+
+typedef struct {
+	EdCache *cache;
+	int id;
+	int nfound;
+	int rc;
+} ThreadArgs;
+
+static void *
+thread_read(void *data)
+{
+	ThreadArgs *args = data;
+	char key[32];
+	for (int i = 0; i < 2000 && args->rc >= 0; i++) {
+		int n = snprintf(key, sizeof(key), "key-%d", (i * 7 + args->id) % 100);
+		EdObject *obj = NULL;
+		int rc = ed_open(args->cache, &obj, key, n, 0);
+		if (rc < 0) { args->rc = rc; break; }
+		if (rc == 1) {
+			size_t len;
+			const void *val = ed_value(obj, &len);
+			if (len != (size_t)n || memcmp(val, key, len) != 0) {
+				args->rc = -1;
+			}
+			args->nfound++;
+			ed_close(&obj);
+		}
+	}
+	return NULL;
+}
+
+static void *
+thread_write(void *data)
+{
+	ThreadArgs *args = data;
+	char key[32];
+	for (int i = 0; i < 200 && args->rc >= 0; i++) {
+		EdObjectAttr attr = { .key = key };
+		attr.keylen = snprintf(key, sizeof(key), "new-%d-%d", args->id, i);
+		args->rc = ed_set(args->cache, &attr, key, attr.keylen, -1);
+		if (args->rc >= 0) { args->nfound++; }
+	}
+	return NULL;
+}
+
+static void
+test_threads(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &cfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	char key[32];
+	for (int i = 0; i < 100; i++) {
+		EdObjectAttr attr = { .key = key };
+		attr.keylen = snprintf(key, sizeof(key), "key-%d", i);
+		mu_assert_int_eq(ed_set(cache, &attr, key, attr.keylen, -1), 0);
+	}
+
+	pthread_t threads[8];
+	ThreadArgs args[ed_len(threads)];
+	for (size_t i = 0; i < ed_len(threads); i++) {
+		args[i] = (ThreadArgs){ cache, (int)i, 0, 0 };
+		mu_assert_int_eq(pthread_create(&threads[i], NULL,
+					i < 2 ? thread_write : thread_read, &args[i]), 0);
+	}
+	for (size_t i = 0; i < ed_len(threads); i++) {
+		mu_assert_int_eq(pthread_join(threads[i], NULL), 0);
+		mu_assert_int_eq(args[i].rc, 0);
+		mu_assert_int_eq(args[i].nfound, i < 2 ? 200 : 2000);
+	}
+
+	// All readers have finished, so the connection holds no snapshot.
+	mu_assert_uint_eq(cache->idx.nreaders, 0);
+	mu_assert_uint_eq(cache->idx.conn->xid, 0);
+	mu_assert_uint_eq(cache->nlcks, 0);
+
+	EdObject *obj = NULL;
+	mu_assert_int_eq(ed_open(cache, &obj, "new-1-199", 9, 0), 1);
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	ed_cache_close(&cache);
+}
+
+static EdSlabPin *
+find_pin(EdCache *cache, int pid)
+{
+	for (EdPgno i = 0; i < cache->idx.hdr->npins; i++) {
+		EdSlabPin *pin = &cache->idx.pins[i];
+		if (pin->pid == pid && pin->mode != 0) { return pin; }
+	}
+	return NULL;
+}
+
+static void
+test_slabpin(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdConfig pcfg = cfg;
+	pcfg.flags |= ED_FSLABPIN;
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &pcfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+	mu_assert_ptr_ne(cache->idx.pins, NULL);
+	mu_assert_uint_ne(cache->idx.hdr->pin_start, ED_PG_NONE);
+
+	create_pattern(cache, "a", 5000);
+
+	// An open object holds a shared pin that is released when closed.
+	EdObject *obj = NULL;
+	mu_assert_int_eq(ed_open(cache, &obj, "a", 1, 0), 1);
+	EdSlabPin *pin = find_pin(cache, getpid());
+	mu_assert_ptr_ne(pin, NULL);
+	mu_assert_int_eq(pin->mode, ED_PIN_SH);
+	mu_assert_int_eq(ed_close(&obj), 0);
+	mu_assert_ptr_eq(find_pin(cache, getpid()), NULL);
+
+	int ready[2], done[2];
+	mu_assert_call(pipe(ready));
+	mu_assert_call(pipe(done));
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		mu_fail("fork failed '%s'\n", strerror(errno));
+	}
+	if (pid == 0) {
+		EdCache *fcache = NULL;
+		EdObject *fobj = NULL;
+		char c = 0;
+		if (ed_cache_open(&fcache, &pcfg) < 0) { _exit(1); }
+		if (ed_open(fcache, &fobj, "a", 1, 0) != 1) { _exit(1); }
+		if (write(ready[1], &c, 1) != 1) { _exit(1); }
+		if (read(done[0], &c, 1) != 1) { _exit(1); }
+		// Exit while still holding the pin.
+		_exit(0);
+	}
+
+	char c = 0;
+	mu_assert_int_eq(read(ready[0], &c, 1), 1);
+
+	// The other process holds the object, so an exclusive pin must fail.
+	pin = find_pin(cache, pid);
+	mu_assert_ptr_ne(pin, NULL);
+	off_t start = pin->start, len = pin->len;
+	mu_assert_int_eq(ed_idx_pin(&cache->idx, ED_LCK_EX, start, len), ed_esys(EAGAIN));
+	mu_assert_int_eq(ed_idx_pin(&cache->idx, ED_LCK_SH, start, len), 0);
+	ed_idx_unpin(&cache->idx, start, len);
+
+	mu_assert_int_eq(write(done[1], &c, 1), 1);
+	int status;
+	mu_assert_call(waitpid(pid, &status, 0));
+	mu_assert_int_eq(WEXITSTATUS(status), 0);
+
+	// The pin of the exited process is reclaimed.
+	mu_assert_ptr_ne(find_pin(cache, pid), NULL);
+	mu_assert_int_eq(ed_idx_pin(&cache->idx, ED_LCK_EX, start, len), 0);
+	mu_assert_ptr_eq(find_pin(cache, pid), NULL);
+	ed_idx_unpin(&cache->idx, start, len);
+	mu_assert_ptr_eq(find_pin(cache, getpid()), NULL);
+	mu_assert_uint_eq(cache->idx.hdr->npins, 0);
+
+	// The slot count shrinks once a burst of pins is released.
+	for (off_t i = 0; i < 100; i++) {
+		mu_assert_int_eq(ed_idx_pin(&cache->idx, ED_LCK_SH, i*len, len), 0);
+	}
+	mu_assert_uint_eq(cache->idx.hdr->npins, 100);
+	ed_idx_unpin(&cache->idx, 99*len, len);
+	mu_assert_uint_eq(cache->idx.hdr->npins, 99);
+	ed_idx_unpin(&cache->idx, 0, len);
+	mu_assert_uint_eq(cache->idx.hdr->npins, 99);
+	mu_assert_int_eq(ed_idx_pin(&cache->idx, ED_LCK_SH, 0, len), 0);
+	mu_assert_uint_eq(cache->idx.hdr->npins, 99);
+	for (off_t i = 98; i >= 0; i--) {
+		ed_idx_unpin(&cache->idx, i*len, len);
+	}
+	mu_assert_uint_eq(cache->idx.hdr->npins, 0);
+
+	close(ready[0]); close(ready[1]);
+	close(done[0]); close(done[1]);
+
+	mu_assert_int_eq(ed_open(cache, &obj, "a", 1, 0), 1);
+	size_t vlen;
+	const void *val = ed_value(obj, &vlen);
+	mu_assert_uint_eq(vlen, 5000);
+	assert_pattern(val, 0, vlen);
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	EdStat *stat;
+	mu_assert_int_eq(ed_stat_new(&stat, &cache->idx, 0), 0);
+	mu_assert(!ed_stat_has_leaks(stat));
+	mu_assert_uint_eq(stat->nmultused, 0);
+	ed_stat_free(&stat);
+
+	ed_cache_close(&cache);
+}
+
+static void
+test_optimistic(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &cfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	create_pattern(cache, "a", 5000);
+	create_pattern(cache, "b", 5000);
+
+	// Opening without a lock still reads the object.
+	EdObject *obj = NULL, *byid = NULL;
+	mu_assert_int_eq(ed_open(cache, &obj, "a", 1, ED_OOPTIMISTIC), 1);
+	mu_assert_uint_eq(cache->nlcks, 0);
+	size_t len;
+	const void *val = ed_value(obj, &len);
+	mu_assert_uint_eq(len, 5000);
+	assert_pattern(val, 0, len);
+	mu_assert_int_eq(ed_validate(obj), 0);
+
+	mu_assert_int_eq(ed_open(cache, &byid, ed_id(obj), 0, ED_OID|ED_OOPTIMISTIC), 1);
+	mu_assert_int_eq(ed_validate(byid), 0);
+	mu_assert_int_eq(ed_close(&byid), 0);
+
+	// Unlinking tombstones the header, so the read is no longer valid.
+	mu_assert_int_eq(ed_unlink(cache, "a", 1), 1);
+	mu_assert_int_eq(ed_validate(obj), ED_EOBJECT_CHANGED);
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	// An unlocked object does not prevent its region from being overwritten.
+	mu_assert_int_eq(ed_open(cache, &obj, "b", 1, ED_OOPTIMISTIC), 1);
+	static uint8_t buf[10000];
+	char key[32];
+	for (int i = 0; i < 2000; i++) {
+		EdObjectAttr attr = { .key = key };
+		attr.keylen = snprintf(key, sizeof(key), "key-%d", i);
+		memset(buf, i % 256, sizeof(buf));
+		mu_assert_int_eq(ed_set(cache, &attr, buf, sizeof(buf), -1), 0);
+	}
+	mu_assert_int_eq(ed_validate(obj), ED_EOBJECT_CHANGED);
+	mu_assert_int_eq(ed_close(&obj), 0);
+	mu_assert_int_eq(ed_open(cache, &obj, "b", 1, ED_OOPTIMISTIC), 0);
+
+	// A locked object always validates.
+	mu_assert_int_eq(ed_open(cache, &obj, "key-1999", 8, 0), 1);
+	mu_assert_int_eq(ed_validate(obj), 0);
+	mu_assert_int_eq(ed_close(&obj), 0);
+	mu_assert_uint_eq(cache->nlcks, 0);
+
+	ed_cache_close(&cache);
+}
+
 int
 main(void)
 {
 	mu_init("cache");
 
 	mu_run(test_create);
+	mu_run(test_splice);
+	mu_run(test_sendfile);
+	mu_run(test_open_many);
+	mu_run(test_exists);
+	mu_run(test_filter);
+	mu_run(test_rebuild);
+	mu_run(test_reap);
+	mu_run(test_clock);
+	mu_run(test_admit);
+	mu_run(test_tier);
+	mu_run(test_ring);
+	mu_run(test_pack);
+	mu_run(test_unlink);
+	mu_run(test_set);
+	mu_run(test_batch);
+	mu_run(test_mapslab);
+	mu_run(test_sync);
+	mu_run(test_threads);
+	mu_run(test_slabpin);
+	mu_run(test_optimistic);
 }
 
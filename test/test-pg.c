@@ -68,13 +68,15 @@ test_gc(void)
 	copy_pgno(pages, pgno, ed_len(pages));
 
 	idx.hdr->xid = 1;
-	ed_idx_acquire_xid(&idx);
+	EdTxnId xid;
+	mu_assert_int_eq(ed_idx_acquire_xid(&idx, &xid), 0);
 
 	mu_assert_int_eq(ed_free(&idx, 1, pages, ed_len(pages)/2), 0);
 	mu_assert_int_eq(ed_free(&idx, 2, pages+ed_len(pages)/2, ed_len(pages)/2), 0);
 
 	idx.hdr->xid = 2;
-	ed_idx_acquire_xid(&idx);
+	ed_idx_release_xid(&idx, xid);
+	mu_assert_int_eq(ed_idx_acquire_xid(&idx, &xid), 0);
 
 	mu_assert_int_eq(ed_alloc(&idx, pages, ed_len(pages), false), ed_len(pages));
 	for (size_t i = 0; i < ed_len(pages); i++) {
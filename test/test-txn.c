@@ -78,6 +78,7 @@ setup(EdTxn **txn)
 	// Testing hack. Don't do this!
 	x->db[0].entry_size = sizeof(Entry);
 	x->db[1].entry_size = sizeof(Entry);
+	x->db[2].entry_size = sizeof(Entry);
 
 	*txn = x;
 }
@@ -171,6 +172,196 @@ test_no_commit(void)
 	finish(&txn);
 }
 
+static void
+insert_many(EdTxn *txn, uint64_t n)
+{
+	Entry ent;
+	for (uint64_t i = 1; i <= n; i++) {
+		ent.key = i;
+		snprintf(ent.name, sizeof(ent.name), "a%" PRIu64, ent.key);
+		for (unsigned db = 0; db < ED_NDB; db++) {
+			mu_assert_int_eq(ed_bpt_find(txn, db, ent.key, NULL), 0);
+			mu_assert_int_eq(ed_bpt_set(txn, db, &ent, false), 0);
+		}
+	}
+}
+
+static void
+assert_no_leaks(void)
+{
+	EdStat *stat;
+	mu_assert_int_eq(ed_stat_new(&stat, &idx, FOPEN), 0);
+	mu_assert(!ed_stat_has_leaks(stat));
+	mu_assert_uint_eq(stat->nmultused, 0);
+	ed_stat_free(&stat);
+}
+
+static void
+test_large(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdTxn *txn;
+	setup(&txn);
+
+	// Allocate more pages than fit in the index header active list.
+	mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
+	insert_many(txn, 8000);
+	mu_assert_uint_eq(idx.hdr->nactive, ed_len(idx.hdr->active));
+	mu_assert_uint_ne(idx.hdr->active_next, ED_PG_NONE);
+	assert_no_leaks();
+	mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
+	mu_assert_uint_eq(idx.hdr->nactive, 0);
+	mu_assert_uint_eq(idx.hdr->active_next, ED_PG_NONE);
+	assert_no_leaks();
+
+	Entry *ent;
+	mu_assert_int_eq(ed_txn_open(txn, ED_FRDONLY|FOPEN), 0);
+	for (uint64_t i = 1; i <= 8000; i++) {
+		for (unsigned db = 0; db < ED_NDB; db++) {
+			mu_assert_int_eq(ed_bpt_find(txn, db, i, (void **)&ent), 1);
+			mu_assert_uint_eq(ent->key, i);
+		}
+	}
+	ed_txn_close(&txn, FRESET);
+
+	finish(&txn);
+}
+
+static void
+test_large_abandon(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdTxn *txn;
+	setup(&txn);
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		mu_fail("fork failed '%s'\n", strerror(errno));
+	}
+	if (pid == 0) {
+		EdTxn *ftxn;
+		setup(&ftxn);
+		mu_assert_int_eq(ed_txn_open(ftxn, FOPEN), 0);
+		insert_many(ftxn, 8000);
+		_exit(0);
+	}
+
+	int status;
+	mu_assert_call(waitpid(pid, &status, 0));
+	mu_assert_int_eq(WEXITSTATUS(status), 0);
+
+	// The abandoned pages remain active until the next writer reclaims them.
+	mu_assert_uint_ne(idx.hdr->active_next, ED_PG_NONE);
+	assert_no_leaks();
+
+	mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
+	mu_assert_uint_eq(idx.hdr->active_next, ED_PG_NONE);
+	ed_txn_close(&txn, FRESET);
+	assert_no_leaks();
+
+	finish(&txn);
+}
+
+static void
+test_grow_snapshot(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdTxn *txn, *rtxn;
+	setup(&txn);
+	mu_assert_int_eq(ed_txn_new(&rtxn, &idx), 0);
+	rtxn->db[0].entry_size = sizeof(Entry);
+
+	mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
+	insert_many(txn, 100);
+	mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
+
+	// Hold node pointers from a read snapshot while the file grows.
+	Entry *ent;
+	mu_assert_int_eq(ed_txn_open(rtxn, ED_FRDONLY|FOPEN), 0);
+	mu_assert_int_eq(ed_bpt_find(rtxn, 0, 50, (void **)&ent), 1);
+	const EdPgno mapcount = idx.mapcount;
+	struct stat before, after;
+	mu_assert_call(fstat(idx.fd, &before));
+
+	Entry add;
+	mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
+	for (uint64_t i = 101; i <= 8000; i++) {
+		add.key = i;
+		snprintf(add.name, sizeof(add.name), "a%" PRIu64, add.key);
+		for (unsigned db = 0; db < ED_NDB; db++) {
+			mu_assert_int_eq(ed_bpt_find(txn, db, add.key, NULL), 0);
+			mu_assert_int_eq(ed_bpt_set(txn, db, &add, false), 0);
+		}
+	}
+	mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
+	mu_assert_call(fstat(idx.fd, &after));
+	mu_assert_int_gt(after.st_size, before.st_size);
+
+	// A new snapshot extends the mapping to reach the new pages.
+	Entry *last;
+	mu_assert_int_eq(ed_txn_open(txn, ED_FRDONLY|FOPEN), 0);
+	mu_assert_int_eq(ed_bpt_find(txn, 0, 8000, (void **)&last), 1);
+	mu_assert_str_eq(last->name, "a8000");
+	mu_assert_uint_gt(idx.mapcount, mapcount);
+
+	// The older snapshot pointers still reference the same mapping.
+	mu_assert_uint_eq(ent->key, 50);
+	mu_assert_str_eq(ent->name, "a50");
+	Entry *again;
+	mu_assert_int_eq(ed_bpt_find(rtxn, 0, 50, (void **)&again), 1);
+	mu_assert_ptr_eq(again, ent);
+	mu_assert_int_eq(ed_bpt_find(rtxn, 0, 8000, NULL), 0);
+	ed_txn_close(&rtxn, FCLOSE);
+	ed_txn_close(&txn, FRESET);
+	assert_no_leaks();
+
+	finish(&txn);
+}
+
+static void
+test_map_fallback(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdTxn *txn;
+	setup(&txn);
+
+	// Extend the file sparsely past the reserved mapping.
+	mu_assert_call(ftruncate(idx.fd, (off_t)(ED_IDX_MAP_MAX + 1) * PAGESIZE));
+
+	// Pages within the reserved range stay mapped after being released.
+	EdPg *pg = ed_idx_map(&idx, ED_IDX_MAP_MAX - 1);
+	mu_assert_ptr_ne(pg, MAP_FAILED);
+	mu_assert_uint_eq(idx.mapcount, ED_IDX_MAP_MAX);
+	mu_assert_ptr_eq(pg, idx.map + (size_t)(ED_IDX_MAP_MAX - 1) * PAGESIZE);
+	pg->no = ED_IDX_MAP_MAX - 1;
+	ed_idx_unmap(&idx, pg);
+	mu_assert_uint_eq(pg->no, ED_IDX_MAP_MAX - 1);
+	mu_assert_ptr_eq(ed_idx_map(&idx, ED_IDX_MAP_MAX - 1), pg);
+
+	// Pages beyond it are mapped individually.
+	pg = ed_idx_map(&idx, ED_IDX_MAP_MAX);
+	mu_assert_ptr_ne(pg, MAP_FAILED);
+	mu_assert((uint8_t *)pg < idx.map ||
+			(uint8_t *)pg >= idx.map + (size_t)ED_IDX_MAP_MAX * PAGESIZE);
+	pg->no = ED_IDX_MAP_MAX;
+	ed_idx_unmap(&idx, pg);
+
+	pg = ed_idx_map(&idx, ED_IDX_MAP_MAX);
+	mu_assert_ptr_ne(pg, MAP_FAILED);
+	mu_assert_uint_eq(pg->no, ED_IDX_MAP_MAX);
+	ed_idx_unmap(&idx, pg);
+
+	finish(&txn);
+}
+
 static void
 test_read_snapshot(void)
 {
@@ -304,6 +495,47 @@ test_write_sequence(void)
 	}
 }
 
+static void
+test_group_sync(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdTxn *txn;
+	setup(&txn);
+
+	const uint64_t fsync = (FRESET & ~ED_FNOSYNC) | ED_FGROUPSYNC;
+	Entry ent;
+
+	mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
+	ent.key = 10;
+	snprintf(ent.name, sizeof(ent.name), "a%" PRIu64, ent.key);
+	mu_assert_int_eq(ed_bpt_find(txn, 0, ent.key, NULL), 0);
+	mu_assert_int_eq(ed_bpt_set(txn, 0, &ent, false), 0);
+	mu_assert_int_eq(ed_txn_commit(&txn, fsync), 0);
+	mu_assert_uint_eq(idx.hdr->xid_written, idx.hdr->xid);
+	mu_assert_uint_eq(idx.hdr->xid_synced, idx.hdr->xid);
+
+	// A commit without syncing is covered by the next group sync.
+	EdTxnId xid = idx.hdr->xid;
+	mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
+	ent.key = 20;
+	snprintf(ent.name, sizeof(ent.name), "a%" PRIu64, ent.key);
+	mu_assert_int_eq(ed_bpt_find(txn, 0, ent.key, NULL), 0);
+	mu_assert_int_eq(ed_bpt_set(txn, 0, &ent, false), 0);
+	mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
+	mu_assert_uint_gt(idx.hdr->xid, xid);
+	mu_assert_uint_eq(idx.hdr->xid_written, idx.hdr->xid);
+	mu_assert_uint_eq(idx.hdr->xid_synced, xid);
+
+	mu_assert_int_eq(ed_idx_sync(&idx, idx.hdr->xid, FOPEN), 0);
+	mu_assert_uint_eq(idx.hdr->xid_synced, idx.hdr->xid);
+	mu_assert_int_eq(ed_idx_sync(&idx, xid, FOPEN), 0);
+	mu_assert_uint_eq(idx.hdr->xid_synced, idx.hdr->xid);
+
+	finish(&txn);
+}
+
 int
 main(void)
 {
@@ -321,6 +553,11 @@ main(void)
 	mu_run(test_no_key);
 	mu_run(test_close);
 	mu_run(test_no_commit);
+	mu_run(test_large);
+	mu_run(test_large_abandon);
+	mu_run(test_grow_snapshot);
+	mu_run(test_map_fallback);
 	mu_run(test_read_snapshot);
 	mu_run(test_write_sequence);
+	mu_run(test_group_sync);
 }